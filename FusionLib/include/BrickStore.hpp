@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*!
+ * Swap file of a paged Volume. Every brick written once gets a fixed record of brickBytes in the file, later writes of
+ * the same brick overwrite it. Writes are queued and performed by a background thread, so evicting a brick only
+ * costs a copy. Reads of queued bricks are served from the queue, all other reads go to the file synchronously.
+ * All methods except the writer thread itself are meant to be called from one thread, the one driving the volume.
+ */
+class BrickStore {
+public:
+    /*!
+     * Creates or truncates the swap file, which is removed again by the destructor.
+     * @param maxPendingBytes write calls block while this many bytes are queued
+     */
+    BrickStore(const std::string& path, size_t brickBytes, size_t maxPendingBytes);
+    ~BrickStore();
+
+    BrickStore(const BrickStore&) = delete;
+    BrickStore& operator=(const BrickStore&) = delete;
+
+    //! @return false if the file could not be created, writes and reads then fail
+    bool isOpen() const;
+
+    //! @return true if the brick has been written before
+    bool contains(uint64_t key) const {
+        return m_records.count(key) != 0;
+    }
+
+    //! bricks of the store and the offsets of their records
+    const std::unordered_map<uint64_t, size_t>& getRecords() const;
+
+    //! queues brickBytes of data for writing, blocks while the queue is full
+    void write(uint64_t key, const char* data);
+
+    /*!
+     * Reads a brick written before into data.
+     * @return false if the brick is unknown or the file could not be read
+     */
+    bool read(uint64_t key, char* data);
+
+    //! blocks until all queued writes are in the file
+    void flush();
+
+    //! @return seconds the caller spent waiting for reads from the file and for a full queue
+    double getStallSeconds() const;
+
+private:
+    struct Pending {
+        std::vector<char> data;
+        size_t offset;
+    };
+
+    void writerLoop();
+
+    const std::string m_path;
+    const size_t m_brickBytes;
+    const size_t m_maxPendingBytes;
+    std::FILE* m_file;
+    //access to the file, shared by the reads and the writer thread
+    std::mutex m_fileMutex;
+    //key -> offset of the record, only used by the calling thread
+    std::unordered_map<uint64_t, size_t> m_records;
+    double m_stallSeconds = 0.;
+
+    //write queue, guarded by m_mutex. A brick queued again before it is written keeps its place in the queue
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::unordered_map<uint64_t, Pending> m_pending;
+    std::deque<uint64_t> m_queue;
+    size_t m_pendingBytes = 0;
+    //brick currently written by the writer thread, readable until the write is finished
+    uint64_t m_inFlightKey = 0;
+    Pending m_inFlight;
+    bool m_stop = false;
+    std::thread m_writer;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+class Volume;
+
+/*!
+ * Per brick summary of a volume, for the same 8x8x8 voxel bricks as DirtyBricks: whether the brick has observed
+ * voxels, the range of their tsdf and whether they lie on both sides of the surface. Loops over the volume consult it
+ * to skip whole bricks: the raycast steps over bricks without a negative tsdf, marching cubes over bricks without a
+ * surface and the tsdf export over unobserved bricks. See Volume::enableBrickSummary for how it is kept current.
+ */
+class BrickSummary {
+public:
+    static constexpr int BrickShift = 3;
+    static constexpr int BrickSize = 1 << BrickShift;
+
+    using BrickList = std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>>;
+
+    enum Flags : uint8_t {
+        //at least one voxel of the brick has a weight > 0
+        Observed = 1,
+        //observed voxels with tsdf <= 0 and with tsdf > 0, the surface passes through the brick
+        ZeroCrossing = 2
+    };
+
+    struct Brick {
+        //range of the tsdf of the observed voxels, only valid if Observed is set
+        float minTSDF = 0.f;
+        float maxTSDF = 0.f;
+        uint8_t flags = 0;
+    };
+
+    //! all bricks start unobserved
+    explicit BrickSummary(const Eigen::Vector3i& volumeSize);
+
+    const Brick& getBrick(int brickX, int brickY, int brickZ) const {
+        return m_bricks[brickX + m_brickCount.x() * (brickY + size_t(m_brickCount.y()) * brickZ)];
+    }
+
+    bool isObserved(int brickX, int brickY, int brickZ) const {
+        return getBrick(brickX, brickY, brickZ).flags & Observed;
+    }
+
+    bool hasZeroCrossing(int brickX, int brickY, int brickZ) const {
+        return getBrick(brickX, brickY, brickZ).flags & ZeroCrossing;
+    }
+
+    /*!
+     * @return true if a voxel of the brick may have a negative tsdf. Unobserved voxels have the tsdf 0, so a ray
+     * sampling the voxels of a brick without one can neither pass the surface nor leave it there
+     */
+    bool hasNegativeTSDF(int brickX, int brickY, int brickZ) const {
+        const Brick& brick = getBrick(brickX, brickY, brickZ);
+        return (brick.flags & Observed) && brick.minTSDF < 0.f;
+    }
+
+    /*!
+     * @return true if a marching cube with its first corner in the brick can produce triangles: the corner has to be
+     * observed and the cube, which reaches one voxel into the bricks above along x, y and z, needs observed corners on
+     * both sides of the surface
+     */
+    bool mayContainSurface(int brickX, int brickY, int brickZ) const;
+
+    //! recomputes the bricks [begin, end) of the list from the voxels of the volume, disjoint ranges may be updated
+    //! concurrently
+    void update(Volume& volume, const BrickList& bricks, size_t begin, size_t end);
+
+    //! recomputes all bricks
+    void rebuild(Volume& volume);
+
+    /*!
+     * Follows Volume::shift: the brick b afterwards is the brick b + bricks before, the bricks entering the volume
+     * are unobserved
+     */
+    void shift(const Eigen::Vector3i& bricks);
+
+    //! number of bricks along each axis, partial bricks at the upper border included
+    const Eigen::Vector3i& getBrickCount() const;
+
+    //! @return number of bricks with all of the given flags set
+    size_t count(uint8_t flags) const;
+
+private:
+    /*!
+     * Recomputes the bricks [begin, end) of the list, readVoxel(index, tsdf) sets the tsdf of the voxel with the given
+     * index into the storage of the volume and returns whether it is observed
+     */
+    template<typename ReadVoxel>
+    void updateBricks(Volume& volume, const BrickList& bricks, size_t begin, size_t end, ReadVoxel readVoxel);
+
+    Eigen::Vector3i m_brickCount;
+    std::vector<Brick> m_bricks;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/*!
+ * Pinhole model of the depth camera with per-pixel lookup tables.
+ * For every pixel (u,v) the ray ((u-cx)/fx, (v-cy)/fy, 1), its unit direction and its norm (lambda) are computed
+ * once, so back-projection, raycasting and the sdf computation of the integration do not need divisions or square
+ * roots per pixel. Models are shared between frames with the same intrinsics and resolution, see create().
+ */
+class CameraModel {
+public:
+    //! number of models create() keeps, the least recently requested one is dropped first
+    static constexpr size_t MaxCachedModels = 4;
+
+    CameraModel(const Eigen::Matrix3d& intrinsics, unsigned int width, unsigned int height);
+
+    /*!
+     * @return the cached model for the given intrinsics and resolution, the tables are only built on the first call.
+     * A model dropped from the cache stays valid for the frames holding it.
+     */
+    static std::shared_ptr<const CameraModel> create(const Eigen::Matrix3d& intrinsics,
+                                                     unsigned int width, unsigned int height);
+
+    //! ray through the pixel center with z = 1
+    const Eigen::Vector3d& getRay(unsigned int u, unsigned int v) const {
+        return m_rays[u + v * m_width];
+    }
+
+    //! normalized ray through the pixel center
+    const Eigen::Vector3d& getRayDirection(unsigned int u, unsigned int v) const {
+        return m_directions[u + v * m_width];
+    }
+
+    //! norm of getRay(u, v), converts the distance along the ray into depth
+    double getLambda(unsigned int u, unsigned int v) const {
+        return m_lambdas[u + v * m_width];
+    }
+
+    //! 1 / getLambda per pixel in single precision, indexed u + v * width, for the vectorized integration
+    const float* getInverseLambdas() const {
+        return m_inverseLambdas.data();
+    }
+
+    const Eigen::Matrix3d& getIntrinsics() const;
+
+    unsigned int getWidth() const;
+
+    unsigned int getHeight() const;
+
+private:
+    Eigen::Matrix3d m_intrinsics;
+    unsigned int m_width;
+    unsigned int m_height;
+
+    std::vector<Eigen::Vector3d> m_rays;
+    std::vector<Eigen::Vector3d> m_directions;
+    std::vector<double> m_lambdas;
+    std::vector<float> m_inverseLambdas;
+};
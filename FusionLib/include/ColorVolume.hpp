@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Eigen.h"
+#include "MappedAllocator.hpp"
+
+//! voxel of a ColorVolume, RGB and the number of blended observations, saturating at ColorVolume::MaxWeight
+struct ColorVoxel {
+    uint8_t rgb[3];
+    uint8_t weight;
+
+    ColorVoxel()
+            : rgb{0, 0, 0}, weight(0) {}
+};
+
+/*!
+ * Colors of a volume in a separate grid with downsampling^3 voxels of the volume per color voxel. The color images are
+ * softer than the depth, so a half or quarter resolution grid loses little detail and needs an eighth or a 64th of
+ * the voxels. The grid covers the voxels of the volume, its voxel (x, y, z) the voxels [x, x + 1) * downsampling along
+ * every axis. Colors are read with trilinear interpolation at global points, see Volume::enableColorVolume.
+ */
+class ColorVolume {
+public:
+    static constexpr int MaxWeight = 255;
+
+    /*!
+     * @param origin, volumeSize, voxelScale the geometry of the volume
+     * @param downsampling voxels of the volume per color voxel along each axis, the grid is rounded up to whole color
+     * voxels
+     */
+    ColorVolume(const Eigen::Vector3d& origin, const Eigen::Vector3i& volumeSize, double voxelScale, int downsampling);
+
+    int getDownsampling() const;
+
+    //! corner of the color voxel (0, 0, 0), the origin of the volume
+    const Eigen::Vector3d& getOrigin() const;
+
+    //! number of color voxels along each axis
+    const Eigen::Vector3i& getSize() const;
+
+    double getVoxelScale() const;
+
+    //! @return center of the color voxel (x, y, z)
+    Eigen::Vector3d getGlobalCoordinate(int x, int y, int z) const {
+        return m_origin + (Eigen::Vector3d(x, y, z) + Eigen::Vector3d::Constant(0.5)) * m_voxelScale;
+    }
+
+    ColorVoxel& getVoxel(int x, int y, int z) {
+        return m_voxels[x + m_size.x() * (y + size_t(m_size.y()) * z)];
+    }
+
+    const ColorVoxel& getVoxel(int x, int y, int z) const {
+        return m_voxels[x + m_size.x() * (y + size_t(m_size.y()) * z)];
+    }
+
+    /*!
+     * Trilinear interpolation of the colors of the voxel centers around the global point. Unobserved voxels and voxels
+     * outside the grid are left out.
+     * @return the color with an opaque alpha channel, transparent black if none of the voxels is observed
+     */
+    Vector4uc getColor(const Eigen::Vector3d& global) const;
+
+    //! blends the color of a pixel into the voxel with the weight 1, like the running average of the voxel colors
+    static void updateVoxel(ColorVoxel& voxel, const Vector4uc& color);
+
+    /*!
+     * Follows Volume::shift of a rolling volume by the given number of its voxels, which have to be multiples of the
+     * downsampling: the color voxels entering the grid are unobserved and the origin moves along.
+     */
+    void shift(const Eigen::Vector3i& voxels);
+
+    //! bytes reserved for the color voxels
+    size_t getMemoryUsage() const;
+
+    //! bytes of getMemoryUsage which are resident, see residentBytes
+    size_t getResidentMemoryUsage() const;
+
+private:
+    Eigen::Vector3d m_origin;
+    Eigen::Vector3i m_size;
+    double m_voxelScale;
+    int m_downsampling;
+    std::vector<ColorVoxel, MappedAllocator<ColorVoxel>> m_voxels;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/*!
+ * Set of the 8x8x8 voxel bricks of a volume which have been modified, one bit per brick.
+ * Fusion::reconstructSurface fills it with the bricks that received at least one update, so TSDFPyramid::update and
+ * VolumeCheckpoint::markBricks only have to look at the changed part of the volume. MarchingCubes and
+ * MeshWriter::toFileTSDF always process the whole volume. Bricks can be marked from several threads at once.
+ */
+class DirtyBricks {
+public:
+    static constexpr int BrickShift = 3;
+    static constexpr int BrickSize = 1 << BrickShift;
+
+    explicit DirtyBricks(const Eigen::Vector3i& volumeSize);
+
+    DirtyBricks(const DirtyBricks& other);
+    DirtyBricks& operator=(const DirtyBricks& other);
+
+    //! marks the brick containing the voxel (x, y, z)
+    void mark(int x, int y, int z) {
+        markBrick(x >> BrickShift, y >> BrickShift, z >> BrickShift);
+    }
+
+    //! marks all bricks containing the voxels [xBegin, xEnd) of the row (y, z)
+    void markRow(int y, int z, int xBegin, int xEnd);
+
+    //! adds all bricks of other, which has to belong to a volume of the same size
+    void merge(const DirtyBricks& other);
+
+    void clear();
+
+    /*!
+     * Moves the marks along with a rolling volume shifted by the given number of bricks, see Volume::shift: the
+     * brick b is marked as b - bricks afterwards, marks leaving the volume are dropped.
+     */
+    void shift(const Eigen::Vector3i& bricks);
+
+    bool contains(int brickX, int brickY, int brickZ) const;
+
+    //! @return true if the brick containing the voxel (x, y, z) is marked
+    bool containsVoxel(int x, int y, int z) const {
+        return contains(x >> BrickShift, y >> BrickShift, z >> BrickShift);
+    }
+
+    //! @return number of marked bricks
+    size_t count() const;
+
+    bool empty() const;
+
+    //! @return brick coordinates of all marked bricks, ordered by z, y and x
+    std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> getBricks() const;
+
+    //! number of bricks along each axis, partial bricks at the upper border included
+    const Eigen::Vector3i& getBrickCount() const;
+
+private:
+    void markBrick(int brickX, int brickY, int brickZ) {
+        const size_t index = brickX + m_brickCount.x() * (brickY + size_t(m_brickCount.y()) * brickZ);
+        const uint64_t bit = uint64_t(1) << (index & 63);
+        std::atomic<uint64_t>& word = m_words[index >> 6];
+        // most calls hit an already marked brick, so only write if the bit is missing
+        if (!(word.load(std::memory_order_relaxed) & bit))
+            word.fetch_or(bit, std::memory_order_relaxed);
+    }
+
+    Eigen::Vector3i m_brickCount;
+    size_t m_numWords;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+};
@@ -7,6 +7,7 @@
 
 #include <vector>
 #include "data_types.h"
+#include "CameraModel.hpp"
 #include <Eigen.h>
 
 #ifndef MINF
@@ -49,6 +50,8 @@ public:
 
     const Eigen::Matrix3d& getIntrinsics() const;
 
+    const CameraModel& getCameraModel() const;
+
     const unsigned int getWidth() const;
 
     const unsigned int getHeight() const;
@@ -87,6 +90,7 @@ private:
     Eigen::Matrix3d m_intrinsic_matrix;
     Eigen::Matrix3d m_color_intrinsic_matrix;
     Eigen::Matrix4d m_d2cExtrinsics;
+    std::shared_ptr<const CameraModel> m_camera;
 
     std::vector<double> m_depth_map;
     std::vector<Vector4uc> m_color_map;
@@ -1,26 +1,202 @@
 #pragma once
 
 #include "Volume.hpp"
+#include "SimdIntegrator.hpp"
+#include "ViewFrustum.hpp"
+#include "DirtyBricks.hpp"
 #include <Frame.h>
 #include <memory>
+#include <functional>
+#include <tuple>
 class Fusion {
 public:
+    explicit Fusion(unsigned int numThreads = 1);
+
 //THIS method expects frame to hold all camera paramerters as well as the estimated pose --> TODO: check if those values are set or redefine method parameters
 
-    bool reconstructSurface(const std::shared_ptr<Frame>& currentFrame,const std::shared_ptr<Volume>& volume,double truncationDistance);
+    /*!
+     * Integrates a posed frame into the volume. For a VolumeLayout::Hashed volume the bricks in the truncation band
+     * of the frame are allocated first, and only they are integrated. A paged volume then evicts the bricks not used
+     * recently, see Volume::enablePaging.
+     * @param dirtyBricks if given, every brick which received at least one voxel update is marked in it, as is every
+     * brick overlapping an updated voxel of the ColorVolume. Marks are only added, so the set can collect the changes
+     * of several frames, e.g. between two checkpoints.
+     * The BrickSummary of the volume, if enabled, is updated for the changed bricks, and the frame is integrated into
+     * its ColorVolume, if there is one.
+     */
+    bool reconstructSurface(const std::shared_ptr<Frame>& currentFrame,const std::shared_ptr<Volume>& volume,double truncationDistance,
+                            DirtyBricks* dirtyBricks = nullptr);
+
+    /*!
+     * Sets the number of worker threads used for the integration. The volume is split into z-slabs which are
+     * handed out to the workers, every voxel is written by exactly one thread, therefore no locking is required
+     * and the result is identical to the serial integration.
+     * @param numThreads number of workers, 0 is treated as 1
+     */
+    void setNumThreads(unsigned int numThreads);
+
+    unsigned int getNumThreads() const;
+
+    /*!
+     * Selects between the double precision reference loop and the vectorized row kernel (see SimdIntegrator).
+     * Fixed point and planar volumes are always integrated with the integer version of the vectorized kernel.
+     * Simd by default, like Config::m_integrationKernel.
+     */
+    void setIntegrationKernel(IntegrationKernel kernel);
+
+    IntegrationKernel getIntegrationKernel() const;
+
+    /*!
+     * Selects between sweeping the voxels of the camera frustum and splatting the depth pixels into the volume.
+     * Splatting marches the ray of every valid pixel through the +-truncation band around its depth, so its cost
+     * scales with the image size and not with the volume resolution. Voxels in front of the band are not updated.
+     * Inside the band it performs the same update as the voxel sweep: a voxel is only touched by the pixel its
+     * center projects to.
+     */
+    void setIntegrationMode(IntegrationMode mode);
+
+    IntegrationMode getIntegrationMode() const;
 
 private:
 
+    //! brick of a hashed volume, given by its first voxel and its level
+    struct LevelBrick {
+        Eigen::Vector3i first;
+        int level;
+
+        bool operator<(const LevelBrick& other) const {
+            return std::make_tuple(level, first.z(), first.y(), first.x()) <
+                   std::make_tuple(other.level, other.first.z(), other.first.y(), other.first.x());
+        }
+
+        bool operator==(const LevelBrick& other) const {
+            return level == other.level && first == other.first;
+        }
+    };
 
+    using Bricks = std::vector<LevelBrick>;
+
+    //! integrates the frame without updating the brick summary, see reconstructSurface
+    bool integrateFrame(const std::shared_ptr<Frame>& currentFrame, const std::shared_ptr<Volume>& volume,
+                        double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Blends the colors of a frame into the color voxels whose centers lie within a band around the measured surface,
+     * see Volume::enableColorVolume. Independent of the integration mode, the color voxels in the frustum are swept.
+     * The bricks of the volume overlapping updated color voxels are marked in dirtyBricks, if given.
+     */
+    void integrateColor(Frame& currentFrame, ColorVolume& colors, double truncationDistance, DirtyBricks* dirtyBricks);
+
+    //! splats the depth pixels of a frame into the volume, see IntegrationMode::DepthSplatting
+    void splatFrame(const std::shared_ptr<Frame>& currentFrame, const std::shared_ptr<Volume>& volume,
+                    double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Everything the voxel sweep needs to know about the integrated frame.
+     */
+    struct FrameContext {
+        FrameContext(Frame& frame, Volume& volume, double truncationDistance, bool simd);
+
+        Frame& frame;
+        // world to camera transformation
+        Eigen::Matrix3d rotation;
+        Eigen::Vector3d translation;
+        // only the voxels inside the camera frustum can receive an update
+        ViewFrustum frustum;
+        //single precision copy of the depth map used by the vectorized kernel
+        std::vector<float> depthMapF;
+        SimdIntegrator::FrameData frameData;
+    };
+
+    /*!
+     * Integrates all voxels with z in [zBegin, zEnd) which lie inside the frustum of the frame into the volume.
+     */
+    void integrateSlab(int zBegin, int zEnd, const FrameContext& context, Volume& volume,
+                       double truncationDistance, DirtyBricks* dirtyBricks);
 
     /*!
-         * The original implementation actually takes a raw depth Value, as we already calculated the camereSpacePoints
-         * only the normalization has to be done.
-         * TODO: move normalization to frame.cpp ; check if the cameraSpaceTransformation in frame.cpp equals the one used in Paper
-         * @param cameraSpacePoint
-         * @return the normalized cameraSpaceCoordinates
-         */
-    double calculateLamdas(Eigen::Vector2i& cameraSpacePoint,Eigen::Matrix3d intrinsics);
+     * Integrates the bricks [begin, end) of a hashed volume with the frame, the bricks have to be allocated.
+     */
+    void integrateBricks(int begin, int end, const Bricks& bricks, const FrameContext& context,
+                         Volume& volume, double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Integrates a brick of a level > 0 with SimdIntegrator. Its samples are updated like voxels of 2^level times the
+     * voxel size at their centers, with the truncation distance scaled by 2^level. The frustum test is left to the
+     * kernel.
+     */
+    void integrateCoarseBrick(const LevelBrick& brick, const FrameContext& context, Volume& volume,
+                              DirtyBricks* dirtyBricks);
+
+    /*!
+     * Integrates the voxels [xMin, xMax) of the row (y, z) which lie inside the frustum of the frame and marks the
+     * updated ones in dirtyBricks, if given.
+     */
+    void integrateVisibleRow(const FrameContext& context, int y, int z, int xMin, int xMax, Volume& volume,
+                             double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Allocates the bricks of a hashed volume which intersect the truncation band of a frame. The pixel center rays
+     * are traversed brick by brick over [depth - truncationDistance, depth + truncationDistance], widened like the
+     * band of the depth splatting, so the bricks of the voxels the frame can update are allocated. Free space in
+     * front of the band is not stored. Every pixel allocates at the level Volume::getLevelForDepth selects for its
+     * depth, with the truncation distance of that level. A new brick below a coarser one starts with its resampled
+     * data, so the newly allocated bricks are marked in dirtyBricks, if given, even if no voxel of them is updated.
+     * @return all bricks in the band, newly allocated or not, ordered by level, z, y and x
+     */
+    Bricks allocateBricks(Frame& currentFrame, Volume& volume, double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Integrates the voxels [xBegin, xEnd) of the row (y, z) with the double precision reference loop.
+     * @return the range between the first and the last updated voxel
+     */
+    SimdIntegrator::Range integrateRow(const FrameContext& context, int y, int z, int xBegin, int xEnd, Volume& volume,
+                                       double truncationDistance);
+
+    //! @return true if the rows of the volume are integrated by SimdIntegrator
+    bool useSimdKernel(Volume& volume) const;
+
+    /*!
+     * Same as integrateRow, but walks the row incrementally and hands it to the vectorized kernel.
+     */
+    SimdIntegrator::Range integrateRowSimd(const FrameContext& context, int y, int z, int xBegin, int xEnd,
+                                           Volume& volume);
+
+    /*!
+     * Hands the voxels [xBegin, xEnd) of a row, which are stored contiguously from the voxel index rowIdx on, to the
+     * vectorized kernel of the storage of the volume.
+     */
+    SimdIntegrator::Range integrateContiguousRow(const SimdIntegrator::FrameData& frameData, const Eigen::Vector3f& p0,
+                                                 const Eigen::Vector3f& delta, int xBegin, int xEnd, Volume& volume,
+                                                 size_t rowIdx);
+
+    /*!
+     * Splats the depth pixels of the image rows [vBegin, vEnd) into the volume.
+     */
+    void integratePixelRows(int vBegin, int vEnd, Frame& currentFrame, Volume& volume,
+                            const Eigen::Matrix3d& rotation, const Eigen::Vector3d& translation,
+                            double truncationDistance, DirtyBricks* dirtyBricks);
+
+    /*!
+     * Applies the weighted running average of the tsdf, weight and color of a single voxel.
+     * @param sdf signed distance of the voxel, has to be >= -truncationDistance
+     * @param image_color color of the pixel the voxel projects to
+     */
+    void updateVoxel(Voxel& voxel, double sdf, const Vector4uc& image_color, double truncationDistance);
+
+    /*!
+     * Splits [begin, end) into chunks which are processed by up to m_numThreads threads.
+     */
+    void parallelFor(int begin, int end, int chunkSize, const std::function<void(int, int)>& body) const;
+
+    /*!
+     * Like parallelFor over the z-range [begin, end) of a volume placed on NUMA nodes (see Volume::placeSlabs): the
+     * chunks of every slab are processed by threads pinned to the node holding its memory. The workers are divided
+     * among the nodes by their number of cpus, every node with voxels in [begin, end) gets at least one.
+     */
+    void parallelForPlaced(int begin, int end, int chunkSize, const std::vector<Volume::SlabPlacement>& placement,
+                           const std::function<void(int, int)>& body) const;
+
     /*!
      *
      * @param lambda
@@ -31,6 +207,8 @@ private:
 
     double calculateSDF(double& lambda,Eigen::Vector3d& cameraPosition,double rawDepthValue);
 
-};
-
+    unsigned int m_numThreads;
+    IntegrationKernel m_kernel;
+    IntegrationMode m_mode;
 
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+/*!
+ * Decides whether a tracked frame is worth integrating.
+ * The pose of every frame is compared with the pose of the last integrated frame. As long as the camera moved less
+ * than the translation and rotation thresholds the frame is skipped, but at least every (maxSkippedFrames+1)-th frame
+ * is integrated, so a static camera still integrates at a reduced cadence.
+ * Setting both thresholds to 0 integrates every frame.
+ */
+class IntegrationScheduler {
+public:
+    /*!
+     * @param minTranslation translation in meters which triggers an integration
+     * @param minRotation rotation angle in radians which triggers an integration
+     * @param maxSkippedFrames number of consecutive frames which may be skipped
+     */
+    IntegrationScheduler(double minTranslation, double minRotation, unsigned int maxSkippedFrames);
+
+    /*!
+     * @param pose camera to world pose estimated by icp::estimatePose
+     * @return true if the frame should be integrated, the pose then becomes the new reference
+     */
+    bool shouldIntegrate(const Eigen::Matrix4d& pose);
+
+    unsigned int getIntegratedFrames() const;
+
+    unsigned int getSkippedFrames() const;
+
+private:
+    double m_minTranslation;
+    double m_minRotation;
+    unsigned int m_maxSkippedFrames;
+
+    bool m_hasReference;
+    Eigen::Matrix4d m_lastIntegratedPose;
+    unsigned int m_consecutiveSkips;
+
+    unsigned int m_integratedFrames;
+    unsigned int m_skippedFrames;
+};
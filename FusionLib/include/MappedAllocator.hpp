@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/*!
+ * Allocates bytes of zero filled memory. Blocks of at least 1 MiB are anonymous memory mappings, the kernel hands out
+ * zero pages on the first write, so they are only committed where they are touched. Smaller blocks come from calloc.
+ * @return nullptr if the memory is exhausted
+ */
+void* mappedAllocate(size_t bytes);
+
+//! releases a block of mappedAllocate, bytes has to be the allocated size
+void mappedFree(void* p, size_t bytes);
+
+/*!
+ * Resets [p, p + bytes) of a block of mappedAllocate to zero. The whole pages inside the range are returned to the
+ * system, so they are no longer resident until they are written again.
+ */
+void mappedDiscard(void* p, size_t bytes);
+
+/*!
+ * Asks the system to back the whole pages inside [p, p + bytes) of a block of mappedAllocate with transparent huge
+ * pages, which cuts the TLB misses of the scattered voxel accesses. A huge page is committed as a whole on its first
+ * write, so the memory is committed in steps of 2 MiB instead of single pages.
+ * @return false if the platform or the kernel configuration does not support it
+ */
+bool mappedAdviseHugePages(void* p, size_t bytes);
+
+/*!
+ * @return number of bytes of the pages overlapping [p, p + bytes) which are resident in physical memory, bytes if
+ * the platform cannot tell
+ */
+size_t residentBytes(const void* p, size_t bytes);
+
+/*!
+ * Allocator for the voxel arrays of a Volume, backed by mappedAllocate. All voxel types represent "unobserved" by
+ * all-zero bytes, so value-initialization (resize(n) without a value) does not write anything: the new elements are
+ * already zero and a large volume starts without committing memory.
+ * This only holds for memory which has never been used, elements re-created in capacity freed by a shrinking resize
+ * would keep their old bytes. A volume only shrinks its arrays when it pages bricks out, and clears the freed range
+ * with mappedDiscard.
+ */
+template<typename T>
+class MappedAllocator {
+public:
+    using value_type = T;
+
+    MappedAllocator() = default;
+
+    template<typename U>
+    MappedAllocator(const MappedAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        void* p = mappedAllocate(n * sizeof(T));
+        if (!p)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        mappedFree(p, n * sizeof(T));
+    }
+
+    //! value-initialization, the memory is already zero
+    template<typename U>
+    void construct(U*) noexcept {}
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    bool operator==(const MappedAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const MappedAllocator<U>&) const noexcept {
+        return false;
+    }
+};
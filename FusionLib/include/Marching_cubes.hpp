@@ -9,6 +9,9 @@
 class MarchingCubes {
 public:
 	static void extractMesh( Volume& volume, std::string fileName);
+	//! meshes the cubes with their first corner in [minVoxel, maxVoxel), e.g. a slab leaving a rolling volume
+	static void extractMesh(Volume& volume, std::string fileName, const Eigen::Vector3i& minVoxel,
+							const Eigen::Vector3i& maxVoxel);
 };
 
 
@@ -6,6 +6,8 @@
 #include <iostream>
 #include "Frame.h"
 #include "Volume.hpp"
+#include "BrickSummary.hpp"
+#include "ColorVolume.hpp"
 #include <Eigen/Core>
 #include "data_types.h"
 #include "Marching_cubes.hpp"
@@ -96,20 +98,28 @@ public:
 
         Eigen::Vector3d red(255, 0, 0);
         Eigen::Vector3d blue(0, 0, 255);
+        const BrickSummary* summary = v.getBrickSummary();
 
         int idx=0;
         for (int z = 0;z<volumeSize.z();z+=step_size) {
             for (int y = 0; y < volumeSize.y(); y+=step_size) {
                 for (int x = 0; x < volumeSize.x(); x+=step_size) {
-                    auto voxel = v.getVoxelData()[x+y*volumeSize.x()+z*volumeSize.x()*volumeSize.y()];
-                    if(voxel.weight == 0. || std::abs(voxel.tsdf) >= threshold){
+                    // unobserved bricks are skipped, x continues with the first voxel of the step grid behind them
+                    if (summary && !summary->isObserved(x >> BrickSummary::BrickShift, y >> BrickSummary::BrickShift,
+                                                        z >> BrickSummary::BrickShift)) {
+                        const int brickEnd = ((x >> BrickSummary::BrickShift) + 1) << BrickSummary::BrickShift;
+                        x += (brickEnd - x - 1) / step_size * step_size;
+                        continue;
+                    }
+                    auto voxel = v.getVoxel(x, y, z);
+                    if(voxel.getWeight() == 0. || std::abs(voxel.getTSDF()) >= threshold){
                         continue;
                     }
                     voxels.push_back(Voxel(v.getOrigin().x()+x*v.getVoxelScale(),v.getOrigin().y()+y*v.getVoxelScale
                             (),v.getOrigin().z()+z*v.getVoxelScale(),v.getVoxelScale()*step_size,idx));
 
                     // max value for TSDF 1, min value -1
-                    double tsdf_abs = std::abs(voxel.tsdf);
+                    double tsdf_abs = std::abs(voxel.getTSDF());
                     Eigen::Vector3i col = ((1-tsdf_abs) * red + tsdf_abs*blue).cast<int>();
                     std::stringstream s;
                     s << col.x() << " "<< col.y() << " "<< col.z();
@@ -196,15 +206,16 @@ public:
         for (int z = 0;z<volumeSize.z();z+=step_size) {
             for (int y = 0; y < volumeSize.y(); y+=step_size) {
                 for (int x = 0; x < volumeSize.x(); x+=step_size) {
-                    auto voxel = v.getVoxelData()[x+y*volumeSize.x()+z*volumeSize.x()*volumeSize.y()];
-                    if(voxel.weight == 0. || std::abs(voxel.tsdf) >= threshold){
+                    auto voxel = v.getVoxel(x, y, z);
+                    if(voxel.getWeight() == 0. || std::abs(voxel.getTSDF()) >= threshold){
                         continue;
                     }
                     voxels.push_back(Voxel(v.getOrigin().x()+x*v.getVoxelScale(),v.getOrigin().y()+y*v.getVoxelScale
                             (),v.getOrigin().z()+z*v.getVoxelScale(),v.getVoxelScale()*step_size,idx));
 
                     // max value for TSDF 1, min value -1
-                    Vector4uc col = voxel.color;
+                    Vector4uc col = v.getColorVolume() ? v.getColorVolume()->getColor(v.getGlobalCoordinate(x, y, z))
+                                                       : voxel.getColor();
                     std::stringstream s;
                     s << (int) col[0] << " "<< (int)col[1] << " "<< (int)col[2] << " " << (int)col[3];
                     colors.push_back(s.str());
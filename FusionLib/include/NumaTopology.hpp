@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//! NUMA node with the cpus it contains
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+/*!
+ * @return the NUMA nodes with cpus, read from /sys/devices/system/node on Linux. Other platforms and machines without
+ * NUMA information report a single node 0 with all hardware threads
+ */
+std::vector<NumaNode> getNumaNodes();
+
+//! restricts the calling thread to the given cpus. @return false if the platform does not support it
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+/*!
+ * Sets the memory policy of the pages overlapping [p, p + bytes) to prefer node: pages are allocated there when they
+ * are first touched, by whichever thread. Pages which are already resident stay where they are.
+ * @return false if the kernel does not support it, e.g. without NUMA or when mbind is not allowed
+ */
+bool preferNode(void* p, size_t bytes, int node);
+
+/*!
+ * Samples every stride-th page of [p, p + bytes) and adds the bytes of the resident ones to the node they are on,
+ * unresident pages are skipped.
+ * @param bytesPerNode pairs of node and bytes, new nodes are appended
+ */
+void addBytesPerNode(const void* p, size_t bytes, size_t stride, std::vector<std::pair<int, size_t>>& bytesPerNode);
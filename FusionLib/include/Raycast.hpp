@@ -10,16 +10,20 @@ public:
     bool surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared_ptr<Volume>& volume,float truncationDistance);
 
 private:
+    //! marches the rays of all pixels through the grid, a VolumeGrid or DynamicVolumeGrid of the volume
+    template<typename Grid>
+    void castRays(const Grid& grid, Frame& currentFrame, Volume& volume, float truncationDistance);
+
     /*!
      *
      * @param x
      * @param y
      * @param rotation
-     * @param intrinsics
+     * @param camera
      * @return the normalized direction of the ray which equals the rotation*cameraSpaceCoordinates
      */
     Eigen::Vector3d calculateRayDirection(size_t x, size_t y, const Eigen::Matrix3d& rotation,
-                                                const Eigen::Matrix3d& intrinsics);
+                                                const CameraModel& camera);
 
     /*!
      * This method should not only calculate the currentPoint on the ray but also check wether it is inside the volume 1<=x<=volume.Size.x()-1,...
@@ -33,8 +37,9 @@ private:
      * @return is point in Volume
      */
 
+    template<typename Grid>
     bool calculatePointOnRay(Eigen::Vector3d& currentPoint,
-                             std::shared_ptr<Volume>& volume,
+                             const Grid& grid,
                              const Eigen::Vector3d& origin,
                              const Eigen::Vector3d& direction,
                              float raylength
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "data_types.h"
+
+/*!
+ * Vectorized integration of a single x-row of the volume, for double precision, fixed point and planar voxels.
+ * Along a row the camera space position of a voxel advances by a constant delta, therefore the position of every voxel
+ * is computed as p0 + x*delta instead of transforming its global coordinate. Projection, depth test and the
+ * SDF computation run in single precision on 8 (AVX2) or 4 (SSE2) voxels at once, the weighted average is then
+ * applied to the voxels which passed all tests.
+ * The instruction set is selected once at runtime, on non x86 platforms a scalar float implementation is used.
+ */
+class SimdIntegrator {
+public:
+
+    struct FrameData {
+        const float* depthMap;
+        //! nullptr for a volume with a ColorVolume, the colors of the voxels are then not updated
+        const Vector4uc* colorMap;
+        //! CameraModel::getInverseLambdas of the frame
+        const float* inverseLambdas;
+        int width;
+        int height;
+        float fX, fY, cX, cY;
+        float truncationDistance;
+    };
+
+    /*!
+     * Voxels of a VolumeStorage::Planar volume, starting at a given voxel. The planes hold the same values as the
+     * members of FixedPointVoxel, a color word consists of RGB and a reserved byte. color is nullptr if the volume
+     * stores no color.
+     */
+    struct VoxelPlanes {
+        int16_t* tsdf;
+        uint16_t* weight;
+        uint32_t* color;
+
+        VoxelPlanes operator+(std::ptrdiff_t offset) const {
+            return {tsdf + offset, weight + offset, color ? color + offset : nullptr};
+        }
+    };
+
+    /*!
+     * Row of a VolumeLayout::Bricked volume, the voxel x is at base + xIndex[x] (see Volume::getIndexX). RowT is
+     * Voxel*, FixedPointVoxel* or VoxelPlanes pointing to the voxel with x = 0.
+     */
+    template<typename RowT>
+    struct BrickedRow {
+        RowT base;
+        const size_t* xIndex;
+
+        RowT operator+(std::ptrdiff_t x) const {
+            return base + xIndex[x];
+        }
+    };
+
+    //! voxels [begin, end) of a row, empty if begin >= end
+    struct Range {
+        int begin;
+        int end;
+    };
+
+    /*!
+     * Integrates the voxels [xBegin, xEnd) of one row.
+     * @param row pointer to the voxel with x = 0 of the row
+     * @param p0 camera space position of the voxel with x = 0
+     * @param delta camera space step between two neighbouring voxels
+     * @return the range between the first and the last voxel which received an update
+     */
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, Voxel* row);
+
+    /*!
+     * Same as above for a fixed point volume. The measurement is quantized to tsdf * TSDFScale and the running
+     * average a + (b - a) / n is evaluated in 32 bit integer arithmetic with a rounded 2^16 / n reciprocal, on AVX2
+     * for 8 voxels at once.
+     * Error bounds against the double precision update:
+     *  - quantization of the stored tsdf: 0.5 / TSDFScale = 1.5e-5 (normalized tsdf)
+     *  - a single update: at most 1.25 / TSDFScale = 3.8e-5, i.e. 2.3 um for a truncation distance of 6 cm
+     *  - older errors are damped by the average, after N updates they add up to at most 1.25 * (N + 1) / 2 / TSDFScale.
+     *    In practice the rounding is unbiased and the error stays far below (see fixedpoint_benchmark)
+     *  - colors are rounded instead of truncated, they differ by at most one per channel and update
+     *  - weights are identical up to FixedPointVoxel::MaxWeight, where they saturate and the average turns into an
+     *    exponential moving average with factor 1 / 65536
+     */
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, FixedPointVoxel* row);
+
+    /*!
+     * Same as above for a planar volume, the results are identical to the fixed point volume. The planes are read
+     * and written with plain vector loads and stores, without color only the tsdf and weight planes are touched.
+     * @param row planes of the voxel with x = 0 of the row
+     */
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, const VoxelPlanes& row);
+
+    /*!
+     * Same as above for the rows of a bricked volume. The vector loop starts at the first brick border, so every
+     * vector of voxels lies in one contiguous run of a brick.
+     */
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, const BrickedRow<Voxel*>& row);
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, const BrickedRow<FixedPointVoxel*>& row);
+    static Range integrateRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                              int xBegin, int xEnd, const BrickedRow<VoxelPlanes>& row);
+
+    /*!
+     * Integer update of a single fixed point voxel, used by the depth splatting.
+     */
+    static void updateVoxel(FixedPointVoxel& voxel, float sdf, const Vector4uc& image_color, float truncationDistance);
+
+    //! same as above for the first voxel of planes
+    static void updateVoxel(const VoxelPlanes& voxel, float sdf, const Vector4uc& image_color,
+                            float truncationDistance);
+
+    //! @return name of the instruction set used by integrateRow
+    static const char* instructionSet();
+};
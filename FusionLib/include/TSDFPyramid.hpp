@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "DirtyBricks.hpp"
+#include "Volume.hpp"
+
+/*!
+ * Coarser copies of a volume with 2, 4 and 8 times the voxel size, for consumers which do not need the full detail:
+ * a raycast for tracking or preview, a coarse mesh. Every level is a linear fixed point Volume at the origin of the
+ * volume, so Raycast and MarchingCubes take it like the volume itself. A voxel of level l is the average of the 2^3
+ * voxels of level l - 1 it covers: the tsdf and color weighted by the voxel weights, the weight is the mean weight of
+ * the observed voxels. A voxel without observed children is unobserved.
+ * The levels are updated incrementally from the bricks Fusion::reconstructSurface marks in a DirtyBricks, a brick of
+ * the volume only changes 4^3, 2^3 and 1 voxels of the levels. After a shift of a rolling volume they have to be
+ * rebuilt, which creates them again at the new origin of the volume. If the volume keeps a BrickSummary, the levels
+ * keep one as well, and they share its ColorVolume.
+ */
+class TSDFPyramid {
+public:
+    static constexpr int MaxLevels = 3;
+
+    //! creates the levels 1 to levels and builds them from the current content of the volume
+    explicit TSDFPyramid(std::shared_ptr<Volume> volume, int levels = MaxLevels);
+
+    //! recomputes the voxels of all levels covering the marked bricks of the volume
+    void update(const DirtyBricks& bricks);
+
+    /*!
+     * Recomputes all levels. If the volume has been shifted, the levels are replaced by new ones at its origin and
+     * the levels returned by getLevel before refer to the old position.
+     */
+    void rebuild();
+
+    //! @return number of coarse levels
+    int getLevelCount() const;
+
+    /*!
+     * @return the volume for level 0, the level with 2^level times the voxel size of the volume otherwise. Raycast a
+     * level with 2^level times the truncation distance, the rays step by half of it.
+     */
+    std::shared_ptr<Volume> getLevel(int level) const;
+
+    /*!
+     * @return the coarsest level with voxels not larger than maxVoxelScale, the volume if even its voxels are larger
+     */
+    int selectLevel(double maxVoxelScale) const;
+
+private:
+    //! creates the levels 1 to levels at the origin of the volume, all voxels unobserved
+    void createLevels(int levels);
+
+    //! recomputes the voxels [minVoxel, maxVoxel) of level from level - 1
+    void downsample(int level, const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel);
+
+    std::shared_ptr<Volume> m_volume;
+    //level l is m_levels[l - 1]
+    std::vector<std::shared_ptr<Volume>> m_levels;
+};
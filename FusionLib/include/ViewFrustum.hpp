@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Volume.hpp"
+#include <Frame.h>
+
+/*!
+ * The part of the volume which can be updated by a frame: all voxels in front of the camera, projecting into the
+ * depth image and not further away than the largest measured depth plus the truncation distance.
+ * Along an x-row of the volume the camera space position is linear in x, so every frustum plane turns into a linear
+ * inequality in x and the visible part of a row is an interval which can be computed in closed form.
+ * The bounds are conservative: every voxel outside of them would be rejected by the integration anyway.
+ */
+class ViewFrustum {
+public:
+    ViewFrustum(Frame& frame, Volume& volume, double truncationDistance);
+
+    //! frustum on another grid of voxels [0, volumeSize) with the given origin and voxel size, like a ColorVolume
+    ViewFrustum(Frame& frame, const Eigen::Vector3d& origin, double voxelScale, const Eigen::Vector3i& volumeSize,
+                double truncationDistance);
+
+    //! @return false if the frustum does not intersect the volume
+    bool intersectsVolume() const;
+
+    //! voxel-space bounding box of the frustum clipped to the volume, min inclusive, max exclusive
+    const Eigen::Vector3i& getMinVoxel() const;
+    const Eigen::Vector3i& getMaxVoxel() const;
+
+    /*!
+     * Conservative test of the box of voxels [minVoxel, maxVoxel) against the frustum, using the bounding sphere of
+     * the box. May report boxes close to the frustum as intersecting.
+     */
+    bool intersectsBox(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) const;
+
+    /*!
+     * Computes the visible voxels [xBegin, xEnd) of the row (y, z).
+     * @return false if no voxel of the row is visible
+     */
+    bool rowExtent(int y, int z, int& xBegin, int& xEnd) const;
+
+private:
+    // world to camera transformation
+    Eigen::Matrix3d m_rotation;
+    Eigen::Vector3d m_translation;
+
+    Eigen::Vector3d m_volumeOrigin;
+    double m_voxelScale;
+    int m_volumeSizeX;
+
+    double m_fX, m_fY, m_cX, m_cY;
+    int m_width, m_height;
+    double m_farDepth;
+
+    Eigen::Vector3i m_minVoxel;
+    Eigen::Vector3i m_maxVoxel;
+};
@@ -1,9 +1,17 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <Eigen/StdVector>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <utility>
+#include <cstdint>
 #include "data_types.h"
+#include "MappedAllocator.hpp"
+#include "NumaTopology.hpp"
 
 class Ray
 {
@@ -13,14 +21,322 @@ public:
     int sign[3];
 };
 
+class BrickStore;
+class BrickSummary;
+class ColorVolume;
+class ViewFrustum;
+
+//! voxel array of a Volume, see MappedAllocator
+template<typename T>
+using VoxelArray = std::vector<T, MappedAllocator<T>>;
+
 class Volume {
 public:
-    Volume(const Eigen::Vector3d origin, const Eigen::Vector3i volumeSize, const double voxelScale);
-    ~Volume()= default;
+    //! bricks of the VolumeLayout::Bricked layout have BrickSize^3 voxels, the same bricks as DirtyBricks
+    static constexpr int BrickShift = 3;
+    static constexpr int BrickSize = 1 << BrickShift;
+
+    /*!
+     * @param maxLevel only for the hashed layout: bricks can be stored at the levels [0, maxLevel], a brick of level l
+     * has 2^l times the voxel size and covers BrickSize * 2^l voxels per axis with BrickSize^3 samples
+     * @param levelDistance sensor distance from which on the observed bricks are stored at level 1, every doubling of
+     * the distance adds a level, see getLevelForDepth
+     */
+    Volume(const Eigen::Vector3d origin, const Eigen::Vector3i volumeSize, const double voxelScale,
+           VolumeStorage storage = VolumeStorage::Double, bool storeColor = true,
+           VolumeLayout layout = VolumeLayout::Linear, int maxLevel = 0, double levelDistance = 2.);
+    ~Volume();
 
     bool intersects(const Ray &r, float& entry_distance) const;
 
-    std::vector<Voxel>& getVoxelData();
+    VolumeStorage getStorage() const;
+
+    VolumeLayout getLayout() const;
+
+    /*!
+     * Index of the voxel (x, y, z) into the voxel data or the planes. The bricked layout pads the volume, so the data
+     * can be larger than the number of voxels. In the hashed layout all voxels of unallocated bricks share the
+     * indices [0, BrickSize^3) of an empty brick, which reads as unobserved and must not be written. A voxel covered
+     * by bricks of several levels maps to the finest of them, within a coarser brick to the sample covering it.
+     */
+    size_t getVoxelIndex(int x, int y, int z) const {
+        if (_layout == VolumeLayout::Linear && !_rolling)
+            return x + y * size_t(_volumeSize.x()) + z * size_t(_volumeSize.x()) * _volumeSize.y();
+        if (_layout == VolumeLayout::Hashed) {
+            for (int level = 0;; ++level) {
+                const uint32_t slot = findBrick(level, x >> (BrickShift + level), y >> (BrickShift + level),
+                                                z >> (BrickShift + level));
+                if (slot != 0 || level == _maxLevel)
+                    return (size_t(slot) << (3 * BrickShift)) | (((z >> level) & (BrickSize - 1)) << (2 * BrickShift)) |
+                           (((y >> level) & (BrickSize - 1)) << BrickShift) | ((x >> level) & (BrickSize - 1));
+            }
+        }
+        return _indexX[x] + _indexY[y] + _indexZ[z];
+    }
+
+    /*!
+     * The index of the bricked layout is separable: getVoxelIndex(x, y, z) = indexX[x] + indexY[y] + indexZ[z].
+     * Loops over a row can look up the voxel x at rowBase + indexX[x] with rowBase = indexY[y] + indexZ[z], runs of
+     * BrickSize voxels starting at a multiple of BrickSize are contiguous. Empty for the linear layout, unless it is
+     * rolling (see enableRolling).
+     * The hashed layout only fills indexX with x mod BrickSize, the offset of the voxel within a row of its brick.
+     */
+    const std::vector<size_t>& getIndexX() const;
+    const std::vector<size_t>& getIndexY() const;
+    const std::vector<size_t>& getIndexZ() const;
+
+    /*!
+     * Bricks in the order they are stored, as the coordinates of their first voxel. Loops which visit the volume
+     * brick by brick in this order, like the mesh extraction, stream through memory in all layouts.
+     * The linear layout lists the bricks ordered by z, y and x, the hashed layout only the allocated bricks in the
+     * order of their allocation.
+     */
+    const std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>>& getBrickOrder() const;
+
+    //! level of every brick of getBrickOrder, empty for the dense layouts
+    const std::vector<uint8_t>& getBrickLevels() const;
+
+    int getMaxLevel() const;
+
+    /*!
+     * @return level at which a surface seen from the given sensor distance is stored: 0 below levelDistance, l for
+     * distances in [levelDistance * 2^(l-1), levelDistance * 2^l), at most getMaxLevel. The depth noise of the
+     * sensor grows with the distance, so far surfaces do not benefit from the fine voxels.
+     */
+    int getLevelForDepth(double depth) const;
+
+    double getLevelDistance() const;
+
+    /*!
+     * Allocates the brick of the given level containing the voxel (x, y, z) of a hashed volume. Below an allocated
+     * coarser brick the new brick starts with the resampled data of the coarser one, otherwise its voxels are
+     * unobserved. The voxel data grows by one brick, so pointers into it are invalidated. Not thread safe, Fusion
+     * allocates the bricks of a frame before it integrates them. Does nothing for the dense layouts.
+     * A paged volume reads an evicted brick back from the swap file, the brick counts as used and modified.
+     * @return true if the brick was not allocated before
+     */
+    bool allocateBrick(int x, int y, int z, int level = 0);
+
+    /*!
+     * @return index of the first sample of the brick of the given level containing the voxel (x, y, z), its
+     * samples follow in x, y, z order. 0 if that brick is not allocated. Only for the hashed layout.
+     */
+    size_t getBrickIndex(int x, int y, int z, int level) const {
+        return size_t(findBrick(level, x >> (BrickShift + level), y >> (BrickShift + level),
+                                z >> (BrickShift + level))) << (3 * BrickShift);
+    }
+
+    //! @return finest level of an allocated brick containing (x, y, z), -1 if there is none. 0 for the dense layouts
+    int getVoxelLevel(int x, int y, int z) const {
+        if (_layout != VolumeLayout::Hashed)
+            return 0;
+        for (int level = 0; level <= _maxLevel; ++level)
+            if (findBrick(level, x >> (BrickShift + level), y >> (BrickShift + level), z >> (BrickShift + level)) != 0)
+                return level;
+        return -1;
+    }
+
+    //! @return false if (x, y, z) lies in an unallocated brick of a hashed volume, always true for the dense layouts
+    bool isAllocated(int x, int y, int z) const {
+        return getVoxelLevel(x, y, z) >= 0;
+    }
+
+    //! @return number of bricks holding voxel data, all bricks of the volume for the dense layouts
+    size_t getAllocatedBrickCount() const;
+
+    /*!
+     * @return bytes reserved for the voxel data, the index tables and the brick hash. The voxel data is committed
+     * lazily (see MappedAllocator), this is its virtual size
+     */
+    size_t getMemoryUsage() const;
+
+    /*!
+     * @return bytes of getMemoryUsage which are resident in physical memory. The pages of the voxel data become
+     * resident when the integration first writes to them, the tables are always counted
+     */
+    size_t getResidentMemoryUsage() const;
+
+    //! z-range of a linear volume whose voxel memory is placed on a NUMA node, see placeSlabs
+    struct SlabPlacement {
+        int zBegin;
+        int zEnd;
+        NumaNode node;
+    };
+
+    /*!
+     * Splits the z-range of a linear volume into one slab per node, sized by the number of cpus of the node, and
+     * places the voxel memory of every slab on its node. The pages of a slab prefer its node when they are first
+     * touched (see preferNode), so they stay uncommitted until the integration writes them. Where the kernel does not
+     * allow that, a thread pinned to the node first-touches the pages of the slab right away. Fusion integrates every
+     * slab with threads pinned to its node. Call it before the first integration, resident pages are not moved.
+     * @return false if nothing was placed: for other layouts, a rolling volume or a single node
+     */
+    bool placeSlabs(const std::vector<NumaNode>& nodes);
+
+    //! @return the slabs of placeSlabs, empty if the volume was not placed
+    const std::vector<SlabPlacement>& getSlabPlacement() const;
+
+    /*!
+     * Backs the voxel data with transparent huge pages, also after it grows. A huge page is committed as a whole, so
+     * this trades some of the lazy commit for fewer TLB misses.
+     * @return false if the system does not support it
+     */
+    bool enableHugePages();
+
+    //! @return pairs of NUMA node and bytes of the voxel data resident on it, estimated from a sample of the pages
+    std::vector<std::pair<int, size_t>> getResidentBytesPerNode() const;
+
+    /*!
+     * Called with the voxels [minVoxel, maxVoxel) which leave a rolling volume on a shift, before they are cleared.
+     * The coordinates and getOrigin still refer to the position before the shift.
+     */
+    using SlabCallback = std::function<void(Volume& volume, const Eigen::Vector3i& minVoxel,
+                                            const Eigen::Vector3i& maxVoxel)>;
+
+    /*!
+     * Turns a dense volume into a rolling volume, a window onto an unbounded grid of voxels which can follow the
+     * camera. The voxel (x, y, z) of the window is stored at ((x, y, z) + offset) mod size, a shift only changes the
+     * offset and clears the voxels leaving the window, which enter it again on the other side. No voxel data is
+     * moved. A linear volume switches to the index tables of getIndexX, so the row kernels handle the wrap around.
+     * @return false for the hashed layout, for sizes which are no multiple of BrickSize and for a volume placed with
+     * placeSlabs
+     */
+    bool enableRolling();
+
+    bool isRolling() const;
+
+    void setSlabCallback(SlabCallback callback);
+
+    /*!
+     * Moves the window of a rolling volume by the given number of bricks along each axis, the origin moves by
+     * bricks * BrickSize * voxelScale. The slabs leaving the window are handed to the slab callback, then cleared.
+     * Voxel coordinates, dirty bricks and brick lists of the old position refer to other voxels afterwards.
+     */
+    void shift(const Eigen::Vector3i& bricks);
+
+    /*!
+     * Keeps point close to origin + anchor, e.g. the camera at its position relative to the volume at the start of
+     * the scan: along every axis on which they are more than threshold apart, the volume is shifted by the closest
+     * number of whole bricks. Does nothing if not rolling.
+     * @return true if the volume was shifted
+     */
+    bool followPoint(const Eigen::Vector3d& point, const Eigen::Vector3d& anchor, double threshold);
+
+    //! @return bricks followPoint would shift the volume by, zero if not rolling
+    Eigen::Vector3i getFollowShift(const Eigen::Vector3d& point, const Eigen::Vector3d& anchor, double threshold) const;
+
+    //! @return position of the voxel (0, 0, 0) in the unbounded grid of a rolling volume, the sum of all shifts
+    const Eigen::Vector3i& getGridOffset() const;
+
+    //! counters of a paged volume, see enablePaging
+    struct PagingStats {
+        //! requested bricks which were resident
+        size_t hits = 0;
+        //! requested bricks which were read back from the swap file
+        size_t loads = 0;
+        size_t evictions = 0;
+        //! evicted bricks which had to be written, unmodified bricks are still valid in the swap file
+        size_t writes = 0;
+        //! seconds spent waiting for reads from the swap file and for a full write queue
+        double stallSeconds = 0.;
+
+        double hitRate() const {
+            return hits + loads > 0 ? double(hits) / double(hits + loads) : 1.;
+        }
+    };
+
+    /*!
+     * Turns a hashed volume into an out-of-core volume: at most memoryBudget bytes of bricks stay resident, the least
+     * recently used ones are written to a swap file at path by a background thread and read back on demand.
+     * Requesting a brick makes it resident: allocateBrick for the integration, pageIn for the bricks in the view
+     * frustum (Raycast) or in a region (marching cubes). evictBricks enforces the budget, Fusion calls it after
+     * every frame. Bricks used since the last evictBricks are never evicted, so the working set of a frame may exceed
+     * the budget. The voxel accessors only see resident bricks.
+     * @return false if the volume is not hashed or the swap file cannot be created
+     */
+    bool enablePaging(const std::string& path, size_t memoryBudget);
+
+    bool isPaged() const;
+
+    /*!
+     * Allows Raycast and MarchingCubes to read a linear 256^3 or 512^3 volume through a VolumeGrid specialized for its
+     * size, see dispatchVolumeGrid. Enabled by default
+     */
+    void setSpecializedAccess(bool enabled);
+
+    bool hasSpecializedAccess() const;
+
+    /*!
+     * Keeps a BrickSummary of the volume, built from its current voxels. Fusion::reconstructSurface updates the bricks
+     * it changes and a shift of a rolling volume moves the summary along, code writing the voxel data directly has to
+     * call updateBrickSummary. Raycast, MarchingCubes and MeshWriter::toFileTSDF then skip the bricks which cannot
+     * contribute. Not supported with several levels, whose samples are interpolated across bricks.
+     * @return false if not supported
+     */
+    bool enableBrickSummary();
+
+    //! @return the summary of enableBrickSummary, nullptr if it is not enabled
+    BrickSummary* getBrickSummary();
+    const BrickSummary* getBrickSummary() const;
+
+    //! recomputes the summary of all bricks, does nothing if it is not enabled
+    void updateBrickSummary();
+
+    /*!
+     * Keeps the colors in a ColorVolume with downsampling^3 voxels per color voxel and weights of its own.
+     * Fusion::reconstructSurface integrates it in a pass over the color voxels, Raycast, MarchingCubes and
+     * MeshWriter::toFileColors sample it trilinearly instead of reading the colors of the voxels, whose colors the
+     * integration then leaves untouched. A planar volume drops its color plane, unless it is already paged, so it
+     * stores no color at full resolution. A shift of a rolling volume moves it along.
+     * @param downsampling 2 or 4 for half or quarter resolution, a power of two up to BrickSize
+     * @return false for other values
+     */
+    bool enableColorVolume(int downsampling);
+
+    //! shares the color volume of another volume covering the same space, like the levels of a TSDFPyramid
+    void setColorVolume(std::shared_ptr<ColorVolume> colors);
+
+    //! @return the color volume, nullptr if the colors are stored in the voxels
+    const std::shared_ptr<ColorVolume>& getColorVolume() const;
+
+    //! makes the bricks intersecting the frustum resident and marks them as used, does nothing if not paged
+    void pageIn(const ViewFrustum& frustum);
+
+    //! makes the bricks overlapping the voxels [minVoxel, maxVoxel) resident and marks them as used
+    void pageIn(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel);
+
+    /*!
+     * Evicts the least recently used bricks until the resident bricks fit into the budget and starts a new period of
+     * use. Invalidates pointers into the voxel data, not thread safe. Does nothing if not paged.
+     */
+    void evictBricks();
+
+    //! @return coordinates of the first voxel and level of every brick, resident or in the swap file
+    std::vector<std::pair<Eigen::Vector3i, int>, Eigen::aligned_allocator<std::pair<Eigen::Vector3i, int>>>
+    getPagedBricks() const;
+
+    const PagingStats& getPagingStats();
+
+    //! voxels of a VolumeStorage::Double volume, empty otherwise
+    VoxelArray<Voxel>& getVoxelData();
+
+    //! voxels of a VolumeStorage::FixedPoint volume, empty otherwise
+    VoxelArray<FixedPointVoxel>& getFixedPointVoxelData();
+
+    /*!
+     * Planes of a VolumeStorage::Planar volume, empty otherwise. They are indexed like the voxel data and hold the
+     * tsdf and weight of FixedPointVoxel, a color word consists of R, G, B and a reserved byte.
+     * The color plane is also empty if the volume stores no color.
+     */
+    VoxelArray<int16_t>& getTSDFPlane();
+    VoxelArray<uint16_t>& getWeightPlane();
+    VoxelArray<uint32_t>& getColorPlane();
+
+    //! @return false for a planar volume created without color, its voxels are reported as white
+    bool hasColor() const;
+
+    //! @return the voxel (x, y, z) converted to double precision, independent of the storage
+    Voxel getVoxel( int x, int y, int z);
 
     const Eigen::Vector3d &getOrigin() const;
 
@@ -28,26 +344,174 @@ public:
     float getVoxelScale() const;
 
     bool contains(const Eigen::Vector3d point);
+
+    //! @return coordinates of the voxel containing the global point, the one getTSDF(global) reads
+    Eigen::Vector3i getVoxelCoordinate(const Eigen::Vector3d& global) const {
+        const Eigen::Vector3d shifted = (global - _origin) / _voxelScale;
+        return Eigen::Vector3i(int(shifted.x()), int(shifted.y()), int(shifted.z()));
+    }
+
     Eigen::Vector3d getGlobalCoordinate( int voxelIdx_x, int voxelIdx_y, int voxelIdx_z );
 
     double getTSDF(Eigen::Vector3d global);
     double getTSDF( int x, int y, int z);
+    double getWeight( int x, int y, int z);
 
     Vector4uc getColor(Eigen::Vector3d global);
+    Vector4uc getColor( int x, int y, int z);
 
     Eigen::Vector3d getTSDFGrad(Eigen::Vector3d global);
 
 private:
+    template<typename VoxelT, int LogX, int LogY, int LogZ> friend class VolumeGrid;
+    //saves the voxel scale in double precision, getVoxelScale rounds it to float
+    friend class VolumeSnapshot;
+
+    /*!
+     * Looks up a brick of a hashed volume in the open addressing table _brickKeys / _brickSlots.
+     * @return slot of the brick in the voxel data, 0 (the empty brick) if it is not allocated
+     */
+    uint32_t findBrick(int level, int brickX, int brickY, int brickZ) const {
+        const uint64_t key = brickKey(level, brickX, brickY, brickZ);
+        for (size_t i = hashBrick(key);; i = (i + 1) & (_brickKeys.size() - 1)) {
+            if (_brickKeys[i] == key)
+                return _brickSlots[i];
+            if (_brickKeys[i] == 0)
+                return 0;
+        }
+    }
+
+    //! 20 bits per axis and the level, offset by one so that the key 0 marks an empty entry
+    static uint64_t brickKey(int level, int brickX, int brickY, int brickZ) {
+        return 1 + ((uint64_t(brickX) & 0xfffff) | ((uint64_t(brickY) & 0xfffff) << 20) |
+                    ((uint64_t(brickZ) & 0xfffff) << 40) | (uint64_t(level) << 60));
+    }
+
+    //! Fibonacci hashing, the table size is a power of two
+    size_t hashBrick(uint64_t key) const {
+        return size_t((key * 0x9E3779B97F4A7C15ull) >> _brickHashShift);
+    }
+
+    void insertBrick(uint64_t key, uint32_t slot);
+
+    //! removes a key from the brick hash, the following entries of its probe sequence move up
+    void eraseBrick(uint64_t key);
+
+    //! key and first voxel of the brick in slot
+    uint64_t slotKey(uint32_t slot) const;
+
+    //! bytes of one brick in the voxel data or the planes together
+    size_t getBrickBytes() const;
+
+    void readBrick(uint32_t slot, char* data) const;
+    void writeBrick(uint32_t slot, const char* data);
+
+    /*!
+     * Writes the brick in slot to the swap file if it was modified and frees the slot. The brick in the last slot
+     * moves into it, so the allocated bricks stay contiguous. data is a buffer of getBrickBytes.
+     */
+    void evictBrick(uint32_t slot, char* data);
+
+    /*!
+     * Marks the resident bricks for which overlaps(first voxel, level) is true as used and makes the bricks of the
+     * swap file for which it is true resident. Of the swap file only the cells of _swapCells overlapping the voxels
+     * [minVoxel, maxVoxel) are visited, overlaps must be false outside of them.
+     */
+    template<typename Predicate>
+    void pageInBricks(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel, Predicate overlaps);
+
+    //! appends a brick to the hash and the voxel data, its voxels are unobserved. @return its slot
+    uint32_t allocateSlot(uint64_t key, const Eigen::Vector3i& first, int level);
+
+    //! resizes the voxel data or the planes of the storage to numVoxels, new voxels are unobserved
+    void resizeVoxelData(size_t numVoxels);
+
+    void setVoxel(size_t voxelIdx, double tsdf, double weight, const Vector4uc& color);
+
+    //! resets the voxels [voxelIdx, voxelIdx + count) of the data or the planes to unobserved
+    void clearVoxels(size_t voxelIdx, size_t count);
+
+    //! start and bytes per voxel of the allocated voxel data or planes
+    std::vector<std::pair<char*, size_t>> getVoxelArrays();
+
+    //! advises huge pages for the voxel data and the planes, see enableHugePages
+    bool adviseHugePages();
+
+    /*!
+     * tsdf of the voxel (x, y, z), for the coarser levels of a hashed volume interpolated trilinearly between the
+     * samples of the level and converted to the truncation distance of level 0, see interpolateTSDF
+     */
+    double readTSDF(int x, int y, int z) const;
+
+    /*!
+     * Trilinear interpolation of the samples of the given level at the center of the voxel (x, y, z). Missing and
+     * unobserved samples are left out. A level l sample stores the sdf divided by the truncation distance scaled by
+     * 2^l, the result is multiplied by 2^l and not clamped.
+     */
+    double interpolateTSDF(int x, int y, int z, int level) const;
+
+    size_t getVoxelIndex(const Eigen::Vector3d& global) const;
+    double getTSDF(size_t voxelIdx) const;
+    double getWeight(size_t voxelIdx) const;
+    Vector4uc getColor(size_t voxelIdx) const;
+
+    const VolumeStorage _storage;
+    const VolumeLayout _layout;
     //_voxelData contains color, tsdf & Weight
-    std::vector<Voxel> _voxelData;
+    VoxelArray<Voxel> _voxelData;
+    VoxelArray<FixedPointVoxel> _fixedPointVoxelData;
+    VoxelArray<int16_t> _tsdfPlane;
+    VoxelArray<uint16_t> _weightPlane;
+    VoxelArray<uint32_t> _colorPlane;
+    bool _hasColor;
     const Eigen::Vector3i _volumeSize;
+    //per axis parts of the bricked voxel index
+    std::vector<size_t> _indexX, _indexY, _indexZ;
+    std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> _brickOrder;
+    //brick hash of the hashed layout, the brick in slot s occupies the voxels [s, s+1) * BrickSize^3
+    std::vector<uint64_t> _brickKeys;
+    std::vector<uint32_t> _brickSlots;
+    int _brickHashShift = 64;
+    std::vector<uint8_t> _brickLevels;
     const double _voxelScale;
     const Eigen::Vector3d _volumeRange;
 
-    const Eigen::Vector3d _origin;
-    const Eigen::Vector3d _maxPoint;
+    Eigen::Vector3d _origin;
+    Eigen::Vector3d _maxPoint;
+    //levels of the hashed layout, see getLevelForDepth
+    const int _maxLevel;
+    const double _levelDistance;
     Eigen::Vector3d bounds[2];
 
+    //rolling, see enableRolling. The index tables before any shift and the sum of the shifts in voxels
+    bool _rolling = false;
+    std::vector<size_t> _unshiftedIndex[3];
+    Eigen::Vector3i _gridOffset = Eigen::Vector3i::Zero();
+    SlabCallback _slabCallback;
+
+    bool _specializedAccess = true;
+
+    std::unique_ptr<BrickSummary> _brickSummary;
+
+    std::shared_ptr<ColorVolume> _colorVolume;
+
+    //placement of the voxel memory, see placeSlabs and enableHugePages
+    std::vector<SlabPlacement> _slabPlacement;
+    bool _hugePages = false;
+
+    //paging, see enablePaging. Per slot the period of the last use and whether the brick was modified since it was
+    //read from the swap file
+    std::unique_ptr<BrickStore> _brickStore;
+    size_t _pagingBudget = 0;
+    uint64_t _pagingPeriod = 1;
+    std::vector<uint64_t> _brickLastUse;
+    std::vector<uint8_t> _brickModified;
+    PagingStats _pagingStats;
+    //keys of the bricks in the swap file by the cell of SwapCellShift voxels containing their first voxel, the cell is
+    //keyed like a brick of level 0
+    static constexpr int SwapCellShift = BrickShift + 3;
+    std::unordered_map<uint64_t, std::vector<uint64_t>> _swapCells;
+
 };
 
 
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DirtyBricks.hpp"
+#include "Volume.hpp"
+
+/*!
+ * Periodic checkpoints of a volume during a scan: a VolumeSnapshot as base and next to it an append-only log of
+ * deltas, each holding the bricks and color blocks changed since the previous checkpoint (VolumeSnapshot::writeBricks)
+ * and the shifts of a rolling volume in between, which are replayed on load. A checkpoint therefore costs in the
+ * number of bricks the scan touched, not in the size of the volume. The thread driving the volume only copies the
+ * changed bricks into a buffer, a background thread appends it to the log, so writing it does not wait for the disk.
+ * load applies the log to the base, compact merges it into a new base.
+ * All methods except the writer thread itself are meant to be called from the thread driving the volume.
+ */
+class VolumeCheckpoint {
+public:
+    //! @return path of the log of the base snapshot at path
+    static std::string getLogPath(const std::string& path);
+
+    /*!
+     * Saves the volume as base snapshot to path and starts an empty log next to it, replacing earlier ones.
+     * A failure shows in isOpen.
+     */
+    VolumeCheckpoint(const std::shared_ptr<Volume>& volume, const std::string& path);
+    //! waits until the queued deltas are in the log
+    ~VolumeCheckpoint();
+
+    VolumeCheckpoint(const VolumeCheckpoint&) = delete;
+    VolumeCheckpoint& operator=(const VolumeCheckpoint&) = delete;
+
+    //! @return false if the base or the log could not be written
+    bool isOpen() const;
+
+    //! adds the bricks marked by Fusion::reconstructSurface to the next delta
+    void markBricks(const DirtyBricks& bricks);
+
+    /*!
+     * Adds a shift of a rolling volume since the last call to the next delta and moves the marks along. Has to be
+     * called after every shift, two shifts read as one would not clear the same voxels on load. markBricks and write
+     * call it as well.
+     */
+    void trackShift();
+
+    /*!
+     * Copies the marked bricks into a delta, queues it for the log and clears the marks. Waits while the previous
+     * delta is still queued. A paged volume reads the marked bricks back from its swap file.
+     * @return false if the log is not open or an earlier append failed
+     */
+    bool write();
+
+    //! blocks until all queued deltas are in the log
+    void flush();
+
+    struct Stats {
+        size_t deltas = 0;
+        //! marked bricks of all deltas
+        size_t bricks = 0;
+        size_t bytes = 0;
+        //! seconds the caller spent copying the bricks and waiting for the writer thread
+        double copySeconds = 0.;
+        double stallSeconds = 0.;
+    };
+
+    const Stats& getStats() const;
+
+    /*!
+     * Reads the base snapshot at path and applies the deltas of its log. A delta cut off at the end of the log, e.g.
+     * by a crash during the append, is dropped, as is the log of an earlier base.
+     * @return nullptr if the base cannot be read or a delta is corrupt
+     */
+    static std::shared_ptr<Volume> load(const std::string& path);
+
+    /*!
+     * Merges the log into a new base snapshot at path and starts an empty log, the volume is loaded as a whole for
+     * that. Not while a VolumeCheckpoint appends to the log.
+     * @return false if the checkpoint cannot be loaded or the new base cannot be written
+     */
+    static bool compact(const std::string& path);
+
+private:
+    void writerLoop();
+
+    const std::shared_ptr<Volume> m_volume;
+    std::FILE* m_log = nullptr;
+    //marks and shifts of the next delta, see trackShift
+    DirtyBricks m_bricks;
+    std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> m_shifts;
+    Eigen::Vector3i m_gridOffset;
+    Stats m_stats;
+
+    //deltas queued for the log, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::string> m_queue;
+    bool m_writing = false;
+    bool m_failed = false;
+    bool m_stop = false;
+    std::thread m_writer;
+};
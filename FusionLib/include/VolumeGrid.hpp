@@ -0,0 +1,127 @@
+#pragma once
+
+#include <utility>
+#include "Volume.hpp"
+
+/*!
+ * Read access to a linear volume of 2^LogX x 2^LogY x 2^LogZ voxels of type VoxelT, with the size known at compile
+ * time: the index of (x, y, z) is x | y << LogX | z << (LogX + LogY), the range checks compare against constants.
+ * Loops over the voxels are written as templates on the grid and instantiated for the common volume sizes, see
+ * dispatchVolumeGrid. The values are the same as those of the Volume accessors.
+ */
+template<typename VoxelT, int LogX, int LogY, int LogZ>
+class VolumeGrid {
+public:
+    static constexpr int SizeX = 1 << LogX;
+    static constexpr int SizeY = 1 << LogY;
+    static constexpr int SizeZ = 1 << LogZ;
+
+    explicit VolumeGrid(Volume& volume)
+            : m_data(data(volume, static_cast<const VoxelT*>(nullptr))), m_origin(volume._origin),
+              m_voxelScale(volume._voxelScale), m_range(volume._volumeRange) {}
+
+    static size_t index(int x, int y, int z) {
+        return size_t(x) | (size_t(y) << LogX) | (size_t(z) << (LogX + LogY));
+    }
+
+    double getTSDF(int x, int y, int z) const {
+        return m_data[index(x, y, z)].getTSDF();
+    }
+
+    double getWeight(int x, int y, int z) const {
+        return m_data[index(x, y, z)].getWeight();
+    }
+
+    Vector4uc getColor(int x, int y, int z) const {
+        return m_data[index(x, y, z)].getColor();
+    }
+
+    Voxel getVoxel(int x, int y, int z) const {
+        const VoxelT& voxel = m_data[index(x, y, z)];
+        Voxel result;
+        result.tsdf = voxel.getTSDF();
+        result.weight = voxel.getWeight();
+        result.color = voxel.getColor();
+        return result;
+    }
+
+    bool contains(const Eigen::Vector3d& global) const {
+        const Eigen::Vector3d volumeCoord = global - m_origin;
+        return !(volumeCoord.x() < 0 || volumeCoord.x() >= m_range.x() || volumeCoord.y() < 0 ||
+                 volumeCoord.y() >= m_range.y() || volumeCoord.z() < 0 || volumeCoord.z() >= m_range.z());
+    }
+
+    double getTSDF(const Eigen::Vector3d& global) const {
+        return m_data[index(global)].getTSDF();
+    }
+
+    Vector4uc getColor(const Eigen::Vector3d& global) const {
+        return m_data[index(global)].getColor();
+    }
+
+private:
+    static const Voxel* data(Volume& volume, const Voxel*) {
+        return volume.getVoxelData().data();
+    }
+
+    static const FixedPointVoxel* data(Volume& volume, const FixedPointVoxel*) {
+        return volume.getFixedPointVoxelData().data();
+    }
+
+    size_t index(const Eigen::Vector3d& global) const {
+        const Eigen::Vector3d shifted = (global - m_origin) / m_voxelScale;
+        return index(int(shifted.x()), int(shifted.y()), int(shifted.z()));
+    }
+
+    const VoxelT* m_data;
+    const Eigen::Vector3d m_origin;
+    const double m_voxelScale;
+    const Eigen::Vector3d m_range;
+};
+
+/*!
+ * The same interface for any volume, every access goes through the Volume and its runtime layout, storage and
+ * levels.
+ */
+class DynamicVolumeGrid {
+public:
+    explicit DynamicVolumeGrid(Volume& volume)
+            : m_volume(volume) {}
+
+    double getTSDF(int x, int y, int z) const { return m_volume.getTSDF(x, y, z); }
+    double getWeight(int x, int y, int z) const { return m_volume.getWeight(x, y, z); }
+    Vector4uc getColor(int x, int y, int z) const { return m_volume.getColor(x, y, z); }
+    Voxel getVoxel(int x, int y, int z) const { return m_volume.getVoxel(x, y, z); }
+    bool contains(const Eigen::Vector3d& global) const { return m_volume.contains(global); }
+    double getTSDF(const Eigen::Vector3d& global) const { return m_volume.getTSDF(global); }
+    Vector4uc getColor(const Eigen::Vector3d& global) const { return m_volume.getColor(global); }
+
+private:
+    Volume& m_volume;
+};
+
+//! @return log2 of the edge length of a cubic volume of 256^3 or 512^3 voxels with a specialized VolumeGrid, 0 else
+inline int getVolumeGridLog(const Eigen::Vector3i& volumeSize, VolumeStorage storage, VolumeLayout layout) {
+    if (layout != VolumeLayout::Linear || (storage != VolumeStorage::Double && storage != VolumeStorage::FixedPoint) ||
+        volumeSize.x() != volumeSize.y() || volumeSize.x() != volumeSize.z())
+        return 0;
+    return volumeSize.x() == 256 ? 8 : volumeSize.x() == 512 ? 9 : 0;
+}
+
+/*!
+ * Calls f with the VolumeGrid instantiated for the size and storage of the volume, or with a DynamicVolumeGrid if
+ * there is none, the specialized access is disabled or the volume is rolling, paged or has several levels.
+ * @return the result of f
+ */
+template<typename F>
+auto dispatchVolumeGrid(Volume& volume, F&& f) -> decltype(f(std::declval<const DynamicVolumeGrid&>())) {
+    const int log = volume.hasSpecializedAccess() && !volume.isRolling() && !volume.isPaged() &&
+                    volume.getMaxLevel() == 0
+                    ? getVolumeGridLog(volume.getVolumeSize(), volume.getStorage(), volume.getLayout()) : 0;
+    const bool fixedPoint = volume.getStorage() == VolumeStorage::FixedPoint;
+    if (log == 8)
+        return fixedPoint ? f(VolumeGrid<FixedPointVoxel, 8, 8, 8>(volume)) : f(VolumeGrid<Voxel, 8, 8, 8>(volume));
+    if (log == 9)
+        return fixedPoint ? f(VolumeGrid<FixedPointVoxel, 9, 9, 9>(volume)) : f(VolumeGrid<Voxel, 9, 9, 9>(volume));
+    return f(DynamicVolumeGrid(volume));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include "DirtyBricks.hpp"
+#include "Volume.hpp"
+
+/*!
+ * Binary snapshot of a Volume, to checkpoint a reconstruction and to resume or mesh it elsewhere. The stream holds
+ *  - a header: magic, version, byte order mark, generation, storage, layout, color flag, max level, origin, voxel
+ *    scale, level distance, size and the downsampling of the ColorVolume (0 without one),
+ *  - the bricks: a tag byte 1, the first voxel and the level of the brick, then its voxels in x, y, z order in the
+ *    record of the storage. A tag byte 0 ends the list,
+ *  - if there is a color volume, its blocks of BrickSize^3 color voxels in the same way, without a level.
+ * Bricks without an observed voxel are left out, so a snapshot scales with the observed part of the volume, only the
+ * allocated bricks of a hashed volume with several levels are all kept, as they decide which level a voxel reads.
+ * Bricks at the upper border of a dense volume only hold the voxels inside it. The values are written in the byte
+ * order of the machine, a snapshot is only read on machines with the same order.
+ * Both directions stream brick by brick, nothing but the volume itself is held in memory. A rolling volume is saved
+ * as its current window and loads as a plain volume at its current origin, the brick summary is not saved.
+ */
+class VolumeSnapshot {
+public:
+    /*!
+     * Writes the volume to the stream. The bricks of a paged volume are read back from the swap file layer by layer.
+     * @param generation stored in the header, identifies the base of a VolumeCheckpoint and its log
+     * @return false if the stream failed
+     */
+    static bool write(Volume& volume, std::ostream& out, uint64_t generation = 0);
+
+    //! writes the volume to the file at path, see write
+    static bool save(Volume& volume, const std::string& path, uint64_t generation = 0);
+
+    /*!
+     * Reads a volume from the stream, with its color volume if it has one.
+     * @param generation receives the generation of the header if not nullptr
+     * @return nullptr if the stream is not a snapshot, of another version or byte order, or ends early
+     */
+    static std::shared_ptr<Volume> read(std::istream& in, uint64_t* generation = nullptr);
+
+    //! reads the volume from the file at path, see read
+    static std::shared_ptr<Volume> load(const std::string& path, uint64_t* generation = nullptr);
+
+    /*!
+     * Writes the bricks of the volume overlapping the marked bricks and the blocks of its color volume overlapping
+     * them, in the format of write without the header. Used for the deltas of VolumeCheckpoint.
+     * @return false if the stream failed
+     */
+    static bool writeBricks(Volume& volume, const DirtyBricks& bricks, std::ostream& out);
+
+    /*!
+     * Reads the bricks and color blocks of writeBricks into a volume with the same geometry, storage and layout.
+     * @return false if the stream ends early or a brick lies outside of the volume
+     */
+    static bool readBricks(Volume& volume, std::istream& in);
+};
@@ -3,6 +3,8 @@
 #include <fstream>
 #include "Eigen.h"
 #include <iostream>
+#include <thread>
+#include <cstdint>
 
 typedef unsigned char BYTE;
 
@@ -13,8 +15,140 @@ struct Voxel {
 
 	Voxel()
 			: tsdf(0.0f), weight(0.0f), color(0, 0, 0, 0) {}
+
+	double getTSDF() const {
+		return tsdf;
+	}
+
+	double getWeight() const {
+		return weight;
+	}
+
+	Vector4uc getColor() const {
+		return color;
+	}
+};
+
+/*
+ * Compact voxel of 8 instead of 24 bytes: the tsdf in [-1, 1] is stored as tsdf * TSDFScale in an int16, the weight
+ * saturates at MaxWeight and the color is packed RGB without alpha. Use the accessors to read it in the units of
+ * Voxel. See SimdIntegrator for the update and its error bounds.
+ */
+struct FixedPointVoxel {
+	static constexpr int TSDFScale = 32767;
+	static constexpr int MaxWeight = 65535;
+
+	int16_t tsdf;
+	uint16_t weight;
+	uint8_t rgb[3];
+	//keeps the color word 32 bit aligned, always 0
+	uint8_t reserved;
+
+	FixedPointVoxel()
+			: tsdf(0), weight(0), rgb{0, 0, 0}, reserved(0) {}
+
+	double getTSDF() const {
+		return double(tsdf) / TSDFScale;
+	}
+
+	double getWeight() const {
+		return weight;
+	}
+
+	//! @return the color with an opaque alpha channel, alpha is 0 while the voxel is unobserved like for Voxel
+	Vector4uc getColor() const {
+		return Vector4uc(rgb[0], rgb[1], rgb[2], weight ? 255 : 0);
+	}
+
+	void setColor(const Vector4uc& color) {
+		rgb[0] = color[0];
+		rgb[1] = color[1];
+		rgb[2] = color[2];
+	}
+};
+
+enum class IntegrationKernel {
+	//double precision reference implementation
+	Scalar,
+	//single precision row kernel, see SimdIntegrator
+	Simd
+};
+
+inline const char* toString(IntegrationKernel kernel) {
+	switch (kernel) {
+		case IntegrationKernel::Scalar: return "Scalar";
+		case IntegrationKernel::Simd: return "Simd";
+	}
+	return "Unknown";
+}
+
+enum class IntegrationMode {
+	//iterate over the voxels of the camera frustum
+	VoxelSweep,
+	//iterate over the depth pixels, only the truncation band around each measurement is updated
+	DepthSplatting
 };
 
+inline const char* toString(IntegrationMode mode) {
+	switch (mode) {
+		case IntegrationMode::VoxelSweep: return "VoxelSweep";
+		case IntegrationMode::DepthSplatting: return "DepthSplatting";
+	}
+	return "Unknown";
+}
+
+enum class VolumeStorage {
+	//Voxel, double precision tsdf and weight
+	Double,
+	//FixedPointVoxel, int16 tsdf, saturating uint16 weight and RGB color
+	FixedPoint,
+	//structure of arrays with the values of FixedPointVoxel in separate tsdf, weight and color planes,
+	//the color plane is optional
+	Planar
+};
+
+inline const char* toString(VolumeStorage storage) {
+	switch (storage) {
+		case VolumeStorage::Double: return "Double";
+		case VolumeStorage::FixedPoint: return "FixedPoint";
+		case VolumeStorage::Planar: return "Planar";
+	}
+	return "Unknown";
+}
+
+enum class VolumeLayout {
+	//x + y*X + z*X*Y
+	Linear,
+	//8^3 voxel bricks stored contiguously, the bricks are ordered by their Morton code
+	Bricked,
+	//8^3 voxel bricks allocated on demand and found through a spatial hash, memory scales with the observed surface
+	Hashed
+};
+
+inline const char* toString(VolumeLayout layout) {
+	switch (layout) {
+		case VolumeLayout::Linear: return "Linear";
+		case VolumeLayout::Bricked: return "Bricked";
+		case VolumeLayout::Hashed: return "Hashed";
+	}
+	return "Unknown";
+}
+
+enum class PipelineMode {
+	//track, integrate and raycast every frame before the next one is read
+	Online,
+	//track the whole sequence first, then integrate all frames in batches
+	Offline
+};
+
+inline const char* toString(PipelineMode mode) {
+	switch (mode) {
+		case PipelineMode::Online: return "Online";
+		case PipelineMode::Offline: return "Offline";
+	}
+	return "Unknown";
+}
+
 struct Config {
 
 public:
@@ -34,6 +168,61 @@ public:
 	const double m_voxelScale;
 	Eigen::Vector3i m_volumeSize;
 	const Eigen::Vector3d m_volumeOrigin;
+	//number of worker threads used by Fusion for the integration
+	unsigned int m_numThreads = std::max(1u, std::thread::hardware_concurrency());
+	IntegrationKernel m_integrationKernel = IntegrationKernel::Simd;
+	IntegrationMode m_integrationMode = IntegrationMode::VoxelSweep;
+	//the compact fixed point storage needs a third of the memory, a 512^3 volume takes 1 GB instead of 3 GB
+	VolumeStorage m_volumeStorage = VolumeStorage::FixedPoint;
+	//false: geometry only, a planar volume then never allocates its color plane and needs 4 bytes per voxel
+	bool m_volumeColor = true;
+	//1 fuses the color into the voxels. 2 or 4 keep it in a separate color volume at half or quarter resolution with
+	//weights of its own, see Volume::enableColorVolume. A planar volume then has no color plane
+	int m_volumeColorDownsampling = 1;
+	VolumeLayout m_volumeLayout = VolumeLayout::Linear;
+	//hashed layout only: surfaces further away than m_volumeLevelDistance * 2^(l-1) are stored with 2^l times the
+	//voxel size, up to level m_volumeMaxLevel. 0 keeps the whole volume at the fine voxel size
+	int m_volumeMaxLevel = 0;
+	double m_volumeLevelDistance = 2.;
+	//hashed layout only: keep at most this many MiB of bricks in memory and swap the least recently used ones to
+	//m_volumePagingFile in the results directory. 0 keeps all bricks in memory
+	unsigned int m_volumePagingBudget = 0;
+	std::string m_volumePagingFile = "volume.swap";
+	//linear and bricked layouts only: the volume follows the camera as a cyclic buffer. Once the camera moved more
+	//than m_volumeShiftThreshold meters from its position relative to the volume at the start, the volume is shifted
+	//by whole bricks and the slabs leaving it are meshed
+	bool m_volumeRolling = false;
+	double m_volumeShiftThreshold = 0.5;
+	//linear 256^3 and 512^3 volumes of double or fixed point voxels are raycast and meshed through a VolumeGrid
+	//specialized for their size, see dispatchVolumeGrid
+	bool m_volumeSpecialization = true;
+	//keeps the observed tsdf range of every brick, so the raycast, marching cubes and the tsdf export skip empty
+	//space. Not available with m_volumeMaxLevel > 0
+	bool m_volumeBrickSummary = true;
+	//linear layout only: places the memory of every z-slab on the NUMA node whose threads integrate it. Does nothing
+	//on a single node
+	bool m_volumeNumaPlacement = false;
+	//backs the voxel data with transparent huge pages
+	bool m_volumeHugePages = false;
+	//number of coarse levels of the TSDFPyramid kept next to the volume, 0 for none, at most 3. The raycast for the
+	//tracking reads level m_trackingLevel, 0 is the volume itself. The coarsest level is meshed at the end
+	int m_volumePyramidLevels = 0;
+	int m_trackingLevel = 0;
+	//the reconstructed volume is saved to this file in the results directory at the end, see VolumeSnapshot.
+	//Empty saves nothing
+	std::string m_volumeSnapshotFile = "";
+	//online pipeline only: a VolumeCheckpoint of the volume is written to this file in the results directory, with a
+	//delta of the changed bricks appended every m_volumeCheckpointInterval seconds. The log is compacted into the
+	//base at the end. Empty writes no checkpoints
+	std::string m_volumeCheckpointFile = "";
+	double m_volumeCheckpointInterval = 5.;
+	//frames moving less than this relative to the last integrated frame are skipped, see IntegrationScheduler
+	double m_integrationMinTranslation = 0.01;
+	double m_integrationMinRotation = 0.5 * M_PI / 180.;
+	unsigned int m_integrationMaxSkippedFrames = 4;
+	PipelineMode m_pipelineMode = PipelineMode::Online;
+	//number of frames read before they are integrated one after another in offline mode
+	unsigned int m_offlineBatchSize = 8;
 
 	std::string toString() {
 		std::stringstream ss;
@@ -43,6 +232,33 @@ public:
 		ss << "Voxel Scale: " << m_voxelScale << std::endl;
 		ss << "Volume Size: " << m_volumeSize.transpose() << std::endl;
 		ss << "Volume Origin: " << m_volumeOrigin.transpose() << std::endl;
+		ss << "Integration Threads: " << m_numThreads << std::endl;
+		ss << "Integration Kernel: " << ::toString(m_integrationKernel) << std::endl;
+		ss << "Integration Mode: " << ::toString(m_integrationMode) << std::endl;
+		ss << "Volume Storage: " << ::toString(m_volumeStorage) << std::endl;
+		ss << "Volume Color: " << m_volumeColor << std::endl;
+		ss << "Volume Color Downsampling: " << m_volumeColorDownsampling << std::endl;
+		ss << "Volume Layout: " << ::toString(m_volumeLayout) << std::endl;
+		ss << "Volume Max Level: " << m_volumeMaxLevel << std::endl;
+		ss << "Volume Level Distance: " << m_volumeLevelDistance << std::endl;
+		ss << "Volume Paging Budget: " << m_volumePagingBudget << std::endl;
+		ss << "Volume Paging File: " << m_volumePagingFile << std::endl;
+		ss << "Volume Rolling: " << m_volumeRolling << std::endl;
+		ss << "Volume Shift Threshold: " << m_volumeShiftThreshold << std::endl;
+		ss << "Volume Specialization: " << m_volumeSpecialization << std::endl;
+		ss << "Volume Brick Summary: " << m_volumeBrickSummary << std::endl;
+		ss << "Volume NUMA Placement: " << m_volumeNumaPlacement << std::endl;
+		ss << "Volume Huge Pages: " << m_volumeHugePages << std::endl;
+		ss << "Volume Pyramid Levels: " << m_volumePyramidLevels << std::endl;
+		ss << "Volume Snapshot File: " << m_volumeSnapshotFile << std::endl;
+		ss << "Volume Checkpoint File: " << m_volumeCheckpointFile << std::endl;
+		ss << "Volume Checkpoint Interval: " << m_volumeCheckpointInterval << std::endl;
+		ss << "Tracking Level: " << m_trackingLevel << std::endl;
+		ss << "Integration Min Translation: " << m_integrationMinTranslation << std::endl;
+		ss << "Integration Min Rotation: " << m_integrationMinRotation << std::endl;
+		ss << "Integration Max Skipped Frames: " << m_integrationMaxSkippedFrames << std::endl;
+		ss << "Pipeline Mode: " << ::toString(m_pipelineMode) << std::endl;
+		ss << "Offline Batch Size: " << m_offlineBatchSize << std::endl;
 
 		return ss.str();
 	}
@@ -0,0 +1,131 @@
+#include "BrickStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+BrickStore::BrickStore(const std::string& path, size_t brickBytes, size_t maxPendingBytes)
+        : m_path(path), m_brickBytes(brickBytes), m_maxPendingBytes(std::max(maxPendingBytes, brickBytes)),
+          m_file(std::fopen(path.c_str(), "w+b")) {
+    m_writer = std::thread([this]() { writerLoop(); });
+}
+
+BrickStore::~BrickStore() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_writer.join();
+    if (m_file) {
+        std::fclose(m_file);
+        std::remove(m_path.c_str());
+    }
+}
+
+bool BrickStore::isOpen() const {
+    return m_file != nullptr;
+}
+
+const std::unordered_map<uint64_t, size_t>& BrickStore::getRecords() const {
+    return m_records;
+}
+
+void BrickStore::write(uint64_t key, const char* data) {
+    auto record = m_records.find(key);
+    if (record == m_records.end())
+        record = m_records.emplace(key, m_records.size() * m_brickBytes).first;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto pending = m_pending.find(key);
+    if (pending != m_pending.end()) {
+        std::memcpy(pending->second.data.data(), data, m_brickBytes);
+        return;
+    }
+    if (m_pendingBytes + m_brickBytes > m_maxPendingBytes) {
+        const auto start = std::chrono::steady_clock::now();
+        m_condition.wait(lock, [this]() { return m_pendingBytes + m_brickBytes <= m_maxPendingBytes; });
+        m_stallSeconds += secondsSince(start);
+    }
+    Pending& entry = m_pending[key];
+    entry.data.assign(data, data + m_brickBytes);
+    entry.offset = record->second;
+    m_queue.push_back(key);
+    m_pendingBytes += m_brickBytes;
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+bool BrickStore::read(uint64_t key, char* data) {
+    const auto record = m_records.find(key);
+    if (record == m_records.end())
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto pending = m_pending.find(key);
+        if (pending != m_pending.end()) {
+            std::memcpy(data, pending->second.data.data(), m_brickBytes);
+            return true;
+        }
+        if (m_inFlightKey == key) {
+            std::memcpy(data, m_inFlight.data.data(), m_brickBytes);
+            return true;
+        }
+    }
+    // the brick can only be queued again by this thread, so its record stays unchanged during the read
+    const auto start = std::chrono::steady_clock::now();
+    bool success = false;
+    if (m_file) {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        success = std::fseek(m_file, long(record->second), SEEK_SET) == 0 &&
+                  std::fread(data, 1, m_brickBytes, m_file) == m_brickBytes;
+    }
+    m_stallSeconds += secondsSince(start);
+    return success;
+}
+
+void BrickStore::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto start = std::chrono::steady_clock::now();
+    m_condition.wait(lock, [this]() { return m_queue.empty() && m_inFlightKey == 0; });
+    m_stallSeconds += secondsSince(start);
+}
+
+double BrickStore::getStallSeconds() const {
+    return m_stallSeconds;
+}
+
+void BrickStore::writerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        // the file is removed on destruction, queued writes are dropped
+        if (m_stop)
+            return;
+        m_inFlightKey = m_queue.front();
+        m_queue.pop_front();
+        auto pending = m_pending.find(m_inFlightKey);
+        m_inFlight = std::move(pending->second);
+        m_pending.erase(pending);
+        lock.unlock();
+
+        if (m_file) {
+            std::lock_guard<std::mutex> fileLock(m_fileMutex);
+            std::fseek(m_file, long(m_inFlight.offset), SEEK_SET);
+            std::fwrite(m_inFlight.data.data(), 1, m_brickBytes, m_file);
+        }
+
+        lock.lock();
+        m_inFlightKey = 0;
+        m_pendingBytes -= m_brickBytes;
+        m_condition.notify_all();
+    }
+}
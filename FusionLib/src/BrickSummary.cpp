@@ -0,0 +1,146 @@
+#include "BrickSummary.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Volume.hpp"
+
+namespace {
+
+// the float bounds enclose the double tsdf, so the sign tests on them are the same as on the voxels
+float roundDown(double value) {
+    const float result = float(value);
+    return result > value ? std::nextafter(result, -std::numeric_limits<float>::infinity()) : result;
+}
+
+float roundUp(double value) {
+    const float result = float(value);
+    return result < value ? std::nextafter(result, std::numeric_limits<float>::infinity()) : result;
+}
+
+}
+
+constexpr int BrickSummary::BrickShift;
+constexpr int BrickSummary::BrickSize;
+
+BrickSummary::BrickSummary(const Eigen::Vector3i& volumeSize)
+        : m_brickCount((volumeSize.x() + BrickSize - 1) >> BrickShift, (volumeSize.y() + BrickSize - 1) >> BrickShift,
+                       (volumeSize.z() + BrickSize - 1) >> BrickShift),
+          m_bricks(size_t(m_brickCount.x()) * m_brickCount.y() * m_brickCount.z()) {}
+
+bool BrickSummary::mayContainSurface(int brickX, int brickY, int brickZ) const {
+    if (!isObserved(brickX, brickY, brickZ))
+        return false;
+    bool inside = false, outside = false;
+    for (int z = brickZ; z <= std::min(brickZ + 1, m_brickCount.z() - 1); ++z) {
+        for (int y = brickY; y <= std::min(brickY + 1, m_brickCount.y() - 1); ++y) {
+            for (int x = brickX; x <= std::min(brickX + 1, m_brickCount.x() - 1); ++x) {
+                const Brick& brick = getBrick(x, y, z);
+                if (!(brick.flags & Observed))
+                    continue;
+                inside |= brick.minTSDF <= 0.f;
+                outside |= brick.maxTSDF > 0.f;
+            }
+        }
+    }
+    return inside && outside;
+}
+
+template<typename ReadVoxel>
+void BrickSummary::updateBricks(Volume& volume, const BrickList& bricks, size_t begin, size_t end,
+                                ReadVoxel readVoxel) {
+    const Eigen::Vector3i& volumeSize = volume.getVolumeSize();
+    for (size_t b = begin; b < end; ++b) {
+        const Eigen::Vector3i first = bricks[b] * BrickSize;
+        const Eigen::Vector3i last = (first + Eigen::Vector3i::Constant(BrickSize)).cwiseMin(volumeSize);
+        double minTSDF = std::numeric_limits<double>::infinity();
+        double maxTSDF = -std::numeric_limits<double>::infinity();
+        for (int z = first.z(); z < last.z(); ++z) {
+            for (int y = first.y(); y < last.y(); ++y) {
+                // the row of a brick is contiguous in all layouts, also in a rolling volume
+                const size_t rowIndex = volume.getVoxelIndex(first.x(), y, z);
+                for (int x = 0; x < last.x() - first.x(); ++x) {
+                    double tsdf;
+                    if (!readVoxel(rowIndex + x, tsdf))
+                        continue;
+                    minTSDF = std::min(minTSDF, tsdf);
+                    maxTSDF = std::max(maxTSDF, tsdf);
+                }
+            }
+        }
+
+        Brick& brick = m_bricks[bricks[b].x() + m_brickCount.x() *
+                                (bricks[b].y() + size_t(m_brickCount.y()) * bricks[b].z())];
+        brick = Brick();
+        if (minTSDF > maxTSDF)
+            continue;
+        brick.minTSDF = roundDown(minTSDF);
+        brick.maxTSDF = roundUp(maxTSDF);
+        brick.flags = Observed | (minTSDF <= 0. && maxTSDF > 0. ? ZeroCrossing : 0);
+    }
+}
+
+void BrickSummary::update(Volume& volume, const BrickList& bricks, size_t begin, size_t end) {
+    switch (volume.getStorage()) {
+        case VolumeStorage::Double: {
+            const Voxel* voxels = volume.getVoxelData().data();
+            updateBricks(volume, bricks, begin, end, [voxels](size_t index, double& tsdf) {
+                tsdf = voxels[index].tsdf;
+                return voxels[index].weight > 0.;
+            });
+            break;
+        }
+        case VolumeStorage::FixedPoint: {
+            const FixedPointVoxel* voxels = volume.getFixedPointVoxelData().data();
+            updateBricks(volume, bricks, begin, end, [voxels](size_t index, double& tsdf) {
+                tsdf = voxels[index].getTSDF();
+                return voxels[index].weight > 0;
+            });
+            break;
+        }
+        case VolumeStorage::Planar: {
+            const int16_t* tsdfs = volume.getTSDFPlane().data();
+            const uint16_t* weights = volume.getWeightPlane().data();
+            updateBricks(volume, bricks, begin, end, [tsdfs, weights](size_t index, double& tsdf) {
+                tsdf = double(tsdfs[index]) / FixedPointVoxel::TSDFScale;
+                return weights[index] > 0;
+            });
+            break;
+        }
+    }
+}
+
+void BrickSummary::rebuild(Volume& volume) {
+    BrickList bricks;
+    bricks.reserve(m_bricks.size());
+    for (int z = 0; z < m_brickCount.z(); ++z)
+        for (int y = 0; y < m_brickCount.y(); ++y)
+            for (int x = 0; x < m_brickCount.x(); ++x)
+                bricks.emplace_back(x, y, z);
+    update(volume, bricks, 0, bricks.size());
+}
+
+void BrickSummary::shift(const Eigen::Vector3i& bricks) {
+    std::vector<Brick> shifted(m_bricks.size());
+    for (int z = 0; z < m_brickCount.z(); ++z) {
+        for (int y = 0; y < m_brickCount.y(); ++y) {
+            for (int x = 0; x < m_brickCount.x(); ++x) {
+                const Eigen::Vector3i source = Eigen::Vector3i(x, y, z) + bricks;
+                if ((source.array() < 0).any() || (source.array() >= m_brickCount.array()).any())
+                    continue;
+                shifted[x + m_brickCount.x() * (y + size_t(m_brickCount.y()) * z)] =
+                        getBrick(source.x(), source.y(), source.z());
+            }
+        }
+    }
+    m_bricks.swap(shifted);
+}
+
+const Eigen::Vector3i& BrickSummary::getBrickCount() const {
+    return m_brickCount;
+}
+
+size_t BrickSummary::count(uint8_t flags) const {
+    return size_t(std::count_if(m_bricks.begin(), m_bricks.end(),
+                                [flags](const Brick& brick) { return (brick.flags & flags) == flags; }));
+}
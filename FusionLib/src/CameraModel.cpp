@@ -0,0 +1,58 @@
+#include "CameraModel.hpp"
+
+#include <mutex>
+
+CameraModel::CameraModel(const Eigen::Matrix3d& intrinsics, unsigned int width, unsigned int height)
+        : m_intrinsics(intrinsics), m_width(width), m_height(height) {
+    const double fovX = intrinsics(0, 0);
+    const double fovY = intrinsics(1, 1);
+    const double cX = intrinsics(0, 2);
+    const double cY = intrinsics(1, 2);
+
+    m_rays.resize(width * height);
+    m_directions.resize(width * height);
+    m_lambdas.resize(width * height);
+    m_inverseLambdas.resize(width * height);
+    for (unsigned int v = 0; v < height; ++v) {
+        for (unsigned int u = 0; u < width; ++u) {
+            const size_t idx = u + v * width;
+            m_rays[idx] = Eigen::Vector3d((u - cX) / fovX, (v - cY) / fovY, 1.);
+            m_lambdas[idx] = m_rays[idx].norm();
+            m_inverseLambdas[idx] = float(1. / m_lambdas[idx]);
+            m_directions[idx] = m_rays[idx].normalized();
+        }
+    }
+}
+
+std::shared_ptr<const CameraModel> CameraModel::create(const Eigen::Matrix3d& intrinsics,
+                                                       unsigned int width, unsigned int height) {
+    static std::mutex cacheMutex;
+    static std::vector<std::shared_ptr<const CameraModel>> cache;
+
+    // ordered from the least to the most recently requested model
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        const std::shared_ptr<const CameraModel> model = *it;
+        if (model->m_width == width && model->m_height == height && model->m_intrinsics == intrinsics) {
+            cache.erase(it);
+            cache.push_back(model);
+            return model;
+        }
+    }
+    if (cache.size() >= MaxCachedModels)
+        cache.erase(cache.begin());
+    cache.push_back(std::make_shared<const CameraModel>(intrinsics, width, height));
+    return cache.back();
+}
+
+const Eigen::Matrix3d& CameraModel::getIntrinsics() const {
+    return m_intrinsics;
+}
+
+unsigned int CameraModel::getWidth() const {
+    return m_width;
+}
+
+unsigned int CameraModel::getHeight() const {
+    return m_height;
+}
@@ -0,0 +1,93 @@
+#include "ColorVolume.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr int ColorVolume::MaxWeight;
+
+ColorVolume::ColorVolume(const Eigen::Vector3d& origin, const Eigen::Vector3i& volumeSize, double voxelScale,
+                         int downsampling)
+        : m_origin(origin),
+          m_size((volumeSize + Eigen::Vector3i::Constant(downsampling - 1)) / downsampling),
+          m_voxelScale(voxelScale * downsampling),
+          m_downsampling(downsampling),
+          m_voxels(size_t(m_size.x()) * m_size.y() * m_size.z()) {}
+
+int ColorVolume::getDownsampling() const {
+    return m_downsampling;
+}
+
+const Eigen::Vector3d& ColorVolume::getOrigin() const {
+    return m_origin;
+}
+
+const Eigen::Vector3i& ColorVolume::getSize() const {
+    return m_size;
+}
+
+double ColorVolume::getVoxelScale() const {
+    return m_voxelScale;
+}
+
+Vector4uc ColorVolume::getColor(const Eigen::Vector3d& global) const {
+    const Eigen::Vector3d position = (global - m_origin) / m_voxelScale - Eigen::Vector3d::Constant(0.5);
+    const Eigen::Vector3i base(int(std::floor(position.x())), int(std::floor(position.y())),
+                               int(std::floor(position.z())));
+    const Eigen::Vector3d fraction = position - base.cast<double>();
+
+    Eigen::Vector3d color = Eigen::Vector3d::Zero();
+    double weight = 0.;
+    for (int corner = 0; corner < 8; ++corner) {
+        const Eigen::Vector3i offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+        const Eigen::Vector3i voxel = base + offset;
+        if ((voxel.array() < 0).any() || (voxel.array() >= m_size.array()).any())
+            continue;
+        const ColorVoxel& sample = getVoxel(voxel.x(), voxel.y(), voxel.z());
+        if (sample.weight == 0)
+            continue;
+        double factor = 1.;
+        for (int axis = 0; axis < 3; ++axis)
+            factor *= offset[axis] ? fraction[axis] : 1. - fraction[axis];
+        color += factor * Eigen::Vector3d(sample.rgb[0], sample.rgb[1], sample.rgb[2]);
+        weight += factor;
+    }
+    if (weight <= 0.)
+        return Vector4uc(0, 0, 0, 0);
+    color = (color / weight).array().round();
+    return Vector4uc((unsigned char) color.x(), (unsigned char) color.y(), (unsigned char) color.z(), 255);
+}
+
+void ColorVolume::updateVoxel(ColorVoxel& voxel, const Vector4uc& color) {
+    const int weight = voxel.weight;
+    for (int c = 0; c < 3; ++c)
+        voxel.rgb[c] = uint8_t((weight * voxel.rgb[c] + color[c] + (weight + 1) / 2) / (weight + 1));
+    voxel.weight = uint8_t(std::min(weight + 1, MaxWeight));
+}
+
+void ColorVolume::shift(const Eigen::Vector3i& voxels) {
+    const Eigen::Vector3i shift = voxels / m_downsampling;
+    std::vector<ColorVoxel, MappedAllocator<ColorVoxel>> shifted(m_voxels.size());
+    for (int z = 0; z < m_size.z(); ++z) {
+        for (int y = 0; y < m_size.y(); ++y) {
+            for (int x = 0; x < m_size.x(); ++x) {
+                const Eigen::Vector3i source = Eigen::Vector3i(x, y, z) + shift;
+                if ((source.array() < 0).any() || (source.array() >= m_size.array()).any())
+                    continue;
+                // the new grid is zero, so the unobserved voxels are skipped and their pages stay uncommitted
+                const ColorVoxel& voxel = getVoxel(source.x(), source.y(), source.z());
+                if (voxel.weight > 0)
+                    shifted[x + m_size.x() * (y + size_t(m_size.y()) * z)] = voxel;
+            }
+        }
+    }
+    m_voxels.swap(shifted);
+    m_origin += shift.cast<double>() * m_voxelScale;
+}
+
+size_t ColorVolume::getMemoryUsage() const {
+    return m_voxels.capacity() * sizeof(ColorVoxel);
+}
+
+size_t ColorVolume::getResidentMemoryUsage() const {
+    return residentBytes(m_voxels.data(), m_voxels.capacity() * sizeof(ColorVoxel));
+}
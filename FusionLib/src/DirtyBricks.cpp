@@ -0,0 +1,96 @@
+#include "DirtyBricks.hpp"
+
+DirtyBricks::DirtyBricks(const Eigen::Vector3i& volumeSize)
+        : m_brickCount((volumeSize.x() + BrickSize - 1) >> BrickShift, (volumeSize.y() + BrickSize - 1) >> BrickShift,
+                       (volumeSize.z() + BrickSize - 1) >> BrickShift),
+          m_numWords((size_t(m_brickCount.x()) * m_brickCount.y() * m_brickCount.z() + 63) / 64),
+          m_words(new std::atomic<uint64_t>[m_numWords]) {
+    clear();
+}
+
+DirtyBricks::DirtyBricks(const DirtyBricks& other)
+        : m_brickCount(other.m_brickCount),
+          m_numWords(other.m_numWords),
+          m_words(new std::atomic<uint64_t>[m_numWords]) {
+    for (size_t i = 0; i < m_numWords; ++i)
+        m_words[i].store(other.m_words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+DirtyBricks& DirtyBricks::operator=(const DirtyBricks& other) {
+    if (this != &other) {
+        if (m_numWords != other.m_numWords)
+            m_words.reset(new std::atomic<uint64_t>[other.m_numWords]);
+        m_brickCount = other.m_brickCount;
+        m_numWords = other.m_numWords;
+        for (size_t i = 0; i < m_numWords; ++i)
+            m_words[i].store(other.m_words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+void DirtyBricks::markRow(int y, int z, int xBegin, int xEnd) {
+    if (xBegin >= xEnd) return;
+    for (int brickX = xBegin >> BrickShift; brickX <= (xEnd - 1) >> BrickShift; ++brickX)
+        markBrick(brickX, y >> BrickShift, z >> BrickShift);
+}
+
+void DirtyBricks::merge(const DirtyBricks& other) {
+    for (size_t i = 0; i < m_numWords && i < other.m_numWords; ++i)
+        m_words[i].fetch_or(other.m_words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void DirtyBricks::clear() {
+    for (size_t i = 0; i < m_numWords; ++i)
+        m_words[i].store(0, std::memory_order_relaxed);
+}
+
+void DirtyBricks::shift(const Eigen::Vector3i& bricks) {
+    if (bricks.isZero())
+        return;
+    const auto marked = getBricks();
+    clear();
+    for (const Eigen::Vector3i& brick : marked) {
+        const Eigen::Vector3i moved = brick - bricks;
+        if ((moved.array() >= 0).all() && (moved.array() < m_brickCount.array()).all())
+            markBrick(moved.x(), moved.y(), moved.z());
+    }
+}
+
+bool DirtyBricks::contains(int brickX, int brickY, int brickZ) const {
+    const size_t index = brickX + m_brickCount.x() * (brickY + size_t(m_brickCount.y()) * brickZ);
+    return (m_words[index >> 6].load(std::memory_order_relaxed) >> (index & 63)) & 1;
+}
+
+size_t DirtyBricks::count() const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_numWords; ++i)
+        count += __builtin_popcountll(m_words[i].load(std::memory_order_relaxed));
+    return count;
+}
+
+bool DirtyBricks::empty() const {
+    for (size_t i = 0; i < m_numWords; ++i)
+        if (m_words[i].load(std::memory_order_relaxed))
+            return false;
+    return true;
+}
+
+std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> DirtyBricks::getBricks() const {
+    std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> bricks;
+    bricks.reserve(count());
+    const size_t bricksPerSlice = size_t(m_brickCount.x()) * m_brickCount.y();
+    for (size_t i = 0; i < m_numWords; ++i) {
+        uint64_t word = m_words[i].load(std::memory_order_relaxed);
+        while (word) {
+            const size_t index = (i << 6) + __builtin_ctzll(word);
+            word &= word - 1;
+            bricks.emplace_back(int(index % m_brickCount.x()), int((index % bricksPerSlice) / m_brickCount.x()),
+                                int(index / bricksPerSlice));
+        }
+    }
+    return bricks;
+}
+
+const Eigen::Vector3i& DirtyBricks::getBrickCount() const {
+    return m_brickCount;
+}
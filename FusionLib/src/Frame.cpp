@@ -9,7 +9,8 @@ Frame::Frame(const double * depthMap, const BYTE* colorMap,
         const Eigen::Matrix4d &d2cExtrinsics,
         const unsigned int width, const unsigned int height, double maxDistance)
         : m_width(width),m_height(height),m_intrinsic_matrix(depthIntrinsics), m_color_intrinsic_matrix(colorIntrinsics),
-        m_d2cExtrinsics(d2cExtrinsics), m_maxDistance(maxDistance)
+        m_d2cExtrinsics(d2cExtrinsics), m_camera(CameraModel::create(depthIntrinsics, width, height)),
+        m_maxDistance(maxDistance)
         {
 
     double depth_threshold = 6.;
@@ -104,11 +105,6 @@ void Frame::addValidPoints(std::vector<Eigen::Vector3d> points, std::vector<Eige
 }
 
 std::vector<Eigen::Vector3d> Frame::computeCameraCoordinates(unsigned int width, unsigned int height){
-    double fovX = m_intrinsic_matrix(0, 0);
-    double fovY = m_intrinsic_matrix(1, 1);
-    double cX = m_intrinsic_matrix(0, 2);
-    double cY = m_intrinsic_matrix(1, 2);
-
     // Back-project the pixel depths into the camera space.
     std::vector<Eigen::Vector3d> pointsTmp(width * height);
 
@@ -122,7 +118,7 @@ std::vector<Eigen::Vector3d> Frame::computeCameraCoordinates(unsigned int width,
             }
             else {
                 // Back-projection to camera space.
-                pointsTmp[idx] = Eigen::Vector3d((x - cX) / fovX * depth, (y - cY) / fovY * depth, depth);
+                pointsTmp[idx] = m_camera->getRay(x, y) * depth;
             }
         }
     }
@@ -258,6 +254,10 @@ const Eigen::Matrix3d& Frame::getIntrinsics() const{
     return m_intrinsic_matrix;
 }
 
+const CameraModel& Frame::getCameraModel() const{
+    return *m_camera;
+}
+
 const unsigned int Frame::getWidth() const{
     return m_width;
 }
@@ -1,100 +1,731 @@
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <mutex>
 #include <MeshWriter.h>
 #include "Fusion.hpp"
+#include "BrickSummary.hpp"
+#include "ColorVolume.hpp"
 #include <Marching_cubes.hpp>
 
-bool Fusion::reconstructSurface(const std::shared_ptr<Frame>& currentFrame,const std::shared_ptr<Volume>& volume,double truncationDistance){
+namespace {
+
+// planes of the voxel 0 of a planar volume, all pointers are nullptr for the other storages
+SimdIntegrator::VoxelPlanes planes(Volume& volume) {
+    return {volume.getTSDFPlane().data(), volume.getWeightPlane().data(),
+            volume.hasColor() ? volume.getColorPlane().data() : nullptr};
+}
+
+}
+
+Fusion::Fusion(unsigned int numThreads) : m_numThreads(std::max(1u, numThreads)), m_kernel(IntegrationKernel::Simd),
+                                           m_mode(IntegrationMode::VoxelSweep) {}
+
+void Fusion::setNumThreads(unsigned int numThreads) {
+    m_numThreads = std::max(1u, numThreads);
+}
+
+unsigned int Fusion::getNumThreads() const {
+    return m_numThreads;
+}
+
+void Fusion::setIntegrationKernel(IntegrationKernel kernel) {
+    m_kernel = kernel;
+}
+
+IntegrationKernel Fusion::getIntegrationKernel() const {
+    return m_kernel;
+}
+
+void Fusion::setIntegrationMode(IntegrationMode mode) {
+    m_mode = mode;
+}
+
+IntegrationMode Fusion::getIntegrationMode() const {
+    return m_mode;
+}
+
+bool Fusion::reconstructSurface(const std::shared_ptr<Frame>& currentFrame,const std::shared_ptr<Volume>& volume,double truncationDistance,
+                                DirtyBricks* dirtyBricks){
+    BrickSummary* summary = volume->getBrickSummary();
+    bool integrated;
+    if (!summary) {
+        integrated = integrateFrame(currentFrame, volume, truncationDistance, dirtyBricks);
+    } else {
+        // the summary is recomputed for the bricks of this frame only, dirtyBricks may hold the marks of earlier ones
+        DirtyBricks changed(volume->getVolumeSize());
+        integrated = integrateFrame(currentFrame, volume, truncationDistance, &changed);
+        // the changed bricks were used by the frame, so a paged volume has kept them resident
+        const BrickSummary::BrickList bricks = changed.getBricks();
+        parallelFor(0, int(bricks.size()), 64, [&](int begin, int end) {
+            summary->update(*volume, bricks, size_t(begin), size_t(end));
+        });
+        if (dirtyBricks)
+            dirtyBricks->merge(changed);
+    }
+
+    if (ColorVolume* colors = volume->getColorVolume().get())
+        integrateColor(*currentFrame, *colors, truncationDistance, dirtyBricks);
+    return integrated;
+}
+
+void Fusion::integrateColor(Frame& currentFrame, ColorVolume& colors, double truncationDistance,
+                            DirtyBricks* dirtyBricks) {
+    // trilinear interpolation at the surface reads the color voxels within a diagonal of a color voxel, the band
+    // updated around the surface reaches them and is at least the band of the voxel colors
+    const double band = std::max(truncationDistance / 2, std::sqrt(3.) * colors.getVoxelScale());
+    const ViewFrustum frustum(currentFrame, colors.getOrigin(), colors.getVoxelScale(), colors.getSize(), band);
+    if (!frustum.intersectsVolume())
+        return;
+
+    const Eigen::Matrix4d pose = currentFrame.getGlobalPose().inverse();
+    const Eigen::Matrix3d rotation = pose.block(0, 0, 3, 3);
+    const Eigen::Vector3d translation = pose.block(0, 3, 3, 1);
+    const Eigen::Vector3d delta = rotation.col(0) * colors.getVoxelScale();
+    const auto width = currentFrame.getWidth();
+    const auto& depthMap = currentFrame.getDepthMap();
+    const auto& colorMap = currentFrame.getColorMap();
+    const CameraModel& camera = currentFrame.getCameraModel();
+
+    // every color voxel is updated by the pixel its center projects to, so the slabs are independent
+    parallelFor(frustum.getMinVoxel().z(), frustum.getMaxVoxel().z(), 2, [&](int zBegin, int zEnd) {
+        int xBegin, xEnd;
+        for (int z = zBegin; z < zEnd; ++z) {
+            for (int y = frustum.getMinVoxel().y(); y < frustum.getMaxVoxel().y(); ++y) {
+                if (!frustum.rowExtent(y, z, xBegin, xEnd))
+                    continue;
+                // the camera space position is linear along the row
+                const Eigen::Vector3d p0 = rotation * colors.getGlobalCoordinate(xBegin, y, z) + translation;
+                int updatedBegin = xEnd, updatedEnd = xBegin;
+                for (int x = xBegin; x < xEnd; ++x) {
+                    Eigen::Vector3d cameraPosition = p0 + (x - xBegin) * delta;
+                    if (cameraPosition.z() <= 0)
+                        continue;
+                    const Eigen::Vector2i pixel = currentFrame.projectOntoDepthPlane(cameraPosition);
+                    if (!currentFrame.contains(pixel))
+                        continue;
+                    const size_t index = pixel.x() + size_t(pixel.y()) * width;
+                    const double depth = depthMap[index];
+                    // invisible pixels carry no color
+                    if (depth <= 0 || colorMap[index][3] == 0)
+                        continue;
+                    double lambda = camera.getLambda(pixel.x(), pixel.y());
+                    const double sdf = calculateSDF(lambda, cameraPosition, depth);
+                    if (sdf > band || sdf < -band)
+                        continue;
+                    ColorVolume::updateVoxel(colors.getVoxel(x, y, z), colorMap[index]);
+                    updatedBegin = std::min(updatedBegin, x);
+                    updatedEnd = x + 1;
+                }
+                // the color voxel x covers the voxels [x * downsampling, (x + 1) * downsampling) of the volume
+                if (dirtyBricks && updatedBegin < updatedEnd)
+                    dirtyBricks->markRow(y * colors.getDownsampling(), z * colors.getDownsampling(),
+                                         updatedBegin * colors.getDownsampling(),
+                                         (updatedEnd - 1) * colors.getDownsampling() + 1);
+            }
+        }
+    });
+}
+
+void Fusion::splatFrame(const std::shared_ptr<Frame>& currentFrame, const std::shared_ptr<Volume>& volume,
+                        double truncationDistance, DirtyBricks* dirtyBricks) {
+    if (volume->getLayout() == VolumeLayout::Hashed) {
+        Bricks bricks = allocateBricks(*currentFrame, *volume, truncationDistance, dirtyBricks);
+        // only the voxels of level 0 bricks are splatted, the coarser bricks are integrated by the brick sweep
+        bricks.erase(std::remove_if(bricks.begin(), bricks.end(),
+                                    [](const LevelBrick& brick) { return brick.level == 0; }), bricks.end());
+        if (!bricks.empty()) {
+            const FrameContext context(*currentFrame, *volume, truncationDistance, true);
+            parallelFor(0, int(bricks.size()), 4, [&](int begin, int end) {
+                integrateBricks(begin, end, bricks, context, *volume, truncationDistance, dirtyBricks);
+            });
+        }
+    }
 
-    auto volumeSize =volume->getVolumeSize();
     auto pose = currentFrame->getGlobalPose().inverse();
-    auto width = currentFrame->getWidth();
-    auto voxelData = volume->getVoxelData();
-int idx =0;
 
     Eigen::Matrix3d rotation    = pose.block(0,0,3,3);
     Eigen::Vector3d translation = pose.block(0,3,3,1);
 
-     for (int z = 0;z<volumeSize.z();z++) {
-		 for( int y =0;y<volumeSize.y();y++){
-    		for(int x=0;x< volumeSize.x();x++){
-				/*
-				 * Volumetric Reconstruction
-				 */
-				//calculate Camera Position
-				Eigen::Vector3d globalCoord_voxel = volume->getGlobalCoordinate(x, y, z);
-                Eigen::Vector3d currentCameraPosition = rotation * globalCoord_voxel + translation;
-                if (currentCameraPosition.z() <= 0) continue;
+    // every voxel is owned by the pixel it projects to, so image rows can be processed in parallel as well
+    parallelFor(0, currentFrame->getHeight(), 8, [&](int vBegin, int vEnd) {
+        integratePixelRows(vBegin, vEnd, *currentFrame, *volume, rotation, translation, truncationDistance,
+                           dirtyBricks);
+    });
+    volume->evictBricks();
+}
+
+bool Fusion::integrateFrame(const std::shared_ptr<Frame>& currentFrame, const std::shared_ptr<Volume>& volume,
+                            double truncationDistance, DirtyBricks* dirtyBricks) {
 
-                Eigen::Vector2i img_coord = currentFrame->projectOntoDepthPlane(currentCameraPosition);
+    if (m_mode == IntegrationMode::DepthSplatting) {
+        splatFrame(currentFrame, volume, truncationDistance, dirtyBricks);
+        return true;
+    }
 
-				if (!currentFrame->contains(img_coord))continue;
+    // the coarser levels of a hashed volume are always integrated by SimdIntegrator
+    const FrameContext context(*currentFrame, *volume, truncationDistance,
+                               useSimdKernel(*volume) || volume->getMaxLevel() > 0);
+    if (!context.frustum.intersectsVolume())
+        return true;
 
-				const double depth = currentFrame->getDepthMap()[img_coord.x() + (img_coord.y() * width)];
-				if (depth <= 0) continue;
+    if (volume->getLayout() == VolumeLayout::Hashed) {
+        // only the bricks in the truncation band of the frame are integrated
+        const Bricks bricks = allocateBricks(*currentFrame, *volume, truncationDistance, dirtyBricks);
+        parallelFor(0, int(bricks.size()), 16, [&](int begin, int end) {
+            integrateBricks(begin, end, bricks, context, *volume, truncationDistance, dirtyBricks);
+        });
+        // a paged volume writes back the bricks which have not been used by the last frames
+        volume->evictBricks();
+        return true;
+    }
 
-				auto lambda = calculateLamdas(img_coord, currentFrame->getIntrinsics());
-				auto sdf = calculateSDF(lambda, currentCameraPosition, depth);
+    // slabs are handed out dynamically, as the amount of visible voxels differs a lot between slabs
+    const auto integrate = [&](int zBegin, int zEnd) {
+        integrateSlab(zBegin, zEnd, context, *volume, truncationDistance, dirtyBricks);
+    };
+    const int zMin = context.frustum.getMinVoxel().z();
+    const int zMax = context.frustum.getMaxVoxel().z();
+    if (volume->getSlabPlacement().empty())
+        parallelFor(zMin, zMax, 4, integrate);
+    else
+        parallelForPlaced(zMin, zMax, 4, volume->getSlabPlacement(), integrate);
 
-				/*
-				 * SDF Conversion to TSDF & Volumetric Integration
-				 */
-				if (sdf >= -truncationDistance) {
-					idx++;
+    return true;
+}
 
-				    const double current_tsdf = std::min(1., sdf / truncationDistance); // *sgn(sdf)
-				    const double current_weight = 1.0;
-					size_t voxel_index = x+(y*volumeSize.x())+(z*volumeSize.x()*volumeSize.y());
-					const double old_tsdf=volume->getVoxelData()[voxel_index].tsdf;
-					const double old_weight = volume->getVoxelData()[voxel_index].weight;
+Fusion::FrameContext::FrameContext(Frame& frame, Volume& volume, double truncationDistance, bool simd)
+        : frame(frame), frustum(frame, volume, truncationDistance), frameData() {
+    const Eigen::Matrix4d pose = frame.getGlobalPose().inverse();
+    rotation = pose.block(0,0,3,3);
+    translation = pose.block(0,3,3,1);
 
-					const double updated_tsdf = (old_weight*old_tsdf + current_weight*current_tsdf)/
-							(old_weight+current_weight);
-					const double updated_weight = old_weight+current_weight;
+    if (simd) {
+        const auto& depthMap = frame.getDepthMap();
+        depthMapF.assign(depthMap.begin(), depthMap.end());
+        const auto& intrinsics = frame.getIntrinsics();
+        frameData.depthMap = depthMapF.data();
+        // the colors of a volume with a ColorVolume are integrated into it, not into the voxels
+        frameData.colorMap = volume.getColorVolume() ? nullptr : frame.getColorMap().data();
+        frameData.inverseLambdas = frame.getCameraModel().getInverseLambdas();
+        frameData.width = frame.getWidth();
+        frameData.height = frame.getHeight();
+        frameData.fX = intrinsics(0, 0);
+        frameData.fY = intrinsics(1, 1);
+        frameData.cX = intrinsics(0, 2);
+        frameData.cY = intrinsics(1, 2);
+        frameData.truncationDistance = truncationDistance;
+    }
+}
 
-                    volume->getVoxelData()[voxel_index].tsdf = updated_tsdf;
-                    volume->getVoxelData()[voxel_index].weight = updated_weight;
+void Fusion::parallelFor(int begin, int end, int chunkSize, const std::function<void(int, int)>& body) const {
+    const unsigned int numChunks = (std::max(0, end - begin) + chunkSize - 1) / chunkSize;
+    const unsigned int numThreads = std::min(m_numThreads, numChunks);
+    if (numThreads <= 1) {
+        if (begin < end)
+            body(begin, end);
+        return;
+    }
 
-                    if (sdf <= truncationDistance / 2 && sdf >= -truncationDistance / 2) {
+    std::atomic<int> nextChunk(begin);
+    auto worker = [&]() {
+        for (int chunkBegin = nextChunk.fetch_add(chunkSize); chunkBegin < end;
+             chunkBegin = nextChunk.fetch_add(chunkSize)) {
+            body(chunkBegin, std::min(chunkBegin + chunkSize, end));
+        }
+    };
 
-                        Vector4uc& voxel_color = voxelData[voxel_index].color;
-                        const Vector4uc image_color = currentFrame->getColorMap()[img_coord.x() + (img_coord.y() * width)];
-                        // voxel is invisible
-                        if(image_color[3] == 0)
-                            continue;
+    std::vector<std::thread> workers;
+    workers.reserve(numThreads - 1);
+    for (unsigned int t = 1; t < numThreads; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+}
+
+void Fusion::parallelForPlaced(int begin, int end, int chunkSize, const std::vector<Volume::SlabPlacement>& placement,
+                               const std::function<void(int, int)>& body) const {
+    size_t totalCpus = 0;
+    for (const auto& slab : placement)
+        totalCpus += slab.node.cpus.size();
+
+    std::vector<std::atomic<int>> nextChunks(placement.size());
+    std::vector<std::thread> workers;
+    for (size_t s = 0; s < placement.size(); ++s) {
+        const int slabBegin = std::max(begin, placement[s].zBegin);
+        const int slabEnd = std::min(end, placement[s].zEnd);
+        if (slabBegin >= slabEnd)
+            continue;
+        nextChunks[s] = slabBegin;
+        // the node gets its share of the workers, at least one
+        const size_t numChunks = (slabEnd - slabBegin + chunkSize - 1) / chunkSize;
+        const size_t numThreads = std::min(numChunks, std::max<size_t>(
+                1, (m_numThreads * placement[s].node.cpus.size() + totalCpus / 2) / totalCpus));
+        for (size_t t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&, s, slabEnd]() {
+                pinCurrentThread(placement[s].node.cpus);
+                std::atomic<int>& nextChunk = nextChunks[s];
+                for (int chunkBegin = nextChunk.fetch_add(chunkSize); chunkBegin < slabEnd;
+                     chunkBegin = nextChunk.fetch_add(chunkSize)) {
+                    body(chunkBegin, std::min(chunkBegin + chunkSize, slabEnd));
+                }
+            });
+        }
+    }
+    for (auto& w : workers)
+        w.join();
+}
+
+void Fusion::integrateSlab(int zBegin, int zEnd, const FrameContext& context, Volume& volume,
+                           double truncationDistance, DirtyBricks* dirtyBricks){
+
+    for (int z = zBegin; z < zEnd; z++)
+        for (int y = 0; y < volume.getVolumeSize().y(); y++)
+            integrateVisibleRow(context, y, z, 0, volume.getVolumeSize().x(), volume, truncationDistance, dirtyBricks);
+}
 
+void Fusion::integrateBricks(int begin, int end, const Bricks& bricks, const FrameContext& context,
+                             Volume& volume, double truncationDistance, DirtyBricks* dirtyBricks){
+
+    const Eigen::Vector3i& volumeSize = volume.getVolumeSize();
+    for (int i = begin; i < end; ++i) {
+        const Eigen::Vector3i& first = bricks[i].first;
+        if (bricks[i].level > 0) {
+            integrateCoarseBrick(bricks[i], context, volume, dirtyBricks);
+            continue;
+        }
+        const Eigen::Vector3i brickEnd = (first + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(volumeSize);
+        for (int z = first.z(); z < brickEnd.z(); z++)
+            for (int y = first.y(); y < brickEnd.y(); y++)
+                integrateVisibleRow(context, y, z, first.x(), brickEnd.x(), volume, truncationDistance, dirtyBricks);
+    }
+}
 
-                        voxel_color[0] = (old_weight * voxel_color[0] + current_weight * image_color[0]) /
-                                (old_weight + current_weight);
-                        voxel_color[1] = (old_weight * voxel_color[1] + current_weight * image_color[1]) /
-                                (old_weight + current_weight);
-                        voxel_color[2] =(old_weight * voxel_color[2] + current_weight * image_color[2]) /
-                                (old_weight + current_weight);
-                        voxel_color[3] =(old_weight * voxel_color[3] + current_weight * image_color[3]) /
-                                        (old_weight + current_weight);
-                        volume->getVoxelData()[voxel_index].color = voxel_color;
+void Fusion::integrateCoarseBrick(const LevelBrick& brick, const FrameContext& context, Volume& volume,
+                                  DirtyBricks* dirtyBricks){
+
+    const Eigen::Vector3i& volumeSize = volume.getVolumeSize();
+    const Eigen::Vector3i& first = brick.first;
+    const int step = 1 << brick.level;
+    const size_t brickIdx = volume.getBrickIndex(first.x(), first.y(), first.z(), brick.level);
+    // samples are skipped once the voxels they cover start outside of the volume
+    const int samplesX = std::min(Volume::BrickSize, (volumeSize.x() - first.x() + step - 1) / step);
+    const int samplesY = std::min(Volume::BrickSize, (volumeSize.y() - first.y() + step - 1) / step);
+    const int samplesZ = std::min(Volume::BrickSize, (volumeSize.z() - first.z() + step - 1) / step);
+
+    // a sample stands for step^3 voxels, the truncation band is widened accordingly so that it still spans
+    // several samples
+    SimdIntegrator::FrameData frameData = context.frameData;
+    frameData.truncationDistance *= step;
+    const Eigen::Vector3f delta = (context.rotation.col(0) * volume.getVoxelScale() * step).cast<float>();
+
+    for (int k = 0; k < samplesZ; ++k) {
+        for (int j = 0; j < samplesY; ++j) {
+            // sample (i, j, k) covers the voxels first + [i, i+1) * step, its center is at first + (i + 0.5) * step
+            const Eigen::Vector3d center = first.cast<double>() + Eigen::Vector3d(0.5, j + 0.5, k + 0.5) * step;
+            const Eigen::Vector3d globalCoord = volume.getOrigin() + center * volume.getVoxelScale();
+            const Eigen::Vector3f p0 = (context.rotation * globalCoord + context.translation).cast<float>();
+            const size_t rowIdx = brickIdx + (size_t(k) << (2 * Volume::BrickShift)) + (size_t(j) << Volume::BrickShift);
+
+            const SimdIntegrator::Range updated = integrateContiguousRow(frameData, p0, delta, 0, samplesX, volume,
+                                                                         rowIdx);
+            if (!dirtyBricks || updated.begin >= updated.end)
+                continue;
+            const int yEnd = std::min(volumeSize.y(), first.y() + (j + 1) * step);
+            const int zEnd = std::min(volumeSize.z(), first.z() + (k + 1) * step);
+            for (int z = first.z() + k * step; z < zEnd; z += Volume::BrickSize)
+                for (int y = first.y() + j * step; y < yEnd; y += Volume::BrickSize)
+                    dirtyBricks->markRow(y, z, first.x() + updated.begin * step,
+                                         std::min(volumeSize.x(), first.x() + updated.end * step));
+        }
+    }
+}
+
+void Fusion::integrateVisibleRow(const FrameContext& context, int y, int z, int xMin, int xMax,
+                                 Volume& volume, double truncationDistance, DirtyBricks* dirtyBricks){
+
+    int xBegin, xEnd;
+    const auto& frustum = context.frustum;
+    if (z < frustum.getMinVoxel().z() || z >= frustum.getMaxVoxel().z() ||
+        y < frustum.getMinVoxel().y() || y >= frustum.getMaxVoxel().y() ||
+        !frustum.rowExtent(y, z, xBegin, xEnd))
+        return;
+    xBegin = std::max(xBegin, xMin);
+    xEnd = std::min(xEnd, xMax);
+    if (xBegin >= xEnd)
+        return;
+
+    const SimdIntegrator::Range updated = useSimdKernel(volume)
+            ? integrateRowSimd(context, y, z, xBegin, xEnd, volume)
+            : integrateRow(context, y, z, xBegin, xEnd, volume, truncationDistance);
+    if (dirtyBricks)
+        dirtyBricks->markRow(y, z, updated.begin, updated.end);
+}
+
+SimdIntegrator::Range Fusion::integrateRow(const FrameContext& context, int y, int z, int xBegin, int xEnd,
+                                           Volume& volume, double truncationDistance){
+
+    Frame& currentFrame = context.frame;
+    const Eigen::Matrix3d& rotation = context.rotation;
+    const Eigen::Vector3d& translation = context.translation;
+    auto width = currentFrame.getWidth();
+    auto& voxelData = volume.getVoxelData();
+    const auto& depthMap = currentFrame.getDepthMap();
+    const auto& colorMap = currentFrame.getColorMap();
+    // a transparent color leaves the colors of the voxels untouched when they are kept in a ColorVolume
+    const bool voxelColor = !volume.getColorVolume();
+    const Vector4uc noColor(0, 0, 0, 0);
+    const CameraModel& camera = currentFrame.getCameraModel();
+    SimdIntegrator::Range updated = {xEnd, xBegin};
+
+    for(int x=xBegin;x< xEnd;x++){
+        /*
+         * Volumetric Reconstruction
+         */
+        //calculate Camera Position
+        Eigen::Vector3d globalCoord_voxel = volume.getGlobalCoordinate(x, y, z);
+        Eigen::Vector3d currentCameraPosition = rotation * globalCoord_voxel + translation;
+        if (currentCameraPosition.z() <= 0) continue;
+
+        Eigen::Vector2i img_coord = currentFrame.projectOntoDepthPlane(currentCameraPosition);
+
+        if (!currentFrame.contains(img_coord))continue;
+
+        const double depth = depthMap[img_coord.x() + (img_coord.y() * width)];
+        if (depth <= 0) continue;
+
+        auto lambda = camera.getLambda(img_coord.x(), img_coord.y());
+        auto sdf = calculateSDF(lambda, currentCameraPosition, depth);
+
+        /*
+         * SDF Conversion to TSDF & Volumetric Integration
+         */
+        if (sdf >= -truncationDistance) {
+            size_t voxel_index = volume.getVoxelIndex(x, y, z);
+            updateVoxel(voxelData[voxel_index], sdf,
+                        voxelColor ? colorMap[img_coord.x() + (img_coord.y() * width)] : noColor, truncationDistance);
+            updated.begin = std::min(updated.begin, x);
+            updated.end = x + 1;
+        }
+    }
+    return updated;
+}
+
+void Fusion::updateVoxel(Voxel& voxel, double sdf, const Vector4uc& image_color, double truncationDistance) {
+    const double current_tsdf = std::min(1., sdf / truncationDistance); // *sgn(sdf)
+    const double current_weight = 1.0;
+    const double old_tsdf=voxel.tsdf;
+    const double old_weight = voxel.weight;
+
+    const double updated_tsdf = (old_weight*old_tsdf + current_weight*current_tsdf)/
+            (old_weight+current_weight);
+    const double updated_weight = old_weight+current_weight;
+
+    voxel.tsdf = updated_tsdf;
+    voxel.weight = updated_weight;
+
+    if (sdf <= truncationDistance / 2 && sdf >= -truncationDistance / 2) {
+
+        Vector4uc& voxel_color = voxel.color;
+        // voxel is invisible
+        if(image_color[3] == 0)
+            return;
+
+        voxel_color[0] = (old_weight * voxel_color[0] + current_weight * image_color[0]) /
+                (old_weight + current_weight);
+        voxel_color[1] = (old_weight * voxel_color[1] + current_weight * image_color[1]) /
+                (old_weight + current_weight);
+        voxel_color[2] =(old_weight * voxel_color[2] + current_weight * image_color[2]) /
+                (old_weight + current_weight);
+        voxel_color[3] =(old_weight * voxel_color[3] + current_weight * image_color[3]) /
+                        (old_weight + current_weight);
+    }
+}
+
+bool Fusion::useSimdKernel(Volume& volume) const {
+    // fixed point and planar voxels are only updated by the integer kernel
+    return m_kernel == IntegrationKernel::Simd || volume.getStorage() != VolumeStorage::Double;
+}
+
+SimdIntegrator::Range Fusion::integrateRowSimd(const FrameContext& context, int y, int z, int xBegin, int xEnd,
+                                               Volume& volume){
+
+    // camera space position of the voxel (x, y, z) is p0 + x * delta
+    const Eigen::Vector3f delta = (context.rotation.col(0) * volume.getVoxelScale()).cast<float>();
+    const Eigen::Vector3f p0 = (context.rotation * volume.getGlobalCoordinate(0, y, z) + context.translation).cast<float>();
+
+    const VolumeStorage storage = volume.getStorage();
+    const VolumeLayout layout = volume.getLayout();
+    // the index of a rolling linear volume is separable like the bricked one
+    if (layout != VolumeLayout::Linear || volume.isRolling()) {
+        // voxels outside of the frustum are rejected by the kernel anyway, widening the row to whole bricks keeps
+        // the vector loop on full runs of a brick
+        xBegin &= ~(Volume::BrickSize - 1);
+        xEnd = std::min(volume.getVolumeSize().x(), (xEnd + Volume::BrickSize - 1) & ~(Volume::BrickSize - 1));
+        // a hashed volume is integrated brick by brick, [xBegin, xEnd) is the row of a single allocated brick
+        const size_t rowBase = layout == VolumeLayout::Hashed ? volume.getVoxelIndex(xBegin, y, z)
+                                                              : volume.getIndexY()[y] + volume.getIndexZ()[z];
+        const size_t* xIndex = volume.getIndexX().data();
+        if (storage == VolumeStorage::FixedPoint)
+            return SimdIntegrator::integrateRow(context.frameData, p0, delta, xBegin, xEnd,
+                    SimdIntegrator::BrickedRow<FixedPointVoxel*>{&volume.getFixedPointVoxelData()[rowBase], xIndex});
+        if (storage == VolumeStorage::Planar)
+            return SimdIntegrator::integrateRow(context.frameData, p0, delta, xBegin, xEnd,
+                    SimdIntegrator::BrickedRow<SimdIntegrator::VoxelPlanes>{planes(volume) + rowBase, xIndex});
+        return SimdIntegrator::integrateRow(context.frameData, p0, delta, xBegin, xEnd,
+                SimdIntegrator::BrickedRow<Voxel*>{&volume.getVoxelData()[rowBase], xIndex});
+    }
+
+    return integrateContiguousRow(context.frameData, p0, delta, xBegin, xEnd, volume, volume.getVoxelIndex(0, y, z));
+}
+
+SimdIntegrator::Range Fusion::integrateContiguousRow(const SimdIntegrator::FrameData& frameData,
+                                                     const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                                                     int xBegin, int xEnd, Volume& volume, size_t rowIdx){
+
+    const VolumeStorage storage = volume.getStorage();
+    if (storage == VolumeStorage::FixedPoint)
+        return SimdIntegrator::integrateRow(frameData, p0, delta, xBegin, xEnd, &volume.getFixedPointVoxelData()[rowIdx]);
+    if (storage == VolumeStorage::Planar)
+        return SimdIntegrator::integrateRow(frameData, p0, delta, xBegin, xEnd, planes(volume) + rowIdx);
+    return SimdIntegrator::integrateRow(frameData, p0, delta, xBegin, xEnd, &volume.getVoxelData()[rowIdx]);
+}
+
+void Fusion::integratePixelRows(int vBegin, int vEnd, Frame& currentFrame, Volume& volume,
+                                const Eigen::Matrix3d& rotation, const Eigen::Vector3d& translation,
+                                double truncationDistance, DirtyBricks* dirtyBricks){
+
+    const Eigen::Vector3i volumeSize = volume.getVolumeSize();
+    const double voxelScale = volume.getVoxelScale();
+    const int width = currentFrame.getWidth();
+    auto& voxelData = volume.getVoxelData();
+    auto& fixedPointVoxelData = volume.getFixedPointVoxelData();
+    const VolumeStorage storage = volume.getStorage();
+    const SimdIntegrator::VoxelPlanes voxelPlanes = planes(volume);
+    const auto& depthMap = currentFrame.getDepthMap();
+    const auto& colorMap = currentFrame.getColorMap();
+    // a transparent color leaves the colors of the voxels untouched when they are kept in a ColorVolume
+    const bool voxelColor = !volume.getColorVolume();
+    const Vector4uc noColor(0, 0, 0, 0);
+    const CameraModel& camera = currentFrame.getCameraModel();
+    const auto& intrinsics = camera.getIntrinsics();
+    const double fovX = intrinsics(0, 0);
+    const double fovY = intrinsics(1, 1);
+    const double cX = intrinsics(0, 2);
+    const double cY = intrinsics(1, 2);
+
+    // camera center and ray directions in voxel coordinates, voxel i covers [i, i+1)
+    const Eigen::Matrix3d cameraToWorld = rotation.transpose();
+    const Eigen::Vector3d gridCenter = (-cameraToWorld * translation - volume.getOrigin()) / voxelScale;
+    // the sdf is measured along the pixel center ray, which differs from the camera z by up to half a pixel
+    const double slack = 1. / std::min(fovX, fovY);
+
+    // voxels updated by the current pixel, sorted, so a voxel hit by several sample rays is updated once
+    std::vector<size_t> visited;
+
+    for (int v = vBegin; v < vEnd; ++v) {
+        for (int u = 0; u < width; ++u) {
+            const size_t pixel = u + v * width;
+            const double depth = depthMap[pixel];
+            if (!(depth > 0) || !std::isfinite(depth)) continue;
+
+            const double tNear = std::max(0., (depth - truncationDistance) * (1. - slack));
+            const double tFar = (depth + truncationDistance) * (1. + slack);
+
+            // if a pixel covers more than a voxel a single ray misses voxels owned by this pixel,
+            // therefore the pixel is sampled with rays spaced at most 2/3 of a voxel apart
+            const int samples = std::max(1, int(std::ceil(1.5 * tFar / (std::min(fovX, fovY) * voxelScale))));
+            visited.clear();
+
+            for (int sv = 0; sv < samples; ++sv) {
+                for (int su = 0; su < samples; ++su) {
+                    const Eigen::Vector3d cameraRay = samples == 1 ? camera.getRay(u, v) : Eigen::Vector3d(
+                            (u - 0.5 + (su + 0.5) / samples - cX) / fovX,
+                            (v - 0.5 + (sv + 0.5) / samples - cY) / fovY, 1.);
+                    const Eigen::Vector3d gridRay = cameraToWorld * cameraRay / voxelScale;
+
+                    // clip the band to the volume
+                    double tBegin = tNear, tEnd = tFar;
+                    for (int i = 0; i < 3 && tBegin <= tEnd; ++i) {
+                        if (gridRay[i] == 0.) {
+                            if (gridCenter[i] < 0. || gridCenter[i] >= volumeSize[i]) tEnd = -1.;
+                            continue;
+                        }
+                        const double t0 = (0. - gridCenter[i]) / gridRay[i];
+                        const double t1 = (volumeSize[i] - gridCenter[i]) / gridRay[i];
+                        tBegin = std::max(tBegin, std::min(t0, t1));
+                        tEnd = std::min(tEnd, std::max(t0, t1));
                     }
+                    if (tBegin > tEnd) continue;
 
+                    // 3D-DDA through the voxels along the ray, see Amanatides & Woo
+                    const Eigen::Vector3d start = gridCenter + tBegin * gridRay;
+                    Eigen::Vector3i cell, step;
+                    Eigen::Vector3d tMax, tDelta;
+                    for (int i = 0; i < 3; ++i) {
+                        cell[i] = std::min(volumeSize[i] - 1, std::max(0, int(std::floor(start[i]))));
+                        step[i] = gridRay[i] >= 0 ? 1 : -1;
+                        tDelta[i] = gridRay[i] != 0. ? std::abs(1. / gridRay[i]) : std::numeric_limits<double>::infinity();
+                        tMax[i] = gridRay[i] != 0. ? tBegin + ((cell[i] + (step[i] > 0)) - start[i]) / gridRay[i]
+                                                   : std::numeric_limits<double>::infinity();
+                    }
 
+                    for (double t = tBegin; t <= tEnd;) {
+                        if ((cell.array() < 0).any() || (cell.array() >= volumeSize.array()).any()) break;
 
-				}
-			}
+                        const size_t voxel_index = volume.getVoxelIndex(cell.x(), cell.y(), cell.z());
+
+                        // same computation as the voxel sweep, restricted to the voxels owned by this pixel
+                        Eigen::Vector3d globalCoord_voxel = volume.getGlobalCoordinate(cell.x(), cell.y(), cell.z());
+                        Eigen::Vector3d currentCameraPosition = rotation * globalCoord_voxel + translation;
+                        const auto slot = samples == 1 ? visited.end()
+                                : std::lower_bound(visited.begin(), visited.end(), voxel_index);
+                        if (currentCameraPosition.z() > 0 && (slot == visited.end() || *slot != voxel_index)) {
+                            Eigen::Vector2i img_coord = currentFrame.projectOntoDepthPlane(currentCameraPosition);
+                            if (img_coord.x() == u && img_coord.y() == v) {
+                                auto lambda = camera.getLambda(u, v);
+                                auto sdf = calculateSDF(lambda, currentCameraPosition, depth);
+                                if (sdf >= -truncationDistance && sdf <= truncationDistance &&
+                                    volume.getVoxelLevel(cell.x(), cell.y(), cell.z()) == 0) {
+                                    const Vector4uc& color = voxelColor ? colorMap[pixel] : noColor;
+                                    if (storage == VolumeStorage::FixedPoint)
+                                        SimdIntegrator::updateVoxel(fixedPointVoxelData[voxel_index], sdf,
+                                                                    color, truncationDistance);
+                                    else if (storage == VolumeStorage::Planar)
+                                        SimdIntegrator::updateVoxel(voxelPlanes + voxel_index, sdf,
+                                                                    color, truncationDistance);
+                                    else
+                                        updateVoxel(voxelData[voxel_index], sdf, color, truncationDistance);
+                                    if (dirtyBricks)
+                                        dirtyBricks->mark(cell.x(), cell.y(), cell.z());
+                                    if (samples > 1) visited.insert(slot, voxel_index);
+                                }
+                            }
+                        }
+
+                        const int axis = tMax.x() < tMax.y() ? (tMax.x() < tMax.z() ? 0 : 2)
+                                                             : (tMax.y() < tMax.z() ? 1 : 2);
+                        t = tMax[axis];
+                        tMax[axis] += tDelta[axis];
+                        cell[axis] += step[axis];
+                    }
+                }
+            }
         }
     }
-    return true;
 }
 
+Fusion::Bricks Fusion::allocateBricks(Frame& currentFrame, Volume& volume, double truncationDistance,
+                                      DirtyBricks* dirtyBricks){
+
+    const Eigen::Matrix4d pose = currentFrame.getGlobalPose().inverse();
+    const Eigen::Matrix3d cameraToWorld = pose.block<3, 3>(0, 0).transpose();
+    const Eigen::Vector3d translation = pose.block<3, 1>(0, 3);
+    const double brickScale = volume.getVoxelScale() * Volume::BrickSize;
+    const int width = currentFrame.getWidth();
+    const auto& depthMap = currentFrame.getDepthMap();
+    const CameraModel& camera = currentFrame.getCameraModel();
+    const auto& intrinsics = camera.getIntrinsics();
+
+    // camera center in brick coordinates of level 0, brick i covers [i, i+1). A brick of level l covers 2^l bricks
+    // of level 0 per axis
+    const Eigen::Vector3d gridCenter = (-cameraToWorld * translation - volume.getOrigin()) / brickScale;
+    // same band as the depth splatting
+    const double slack = 1. / std::min(intrinsics(0, 0), intrinsics(1, 1));
+
+    // the bricks are collected as level, z, y, x packed into 64 bit, which sorts them like LevelBrick
+    std::vector<uint64_t> keys;
+    std::mutex keysMutex;
+    parallelFor(0, currentFrame.getHeight(), 8, [&](int vBegin, int vEnd) {
+        std::vector<uint64_t> rowKeys;
+        // neighbouring pixels mostly hit the same bricks, a small direct mapped cache of the recently collected
+        // bricks keeps most duplicates out of rowKeys
+        uint64_t recentKeys[256];
+        std::fill(std::begin(recentKeys), std::end(recentKeys), ~uint64_t(0));
+        for (int v = vBegin; v < vEnd; ++v) {
+            for (int u = 0; u < width; ++u) {
+                const double depth = depthMap[u + v * width];
+                if (!(depth > 0) || !std::isfinite(depth)) continue;
 
-double Fusion::calculateLamdas(Eigen::Vector2i &cameraSpacePoint,Eigen::Matrix3d intrinsics) {
-    double fovX = intrinsics(0, 0);
-    double fovY = intrinsics(1, 1);
-    double cX = intrinsics(0, 2);
-    double cY = intrinsics(1, 2);
-    const Eigen::Vector3d lambda(
-            (cameraSpacePoint.x() - cX) / fovX,
-            (cameraSpacePoint.y() - cY) / fovY,
-            1.);
+                // the coarser levels integrate with a wider truncation band, see integrateCoarseBrick
+                const int level = volume.getLevelForDepth(depth);
+                const double levelScale = 1 << level;
+                const Eigen::Vector3d gridRay = cameraToWorld * camera.getRay(u, v) / (brickScale * levelScale);
+                const Eigen::Vector3d gridCenterLevel = gridCenter / levelScale;
+                const int levelBrickSize = Volume::BrickSize << level;
+                const Eigen::Vector3d gridSize = volume.getVolumeSize().cast<double>() / levelBrickSize;
+                const Eigen::Vector3i brickCount = (volume.getVolumeSize() +
+                                                    Eigen::Vector3i::Constant(levelBrickSize - 1)) / levelBrickSize;
+                double tBegin = std::max(0., (depth - truncationDistance * levelScale) * (1. - slack));
+                double tEnd = (depth + truncationDistance * levelScale) * (1. + slack);
+                for (int i = 0; i < 3 && tBegin <= tEnd; ++i) {
+                    if (gridRay[i] == 0.) {
+                        if (gridCenterLevel[i] < 0. || gridCenterLevel[i] >= gridSize[i]) tEnd = -1.;
+                        continue;
+                    }
+                    const double t0 = (0. - gridCenterLevel[i]) / gridRay[i];
+                    const double t1 = (gridSize[i] - gridCenterLevel[i]) / gridRay[i];
+                    tBegin = std::max(tBegin, std::min(t0, t1));
+                    tEnd = std::min(tEnd, std::max(t0, t1));
+                }
+                if (tBegin > tEnd) continue;
+
+                // 3D-DDA through the bricks along the ray, like the voxel traversal of the splatting
+                const Eigen::Vector3d start = gridCenterLevel + tBegin * gridRay;
+                Eigen::Vector3i cell, step;
+                Eigen::Vector3d tMax, tDelta;
+                for (int i = 0; i < 3; ++i) {
+                    cell[i] = std::min(brickCount[i] - 1, std::max(0, int(std::floor(start[i]))));
+                    step[i] = gridRay[i] >= 0 ? 1 : -1;
+                    tDelta[i] = gridRay[i] != 0. ? std::abs(1. / gridRay[i]) : std::numeric_limits<double>::infinity();
+                    tMax[i] = gridRay[i] != 0. ? tBegin + ((cell[i] + (step[i] > 0)) - start[i]) / gridRay[i]
+                                               : std::numeric_limits<double>::infinity();
+                }
+                for (double t = tBegin; t <= tEnd;) {
+                    if ((cell.array() < 0).any() || (cell.array() >= brickCount.array()).any()) break;
+                    const uint64_t key = (uint64_t(level) << 60) | (uint64_t(cell.z()) << 40) |
+                                         (uint64_t(cell.y()) << 20) | uint64_t(cell.x());
+                    uint64_t& recent = recentKeys[(key * 0x9E3779B97F4A7C15ull) >> 56];
+                    if (recent != key) {
+                        recent = key;
+                        rowKeys.push_back(key);
+                    }
 
-    return lambda.norm();
+                    const int axis = tMax.x() < tMax.y() ? (tMax.x() < tMax.z() ? 0 : 2)
+                                                         : (tMax.y() < tMax.z() ? 1 : 2);
+                    t = tMax[axis];
+                    tMax[axis] += tDelta[axis];
+                    cell[axis] += step[axis];
+                }
+            }
+        }
+        std::sort(rowKeys.begin(), rowKeys.end());
+        rowKeys.erase(std::unique(rowKeys.begin(), rowKeys.end()), rowKeys.end());
+        std::lock_guard<std::mutex> lock(keysMutex);
+        keys.insert(keys.end(), rowKeys.begin(), rowKeys.end());
+    });
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    Bricks bricks;
+    bricks.reserve(keys.size());
+    for (uint64_t key : keys) {
+        LevelBrick brick;
+        brick.level = int(key >> 60);
+        brick.first = Eigen::Vector3i(int(key & 0xfffff), int((key >> 20) & 0xfffff), int((key >> 40) & 0xfffff)) *
+                      (Volume::BrickSize << brick.level);
+        if (volume.allocateBrick(brick.first.x(), brick.first.y(), brick.first.z(), brick.level) && dirtyBricks) {
+            const Eigen::Vector3i last = (brick.first + Eigen::Vector3i::Constant(Volume::BrickSize << brick.level))
+                    .cwiseMin(volume.getVolumeSize());
+            for (int z = brick.first.z(); z < last.z(); z += Volume::BrickSize)
+                for (int y = brick.first.y(); y < last.y(); y += Volume::BrickSize)
+                    dirtyBricks->markRow(y, z, brick.first.x(), last.x());
+        }
+        bricks.push_back(brick);
+    }
+    return bricks;
 }
 
 double Fusion::calculateSDF(double &lambda, Eigen::Vector3d &cameraPosition, double rawDepthValue) {
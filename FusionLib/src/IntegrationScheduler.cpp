@@ -0,0 +1,42 @@
+#include "IntegrationScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+IntegrationScheduler::IntegrationScheduler(double minTranslation, double minRotation, unsigned int maxSkippedFrames)
+        : m_minTranslation(minTranslation), m_minRotation(minRotation), m_maxSkippedFrames(maxSkippedFrames),
+          m_hasReference(false), m_lastIntegratedPose(Eigen::Matrix4d::Identity()), m_consecutiveSkips(0),
+          m_integratedFrames(0), m_skippedFrames(0) {}
+
+bool IntegrationScheduler::shouldIntegrate(const Eigen::Matrix4d& pose) {
+    bool integrate = !m_hasReference || m_consecutiveSkips >= m_maxSkippedFrames;
+
+    if (!integrate) {
+        // motion relative to the last integrated frame
+        const Eigen::Matrix4d delta = m_lastIntegratedPose.inverse() * pose;
+        const double translation = delta.block(0, 3, 3, 1).norm();
+        const double cosAngle = std::min(1., std::max(-1., (delta.block(0, 0, 3, 3).trace() - 1.) / 2.));
+        const double rotation = std::acos(cosAngle);
+        integrate = translation >= m_minTranslation || rotation >= m_minRotation;
+    }
+
+    if (!integrate) {
+        m_consecutiveSkips++;
+        m_skippedFrames++;
+        return false;
+    }
+
+    m_hasReference = true;
+    m_lastIntegratedPose = pose;
+    m_consecutiveSkips = 0;
+    m_integratedFrames++;
+    return true;
+}
+
+unsigned int IntegrationScheduler::getIntegratedFrames() const {
+    return m_integratedFrames;
+}
+
+unsigned int IntegrationScheduler::getSkippedFrames() const {
+    return m_skippedFrames;
+}
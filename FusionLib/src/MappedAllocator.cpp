@@ -0,0 +1,103 @@
+#include "MappedAllocator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define KFUSION_HAS_MMAP 1
+#endif
+
+namespace {
+
+// smaller blocks would waste most of their last page
+constexpr size_t MapThreshold = size_t(1) << 20;
+
+}
+
+void* mappedAllocate(size_t bytes) {
+#ifdef KFUSION_HAS_MMAP
+    if (bytes >= MapThreshold) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+#endif
+    return std::calloc(bytes > 0 ? bytes : 1, 1);
+}
+
+void mappedFree(void* p, size_t bytes) {
+    if (!p)
+        return;
+#ifdef KFUSION_HAS_MMAP
+    if (bytes >= MapThreshold) {
+        munmap(p, bytes);
+        return;
+    }
+#endif
+    std::free(p);
+}
+
+void mappedDiscard(void* p, size_t bytes) {
+    if (!p || bytes == 0)
+        return;
+    char* begin = static_cast<char*>(p);
+    char* end = begin + bytes;
+#if defined(__linux__)
+    // MADV_DONTNEED drops private anonymous pages, malloc memory included, they read as zero afterwards. Other
+    // systems may keep the old content, there the range is only cleared
+    const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    char* pagesBegin = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + pageSize - 1) / pageSize * pageSize);
+    char* pagesEnd = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(end) / pageSize * pageSize);
+    if (pagesBegin < pagesEnd && madvise(pagesBegin, size_t(pagesEnd - pagesBegin), MADV_DONTNEED) == 0) {
+        std::memset(begin, 0, size_t(pagesBegin - begin));
+        std::memset(pagesEnd, 0, size_t(end - pagesEnd));
+        return;
+    }
+#endif
+    std::memset(begin, 0, bytes);
+}
+
+bool mappedAdviseHugePages(void* p, size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (!p || bytes < MapThreshold)
+        return false;
+    const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(p) + pageSize - 1) / pageSize * pageSize;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(p) + bytes) / pageSize * pageSize;
+    return begin < end && madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0;
+#else
+    (void)p;
+    (void)bytes;
+    return false;
+#endif
+}
+
+size_t residentBytes(const void* p, size_t bytes) {
+#ifdef KFUSION_HAS_MMAP
+    if (!p || bytes == 0)
+        return 0;
+    const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p) / pageSize * pageSize;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+    const size_t pages = (end - begin + pageSize - 1) / pageSize;
+#if defined(__APPLE__)
+    std::vector<char> residency(pages);
+#else
+    std::vector<unsigned char> residency(pages);
+#endif
+    if (mincore(reinterpret_cast<void*>(begin), end - begin, residency.data()) != 0)
+        return bytes;
+    size_t resident = 0;
+    for (size_t i = 0; i < pages; ++i)
+        if (residency[i] & 1)
+            resident++;
+    return std::min(bytes, resident * pageSize);
+#else
+    (void)p;
+    return bytes;
+#endif
+}
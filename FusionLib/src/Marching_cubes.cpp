@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <iomanip>
+#include <tuple>
 #include "Marching_cubes.hpp"
+#include "VolumeGrid.hpp"
+#include "BrickSummary.hpp"
+#include "ColorVolume.hpp"
 
 struct VoxelWCoords {
 	Voxel _data;
@@ -16,7 +21,7 @@ struct triangleShape {
 };
 
 Eigen::Vector3d interpolate(VoxelWCoords v1, VoxelWCoords v2) {
-	double t = (0 - v1._data.tsdf) / (v2._data.tsdf - v1._data.tsdf);
+	double t = (0 - v1._data.getTSDF()) / (v2._data.getTSDF() - v1._data.getTSDF());
 	Eigen::Vector3d vec1, vec2;
 	vec1 << v1._x, v1._y, v1._z;
 	vec2 << v2._x, v2._y, v2._z;
@@ -49,31 +54,41 @@ std::string printTriangleFaces(triangleShape tri, double number) {
 	return ss.str();
 }
 
-void MarchingCubes::extractMesh(Volume &volume, std::string fileName) {
-	std::vector<triangleShape> faces;
-	auto volumeSize = volume.getVolumeSize();
-	auto voxelScale = volume.getVoxelScale();
-	//iterate over all cubes in the volume
-	for (int z = 0; z < volumeSize.z() - 1; z++) {
-		for (int y = 0; y < volumeSize.y() - 1; y++) {
-			for (int x = 0; x < volumeSize.x() - 1; x++) {
+//meshes the cubes with their first corner in [begin, end), grid is a VolumeGrid or DynamicVolumeGrid of the volume.
+//With a color volume the triangles are colored by sampling it at their centroid
+template<typename Grid>
+void meshCubes(const Grid& grid, const Eigen::Vector3i& begin, const Eigen::Vector3i& end, double voxelScale,
+			   const Eigen::Vector3d& origin, const ColorVolume* colors, std::vector<triangleShape>& faces) {
+	for (int z = begin.z(); z < end.z(); z++) {
+		for (int y = begin.y(); y < end.y(); y++) {
+			for (int x = begin.x(); x < end.x(); x++) {
+				//cubes without a zero crossing produce no triangles, for them only the tsdf is read
+				static const int cornerOffsets[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1},
+														{0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}};
+				int insideCorners = 0;
+				for (int i = 0; i < 8; i++) {
+					if (grid.getTSDF(x + cornerOffsets[i][0], y + cornerOffsets[i][1], z + cornerOffsets[i][2]) <= 0.0)
+						insideCorners++;
+				}
+				if (insideCorners == 0 || insideCorners == 8) continue;
+
 				//get all corners of each cube
 				std::vector<VoxelWCoords> points;
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x, y, z, volumeSize)], x, y, z});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x + 1, y, z, volumeSize)],
+				points.push_back({grid.getVoxel(x, y, z), x, y, z});
+				points.push_back({grid.getVoxel(x + 1, y, z),
 								  x + 1, y, z});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x + 1, y, z + 1, volumeSize)],
+				points.push_back({grid.getVoxel(x + 1, y, z + 1),
 								  x + 1, y, z + 1});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x, y, z + 1, volumeSize)], x, y,
+				points.push_back({grid.getVoxel(x, y, z + 1), x, y,
 								  z + 1});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x, y + 1, z, volumeSize)], x,
+				points.push_back({grid.getVoxel(x, y + 1, z), x,
 								  y + 1, z});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x + 1, y + 1, z, volumeSize)],
+				points.push_back({grid.getVoxel(x + 1, y + 1, z),
 								  x + 1, y + 1, z});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x + 1, y + 1, z + 1, volumeSize)],
+				points.push_back({grid.getVoxel(x + 1, y + 1, z + 1),
 								  x + 1, y + 1,
 								  z + 1});
-				points.push_back({volume.getVoxelData()[calculateCoordinateToIndex(x, y + 1, z + 1, volumeSize)], x,
+				points.push_back({grid.getVoxel(x, y + 1, z + 1), x,
 								  y + 1, z + 1});
 
 				//calculate Table Index
@@ -84,18 +99,18 @@ void MarchingCubes::extractMesh(Volume &volume, std::string fileName) {
 				bool valid = true;
 
 				for(int i = 0;i<8;i++){
-					if(points[i]._data.weight  ==0.)valid = false;
+					if(points[i]._data.getWeight()  ==0.)valid = false;
 				}
 				if(!valid) continue;
 
 				double tsdf =-10;
                 for ( size_t voxel_corner = 0; voxel_corner < points.size(); voxel_corner++){
-                    if (points[voxel_corner]._data.tsdf <= isoLevel && points[voxel_corner]._data.weight != 0) {
+                    if (points[voxel_corner]._data.getTSDF() <= isoLevel && points[voxel_corner]._data.getWeight() != 0) {
                         cubeIndex |= int(std::pow(2,voxel_corner));
-                        if(points[voxel_corner]._data.tsdf>tsdf){
-                            averageColor = points[voxel_corner]._data.color;
+                        if(points[voxel_corner]._data.getTSDF()>tsdf){
+                            averageColor = points[voxel_corner]._data.getColor();
                             contributors++;
-                            tsdf = points[voxel_corner]._data.tsdf;
+                            tsdf = points[voxel_corner]._data.getTSDF();
                         }
                     }
                 }
@@ -116,9 +131,11 @@ void MarchingCubes::extractMesh(Volume &volume, std::string fileName) {
 
                     triangleShape tri;
                     tri.color = averageColor;
-                    tri._idx1 = interpolate(points[a0], points[b0])*voxelScale+volume.getOrigin();
-                    tri._idx2 = interpolate(points[a1], points[b1])*voxelScale+volume.getOrigin();
-                    tri._idx3 = interpolate(points[a2], points[b2])*voxelScale+volume.getOrigin();
+                    tri._idx1 = interpolate(points[a0], points[b0])*voxelScale+origin;
+                    tri._idx2 = interpolate(points[a1], points[b1])*voxelScale+origin;
+                    tri._idx3 = interpolate(points[a2], points[b2])*voxelScale+origin;
+                    if (colors)
+                        tri.color = colors->getColor((tri._idx1 + tri._idx2 + tri._idx3) / 3.);
                     faces.push_back(tri);
                 }
 
@@ -126,6 +143,76 @@ void MarchingCubes::extractMesh(Volume &volume, std::string fileName) {
             }
         }
     }
+}
+
+void MarchingCubes::extractMesh(Volume &volume, std::string fileName) {
+	extractMesh(volume, fileName, Eigen::Vector3i::Zero(), volume.getVolumeSize());
+}
+
+void MarchingCubes::extractMesh(Volume &volume, std::string fileName, const Eigen::Vector3i& minVoxel,
+								const Eigen::Vector3i& maxVoxel) {
+	std::vector<triangleShape> faces;
+	auto volumeSize = volume.getVolumeSize();
+	auto voxelScale = volume.getVoxelScale();
+	//iterate over all cubes in the volume brick by brick, in the order the bricks are stored
+	const Eigen::Vector3i lastCube = (volumeSize - Eigen::Vector3i::Ones()).cwiseMin(maxVoxel);
+	//a brick of a coarser level of a hashed volume is meshed on the fine grid as well, the volume interpolates its
+	//samples. The parts covered by a finer brick are left to that brick, so the mesh has no cracks between levels
+	//a paged volume is meshed in layers of BrickSize voxels along z, only the bricks of the current and the next
+	//layer have to be resident
+	std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> levelBricks;
+	std::vector<int> blockLevels;
+	const bool splitBricks = volume.getMaxLevel() > 0 || volume.isPaged();
+	if (splitBricks) {
+		auto blocks = volume.getPagedBricks();
+		decltype(blocks) split;
+		for (const auto& block : blocks) {
+			const Eigen::Vector3i& first = block.first;
+			const Eigen::Vector3i end = (first + Eigen::Vector3i::Constant(Volume::BrickSize << block.second)).cwiseMin(volumeSize);
+			for (int z = first.z(); z < end.z(); z += Volume::BrickSize)
+				for (int y = first.y(); y < end.y(); y += Volume::BrickSize)
+					for (int x = first.x(); x < end.x(); x += Volume::BrickSize)
+						split.emplace_back(Eigen::Vector3i(x, y, z), block.second);
+		}
+		if (volume.isPaged()) {
+			std::sort(split.begin(), split.end(), [](const std::pair<Eigen::Vector3i, int>& a, const std::pair<Eigen::Vector3i, int>& b) {
+				return std::make_tuple(a.first.z(), a.first.y(), a.first.x()) < std::make_tuple(b.first.z(), b.first.y(), b.first.x());
+			});
+		}
+		for (const auto& block : split) {
+			levelBricks.push_back(block.first);
+			blockLevels.push_back(block.second);
+		}
+	}
+	const auto& bricks = splitBricks ? levelBricks : volume.getBrickOrder();
+	const BrickSummary* summary = volume.getBrickSummary();
+	const ColorVolume* colors = volume.getColorVolume().get();
+	int pagedLayer = -1;
+	for (size_t b = 0; b < bricks.size(); b++) {
+		const Eigen::Vector3i& brick = bricks[b];
+		if (volume.isPaged() && brick.z() / Volume::BrickSize != pagedLayer) {
+			if (pagedLayer >= 0)
+				volume.evictBricks();
+			pagedLayer = brick.z() / Volume::BrickSize;
+			volume.pageIn(Eigen::Vector3i(0, 0, brick.z()),
+						  Eigen::Vector3i(volumeSize.x(), volumeSize.y(), brick.z() + Volume::BrickSize + 1));
+		}
+		if (volume.getMaxLevel() > 0 && volume.getVoxelLevel(brick.x(), brick.y(), brick.z()) != blockLevels[b])
+			continue;
+		const Eigen::Vector3i brickBegin = brick.cwiseMax(minVoxel);
+		const Eigen::Vector3i brickEnd = (brick + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(lastCube);
+		if ((brickBegin.array() >= brickEnd.array()).any())
+			continue;
+		//the voxels of bricks whose cubes cannot produce triangles are not read
+		if (summary && !summary->mayContainSurface(brick.x() >> BrickSummary::BrickShift,
+												   brick.y() >> BrickSummary::BrickShift,
+												   brick.z() >> BrickSummary::BrickShift))
+			continue;
+		dispatchVolumeGrid(volume, [&](const auto& grid) {
+			meshCubes(grid, brickBegin, brickEnd, voxelScale, volume.getOrigin(), colors, faces);
+		});
+	}
+	volume.evictBricks();
     std::string filenameBaseOut = PROJECT_DIR + std::string("/results/");
 
     // Write off file.
@@ -0,0 +1,136 @@
+#include "NumaTopology.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+// from linux/mempolicy.h, which is not installed everywhere, numaif.h needs libnuma
+constexpr int MpolPreferred = 1;
+
+// parses a cpu list like "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        const size_t dash = range.find('-');
+        try {
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            // empty list of a node without cpus
+        }
+    }
+    return cpus;
+}
+#endif
+
+}
+
+std::vector<NumaNode> getNumaNodes() {
+    std::vector<NumaNode> nodes;
+#if defined(__linux__)
+    // node ids may have gaps. preferNode takes a mask of 64 nodes
+    for (int id = 0; id < 64; ++id) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        if (!file.is_open())
+            continue;
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus = parseCpuList(list);
+        // memory-only nodes cannot run the integration
+        if (!cpus.empty())
+            nodes.push_back({id, std::move(cpus)});
+    }
+#endif
+    if (nodes.empty()) {
+        NumaNode node{0, {}};
+        for (int cpu = 0; cpu < int(std::max(1u, std::thread::hardware_concurrency())); ++cpu)
+            node.cpus.push_back(cpu);
+        nodes.push_back(std::move(node));
+    }
+    return nodes;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+bool preferNode(void* p, size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (!p || bytes == 0 || node < 0 || node >= 64)
+        return false;
+    const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p) / pageSize * pageSize;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+    const unsigned long nodeMask = 1ul << node;
+    return syscall(SYS_mbind, begin, end - begin, MpolPreferred, &nodeMask, 64, 0) == 0;
+#else
+    (void)p;
+    (void)bytes;
+    (void)node;
+    return false;
+#endif
+}
+
+void addBytesPerNode(const void* p, size_t bytes, size_t stride, std::vector<std::pair<int, size_t>>& bytesPerNode) {
+#if defined(__linux__) && defined(SYS_move_pages)
+    if (!p || bytes == 0)
+        return;
+    stride = std::max<size_t>(1, stride);
+    const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p) / pageSize * pageSize;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+    // move_pages without target nodes only reports the node of every page, or a negative error if it is not resident
+    constexpr size_t Batch = 4096;
+    std::vector<void*> pages;
+    std::vector<int> status(Batch);
+    for (uintptr_t page = begin; page < end;) {
+        pages.clear();
+        for (; page < end && pages.size() < Batch; page += stride * pageSize)
+            pages.push_back(reinterpret_cast<void*>(page));
+        if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0)
+            return;
+        for (size_t i = 0; i < pages.size(); ++i) {
+            if (status[i] < 0)
+                continue;
+            auto entry = std::find_if(bytesPerNode.begin(), bytesPerNode.end(),
+                                      [&](const std::pair<int, size_t>& e) { return e.first == status[i]; });
+            if (entry == bytesPerNode.end())
+                entry = bytesPerNode.insert(bytesPerNode.end(), {status[i], 0});
+            entry->second += stride * pageSize;
+        }
+    }
+#else
+    (void)p;
+    (void)bytes;
+    (void)stride;
+    (void)bytesPerNode;
+#endif
+}
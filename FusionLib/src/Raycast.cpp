@@ -1,15 +1,34 @@
+#include <limits>
 #include "MeshWriter.h"
 #include "Raycast.hpp"
+#include "BrickSummary.hpp"
+#include "ColorVolume.hpp"
+#include "ViewFrustum.hpp"
+#include "VolumeGrid.hpp"
 
 bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared_ptr<Volume>& volume,float truncationDistance){
 
-    auto volumeSize =volume->getVolumeSize();
-    auto voxelScale = volume->getVoxelScale();
-    auto pose = currentFrame->getGlobalPose();
+    // the rays only read resident bricks, bricks of a paged volume in the view are read back first
+    if (volume->isPaged())
+        volume->pageIn(ViewFrustum(*currentFrame, *volume, truncationDistance));
+
+    dispatchVolumeGrid(*volume, [&](const auto& grid) {
+        castRays(grid, *currentFrame, *volume, truncationDistance);
+    });
+    currentFrame->computeNormalFromGlobals();
+    return true;
+}
+
+template<typename Grid>
+void Raycast::castRays(const Grid& grid, Frame& currentFrame, Volume& volume, float truncationDistance){
+
+    auto volumeSize =volume.getVolumeSize();
+    auto voxelScale = volume.getVoxelScale();
+    auto pose = currentFrame.getGlobalPose();
     auto rotationMatrix = pose.block(0,0,3,3);
     auto translation = pose.block(0,3,3,1);
-    auto width = currentFrame->getWidth();
-    auto height = currentFrame->getHeight();
+    auto width = currentFrame.getWidth();
+    auto height = currentFrame.getHeight();
 
     std::vector<double> depthMap (width*height);
 
@@ -19,26 +38,78 @@ bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared
     std::vector<Eigen::Vector3d> vertices(height*width);
     std::vector<Vector4uc> colors;
 
+    const BrickSummary* summary = volume.getBrickSummary();
+    //a separate color volume is sampled at the vertex, see Volume::enableColorVolume
+    const ColorVolume* colorVolume = volume.getColorVolume().get();
+    const float step = truncationDistance * 0.5f;
+    /*
+     * Ray length at which the ray leaves the run of bricks without negative tsdf the sample at rayLength reads, less
+     * a margin for rounding, or 0 if that brick has a negative tsdf or the sample is outside. Infinity if the run
+     * reaches the border of the volume, which the ray does not enter again. The bricks are traversed like the voxels
+     * of a 3D DDA.
+     */
+    const auto freeRunEnd = [&](const Eigen::Vector3d& translation, const Eigen::Vector3d& direction, float rayLength) {
+        Eigen::Vector3d point;
+        if (!calculatePointOnRay(point, grid, translation, direction, rayLength))
+            return 0.;
+        Eigen::Vector3i brick = volume.getVoxelCoordinate(point).unaryExpr([](int v) {
+            return v >> BrickSummary::BrickShift;
+        });
+        if (summary->hasNegativeTSDF(brick.x(), brick.y(), brick.z()))
+            return 0.;
+        // incremental traversal of the bricks: next[axis] is the distance along the ray to the next brick border
+        const Eigen::Vector3d voxel = (point - volume.getOrigin()) / voxelScale;
+        const Eigen::Vector3i& brickCount = summary->getBrickCount();
+        Eigen::Vector3d next, delta;
+        Eigen::Vector3i stepDirection;
+        double border = std::numeric_limits<double>::infinity();
+        for (int axis = 0; axis < 3; ++axis) {
+            stepDirection[axis] = direction[axis] > 0. ? 1 : -1;
+            if (direction[axis] == 0.) {
+                next[axis] = delta[axis] = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            const double bound = (brick[axis] + (direction[axis] > 0. ? 1 : 0)) * BrickSummary::BrickSize;
+            next[axis] = (bound - voxel[axis]) * voxelScale / direction[axis];
+            delta[axis] = BrickSummary::BrickSize * voxelScale / std::abs(direction[axis]);
+            border = std::min(border, ((direction[axis] > 0. ? volumeSize[axis] : 0) - voxel[axis]) * voxelScale /
+                                      direction[axis]);
+        }
+        double exit = 0.;
+        for (;;) {
+            int exitAxis;
+            exit = next.minCoeff(&exitAxis);
+            next[exitAxis] += delta[exitAxis];
+            brick[exitAxis] += stepDirection[exitAxis];
+            // the partial bricks at the upper border end at the volume border before their brick border
+            if (exit >= border || brick[exitAxis] < 0 || brick[exitAxis] >= brickCount[exitAxis])
+                return std::numeric_limits<double>::infinity();
+            if (summary->hasNegativeTSDF(brick.x(), brick.y(), brick.z()))
+                break;
+        }
+        return rayLength + exit - 0.01 * voxelScale;
+    };
+
     for( size_t v =0;v<height;v++){
         for(size_t u=0;u< width;u++) {
             vertices[u+ v*width] = Eigen::Vector3d(MINF, MINF, MINF);
             //calculate Normalized Direction
-            auto direction = calculateRayDirection(u, v, rotationMatrix, currentFrame->getIntrinsics());
+            auto direction = calculateRayDirection(u, v, rotationMatrix, currentFrame.getCameraModel());
 
             //calculate rayLength
             float rayLength (0.f);
 
             Ray ray (translation, direction);
-            if ( ! (volume->intersects( ray, rayLength))) continue;
+            if ( ! (volume.intersects( ray, rayLength))) continue;
 
             rayLength += voxelScale;
 
             Eigen::Vector3d currentPoint;
-            if(! calculatePointOnRay(currentPoint, volume, translation,
+            if(! calculatePointOnRay(currentPoint, grid, translation,
                                      direction,rayLength))
                 continue;
 
-            double currentTSDF = volume->getTSDF(currentPoint);
+            double currentTSDF = grid.getTSDF(currentPoint);
 
             const double maxSearchLength = rayLength + volumeRange.norm();
 
@@ -46,14 +117,26 @@ bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared
 
             for (; rayLength < maxSearchLength; rayLength += truncationDistance * 0.5f) {
 
+                //a crossing or the end of the search needs a negative sample. After a sample >= 0, the samples in
+                //bricks without negative tsdf are skipped up to the last one before the next brick with a negative
+                //tsdf, which is read as before. The ray length is advanced in steps, so the samples stay the same.
+                //Past the volume there are only samples outside, so the search ends if the ray leaves it
+                if (summary && currentTSDF >= 0.) {
+                    const double runEnd = freeRunEnd(translation, direction, rayLength + step);
+                    if (runEnd == std::numeric_limits<double>::infinity())
+                        break;
+                    while (rayLength + step + step < runEnd)
+                        rayLength += step;
+                }
+
                 Eigen::Vector3d previousPoint = currentPoint;
                 const double previousTSDF = currentTSDF;
 
-                if (!calculatePointOnRay(currentPoint, volume, translation,
+                if (!calculatePointOnRay(currentPoint, grid, translation,
                                          direction,rayLength+truncationDistance * 0.5f))
                     continue;
 
-                currentTSDF = volume->getTSDF(currentPoint);
+                currentTSDF = grid.getTSDF(currentPoint);
 
                 //This equals -ve to +ve in the paper / we cant go from a negative to positive tsdf value as negative is behind the surface
                 if (previousTSDF < 0. && currentTSDF > 0.)break;
@@ -64,7 +147,7 @@ bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared
 
                     vertices[u+ v*width] = globalVertex;
 
-                    Eigen::Vector3d gridVertex = (globalVertex - volume->getOrigin())/ voxelScale;
+                    Eigen::Vector3d gridVertex = (globalVertex - volume.getOrigin())/ voxelScale;
 
                     if (gridVertex.x()-1 < 1 || gridVertex.x()+1 >= volumeSize.x() - 1 ||
                         gridVertex.y()-1 < 1 || gridVertex.y()+1 >= volumeSize.y() - 1 ||
@@ -77,16 +160,19 @@ bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared
 
                     Vector4uc color;
 
-                    if(std::abs(previousTSDF) < std::abs(currentTSDF)){
-                        color = volume->getColor(previousPoint);
+                    if (colorVolume) {
+                        color = colorVolume->getColor(globalVertex);
+                    }
+                    else if(std::abs(previousTSDF) < std::abs(currentTSDF)){
+                        color = grid.getColor(previousPoint);
                     }
                     else{
-                        color = volume->getColor(currentPoint);
+                        color = grid.getColor(currentPoint);
                     }
 
-                    currentFrame->setGlobalPoint(globalVertex,u,v);
-                    // currentFrame->setGlobalNormal(normal,u,v);
-                    currentFrame->setColor(color,u,v);
+                    currentFrame.setGlobalPoint(globalVertex,u,v);
+                    // currentFrame.setGlobalNormal(normal,u,v);
+                    currentFrame.setColor(color,u,v);
 
                     colors.emplace_back(color);
 
@@ -94,8 +180,6 @@ bool Raycast::surfacePrediction(std::shared_ptr<Frame>& currentFrame,std::shared
             }
         }
     }
-    currentFrame->computeNormalFromGlobals();
-    return true;
 }
 
 Eigen::Vector3d Raycast::getVertexAtZeroCrossing(
@@ -106,27 +190,20 @@ Eigen::Vector3d Raycast::getVertexAtZeroCrossing(
 }
 
 Eigen::Vector3d Raycast::calculateRayDirection(size_t x, size_t y, const Eigen::Matrix3d& rotation,
-                                               const Eigen::Matrix3d& intrinsics) {
-    double fovX = intrinsics(0, 0);
-    double fovY = intrinsics(1, 1);
-    double cX = intrinsics(0, 2);
-    double cY = intrinsics(1, 2);
-
-    Eigen::Vector3d cameraPoint = Eigen::Vector3d((x - cX) / fovX , (y - cY) / fovY ,1.0);
-    Eigen::Vector3d rayDirection = rotation * cameraPoint;
-    rayDirection.normalize();
-
-    return rayDirection;
+                                               const CameraModel& camera) {
+    // the rotation preserves the length of the precomputed unit direction
+    return rotation * camera.getRayDirection(x, y);
 }
 
+template<typename Grid>
 bool Raycast::calculatePointOnRay(Eigen::Vector3d& currentPoint,
-                                  std::shared_ptr<Volume>& volume,
+                                  const Grid& grid,
                                   const Eigen::Vector3d& origin,
                                   const Eigen::Vector3d& direction,
                                   float raylength
 ) {
     currentPoint = (origin + (direction * raylength));
-    return volume->contains(currentPoint);
+    return grid.contains(currentPoint);
 }
 
 Eigen::Vector3i Raycast::getOriginForInterpolation(const Eigen::Vector3d& point){
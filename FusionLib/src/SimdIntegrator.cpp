@@ -0,0 +1,563 @@
+#include "SimdIntegrator.hpp"
+#include "Volume.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KFUSION_X86_SIMD
+#endif
+
+namespace {
+
+using FrameData = SimdIntegrator::FrameData;
+using Range = SimdIntegrator::Range;
+using VoxelPlanes = SimdIntegrator::VoxelPlanes;
+template<typename RowT>
+using BrickedRow = SimdIntegrator::BrickedRow<RowT>;
+
+// the vector loops need contiguous voxels, for bricked rows they start at a brick border
+template<typename RowT>
+struct RowAlignment {
+    static constexpr int value = 1;
+};
+
+template<typename RowT>
+struct RowAlignment<BrickedRow<RowT>> {
+    static constexpr int value = Volume::BrickSize;
+};
+
+// extends the range by the voxels [begin, end) of the row
+inline void extend(Range& range, int begin, int end) {
+    if (range.begin >= range.end)
+        range.begin = begin;
+    range.end = end;
+}
+
+// the kernels address the voxel x of a row as row + x, which is a pointer for the voxel structs and VoxelPlanes for
+// the planar storage
+
+// same weighted average as the scalar integration in Fusion.cpp
+inline void blendVoxel(const FrameData& frame, float sdf, int pixel, Voxel* voxel) {
+    const double truncationDistance = frame.truncationDistance;
+    const double current_tsdf = std::min(1., sdf / truncationDistance);
+    const double current_weight = 1.0;
+    const double old_tsdf = voxel->tsdf;
+    const double old_weight = voxel->weight;
+
+    voxel->tsdf = (old_weight * old_tsdf + current_weight * current_tsdf) / (old_weight + current_weight);
+    voxel->weight = old_weight + current_weight;
+
+    if (frame.colorMap && sdf <= truncationDistance / 2 && sdf >= -truncationDistance / 2) {
+        const Vector4uc& image_color = frame.colorMap[pixel];
+        // voxel is invisible
+        if (image_color[3] == 0)
+            return;
+        for (int c = 0; c < 4; ++c)
+            voxel->color[c] = (old_weight * voxel->color[c] + current_weight * image_color[c]) /
+                             (old_weight + current_weight);
+    }
+}
+
+// 2^16 / n rounded to nearest, for n >= 2 at most 2^15 so that (a - b) * reciprocal(n) fits into 32 bits
+inline int32_t reciprocal(int32_t n) {
+    return (65536 + n / 2) / n;
+}
+
+const std::vector<int32_t>& reciprocalTable() {
+    static const std::vector<int32_t> table = []() {
+        std::vector<int32_t> t(FixedPointVoxel::MaxWeight + 2, 0);
+        for (int32_t n = 1; n < int32_t(t.size()); ++n)
+            t[n] = reciprocal(n);
+        return t;
+    }();
+    return table;
+}
+
+inline int32_t quantizeTSDF(float sdf, float truncationDistance) {
+    const float tsdf = std::min(1.f, sdf / truncationDistance) * float(FixedPointVoxel::TSDFScale);
+    return std::max(-FixedPointVoxel::TSDFScale, int32_t(std::nearbyint(tsdf)));
+}
+
+// a + (b - a) / n with an error of at most one unit in the last place, n >= 2
+inline int32_t blendFixedPoint(int32_t a, int32_t b, int32_t reciprocal) {
+    return a + (((b - a) * reciprocal + 32768) >> 16);
+}
+
+// integer version of the weighted average, the vectorized updates in integrateRowAVX2 compute the same values.
+// rgb may be nullptr for a volume without color
+inline void blendVoxel(int32_t tsdf, bool updateColor, const Vector4uc& image_color,
+                       int16_t& voxelTSDF, uint16_t& voxelWeight, uint8_t* rgb) {
+    updateColor = updateColor && rgb;
+    if (voxelWeight == 0) {
+        voxelTSDF = int16_t(tsdf);
+        voxelWeight = 1;
+        if (updateColor)
+            for (int c = 0; c < 3; ++c)
+                rgb[c] = image_color[c];
+        return;
+    }
+    const int32_t n = int32_t(voxelWeight) + 1;
+    const int32_t r = reciprocal(n);
+    voxelTSDF = int16_t(blendFixedPoint(voxelTSDF, tsdf, r));
+    voxelWeight = uint16_t(n > FixedPointVoxel::MaxWeight ? FixedPointVoxel::MaxWeight : n);
+    if (updateColor)
+        for (int c = 0; c < 3; ++c)
+            rgb[c] = uint8_t(blendFixedPoint(rgb[c], image_color[c], r));
+}
+
+inline void blendVoxel(int32_t tsdf, bool updateColor, const Vector4uc& image_color, FixedPointVoxel& voxel) {
+    blendVoxel(tsdf, updateColor, image_color, voxel.tsdf, voxel.weight, voxel.rgb);
+}
+
+// the bytes of a color word are R, G, B and the reserved byte, as in FixedPointVoxel
+inline void blendVoxel(int32_t tsdf, bool updateColor, const Vector4uc& image_color, const VoxelPlanes& voxel) {
+    blendVoxel(tsdf, updateColor, image_color, *voxel.tsdf, *voxel.weight,
+               reinterpret_cast<uint8_t*>(voxel.color));
+}
+
+// a frame without color map, for a volume with a ColorVolume, leaves the colors of the voxels untouched
+inline bool updatesColor(const FrameData& frame, float sdf, int pixel) {
+    return frame.colorMap && sdf <= frame.truncationDistance / 2 && sdf >= -frame.truncationDistance / 2 &&
+           frame.colorMap[pixel][3] != 0;
+}
+
+const Vector4uc NoColor(0, 0, 0, 0);
+
+inline void blendVoxel(const FrameData& frame, float sdf, int pixel, FixedPointVoxel* voxel) {
+    const bool updateColor = updatesColor(frame, sdf, pixel);
+    blendVoxel(quantizeTSDF(sdf, frame.truncationDistance), updateColor, updateColor ? frame.colorMap[pixel] : NoColor,
+               *voxel);
+}
+
+inline void blendVoxel(const FrameData& frame, float sdf, int pixel, const VoxelPlanes& voxel) {
+    const bool updateColor = updatesColor(frame, sdf, pixel);
+    blendVoxel(quantizeTSDF(sdf, frame.truncationDistance), updateColor, updateColor ? frame.colorMap[pixel] : NoColor,
+               voxel);
+}
+
+template<typename VoxelRef>
+inline bool integrateVoxel(const FrameData& frame, float pX, float pY, float pZ, VoxelRef voxel) {
+    if (pZ <= 0) return false;
+    const float invZ = 1.f / pZ;
+    const float u = std::nearbyint(frame.fX * pX * invZ + frame.cX);
+    const float v = std::nearbyint(frame.fY * pY * invZ + frame.cY);
+    if (u < 0 || v < 0 || u > frame.width - 1 || v > frame.height - 1) return false;
+
+    const int pixel = int(u) + int(v) * frame.width;
+    const float depth = frame.depthMap[pixel];
+    if (depth <= 0) return false;
+
+    const float sdf = depth - std::sqrt(pX * pX + pY * pY + pZ * pZ) * frame.inverseLambdas[pixel];
+    if (sdf < -frame.truncationDistance) return false;
+
+    blendVoxel(frame, sdf, pixel, voxel);
+    return true;
+}
+
+template<typename RowT>
+Range integrateRowScalar(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                         int xBegin, int xEnd, RowT row) {
+    Range updated = {0, 0};
+    for (int x = xBegin; x < xEnd; ++x) {
+        const Eigen::Vector3f p = p0 + float(x) * delta;
+        if (integrateVoxel(frame, p.x(), p.y(), p.z(), row + x))
+            extend(updated, x, x + 1);
+    }
+    return updated;
+}
+
+// integrates the voxels before the first aligned x with the scalar loop, returns that x
+template<typename RowT>
+int alignRow(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta, int xBegin, int xEnd,
+             RowT row, Range& updated) {
+    const int alignment = RowAlignment<RowT>::value;
+    if (alignment == 1)
+        return xBegin;
+    const int aligned = std::min(xEnd, (xBegin + alignment - 1) / alignment * alignment);
+    updated = integrateRowScalar(frame, p0, delta, xBegin, aligned, row);
+    return aligned;
+}
+
+#ifdef KFUSION_X86_SIMD
+
+// updates the voxels [0, 8) of row whose lane is set in valid
+__attribute__((target("avx2,fma")))
+inline void blendLanesAVX2(const FrameData& frame, __m256 sdf, __m256i pixel, __m256 valid, Voxel* row) {
+    alignas(32) float sdfs[8];
+    alignas(32) int pixels[8];
+    int mask = _mm256_movemask_ps(valid);
+    _mm256_store_ps(sdfs, sdf);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(pixels), pixel);
+    while (mask) {
+        const int i = __builtin_ctz(mask);
+        mask &= mask - 1;
+        blendVoxel(frame, sdfs[i], pixels[i], row + i);
+    }
+}
+
+// blendFixedPoint on 8 lanes, lanes set in unobserved take b
+__attribute__((target("avx2,fma")))
+inline __m256i blendFixedPointAVX2(__m256i a, __m256i b, __m256i reciprocal, __m256i unobserved) {
+    const __m256i step = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), reciprocal),
+                                                            _mm256_set1_epi32(32768)), 16);
+    return _mm256_blendv_epi8(_mm256_add_epi32(a, step), b, unobserved);
+}
+
+// quantizeTSDF on 8 lanes
+__attribute__((target("avx2,fma")))
+inline __m256i quantizeTSDFAVX2(const FrameData& frame, __m256 sdf) {
+    const __m256 truncation = _mm256_set1_ps(frame.truncationDistance);
+    const __m256 scaled = _mm256_mul_ps(_mm256_min_ps(_mm256_set1_ps(1.f), _mm256_div_ps(sdf, truncation)),
+                                        _mm256_set1_ps(float(FixedPointVoxel::TSDFScale)));
+    return _mm256_max_epi32(_mm256_set1_epi32(-FixedPointVoxel::TSDFScale), _mm256_cvtps_epi32(scaled));
+}
+
+// blends the RGB bytes of 8 color words, the reserved byte is kept. Only lanes within half the truncation distance
+// with a visible pixel are changed
+__attribute__((target("avx2,fma")))
+inline __m256i blendColorAVX2(const FrameData& frame, __m256 sdf, __m256i pixel, __m256i validMask, __m256i color,
+                              __m256i reciprocal, __m256i unobserved) {
+    const __m256i lowByte = _mm256_set1_epi32(0xff);
+    const __m256i imageColor = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                                                           reinterpret_cast<const int*>(frame.colorMap), pixel,
+                                                           validMask, 4);
+    const __m256 halfTruncation = _mm256_set1_ps(frame.truncationDistance / 2);
+    __m256i colorMask = _mm256_and_si256(validMask, _mm256_castps_si256(_mm256_and_ps(
+            _mm256_cmp_ps(sdf, halfTruncation, _CMP_LE_OQ),
+            _mm256_cmp_ps(sdf, _mm256_sub_ps(_mm256_setzero_ps(), halfTruncation), _CMP_GE_OQ))));
+    colorMask = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_srli_epi32(imageColor, 24), _mm256_setzero_si256()),
+                                    colorMask);
+    __m256i newColor = _mm256_andnot_si256(_mm256_set1_epi32(0xffffff), color);
+    for (int c = 0; c < 3; ++c) {
+        const __m256i channel = blendFixedPointAVX2(_mm256_and_si256(_mm256_srli_epi32(color, 8 * c), lowByte),
+                                                    _mm256_and_si256(_mm256_srli_epi32(imageColor, 8 * c), lowByte),
+                                                    reciprocal, unobserved);
+        newColor = _mm256_or_si256(newColor, _mm256_slli_epi32(channel, 8 * c));
+    }
+    return _mm256_blendv_epi8(color, newColor, colorMask);
+}
+
+// integer SIMD version of blendVoxel(..., FixedPointVoxel*), one voxel per 32 bit lane
+__attribute__((target("avx2,fma")))
+inline void blendLanesAVX2(const FrameData& frame, __m256 sdf, __m256i pixel, __m256 valid, FixedPointVoxel* row) {
+    static_assert(sizeof(FixedPointVoxel) == 8, "FixedPointVoxel has to consist of a tsdf/weight and a color word");
+    const __m256i lowWord = _mm256_set1_epi32(0xffff);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i validMask = _mm256_castps_si256(valid);
+    const __m256i tsdf = quantizeTSDFAVX2(frame, sdf);
+
+    // split 8 voxels into the tsdf/weight words and the color words
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i* voxels = reinterpret_cast<__m256i*>(row);
+    const __m256i first = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(voxels), deinterleave);
+    const __m256i second = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(voxels + 1), deinterleave);
+    const __m256i tsdfWeight = _mm256_permute2x128_si256(first, second, 0x20);
+    const __m256i color = _mm256_permute2x128_si256(first, second, 0x31);
+
+    const __m256i oldTSDF = _mm256_srai_epi32(_mm256_slli_epi32(tsdfWeight, 16), 16);
+    const __m256i oldWeight = _mm256_srli_epi32(tsdfWeight, 16);
+    const __m256i n = _mm256_add_epi32(oldWeight, one);
+    const __m256i unobserved = _mm256_cmpeq_epi32(oldWeight, _mm256_setzero_si256());
+    const __m256i reciprocal = _mm256_i32gather_epi32(reciprocalTable().data(), n, 4);
+
+    const __m256i newWeight = _mm256_min_epi32(n, _mm256_set1_epi32(FixedPointVoxel::MaxWeight));
+    const __m256i newTSDFWeight = _mm256_or_si256(_mm256_and_si256(blendFixedPointAVX2(oldTSDF, tsdf, reciprocal, unobserved), lowWord),
+                                                  _mm256_slli_epi32(newWeight, 16));
+
+    const __m256i newColor = frame.colorMap ? blendColorAVX2(frame, sdf, pixel, validMask, color, reciprocal, unobserved)
+                                            : color;
+
+    // interleave again and write back the valid voxels
+    const __m256i interleave = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i firstOut = _mm256_permutevar8x32_epi32(_mm256_permute2x128_si256(newTSDFWeight, newColor, 0x20),
+                                                         interleave);
+    const __m256i secondOut = _mm256_permutevar8x32_epi32(_mm256_permute2x128_si256(newTSDFWeight, newColor, 0x31),
+                                                          interleave);
+    const __m256i firstMask = _mm256_permutevar8x32_epi32(validMask, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    const __m256i secondMask = _mm256_permutevar8x32_epi32(validMask, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(voxels), firstMask, firstOut);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(voxels + 1), secondMask, secondOut);
+}
+
+// same update on the planes, 8 int16 tsdf and uint16 weight values are widened to 32 bit lanes
+__attribute__((target("avx2,fma")))
+inline void blendLanesAVX2(const FrameData& frame, __m256 sdf, __m256i pixel, __m256 valid, const VoxelPlanes& row) {
+    const __m256i validMask = _mm256_castps_si256(valid);
+    const __m256i tsdf = quantizeTSDFAVX2(frame, sdf);
+
+    __m128i* tsdfPlane = reinterpret_cast<__m128i*>(row.tsdf);
+    __m128i* weightPlane = reinterpret_cast<__m128i*>(row.weight);
+    const __m256i oldTSDF = _mm256_cvtepi16_epi32(_mm_loadu_si128(tsdfPlane));
+    const __m256i oldWeight = _mm256_cvtepu16_epi32(_mm_loadu_si128(weightPlane));
+    const __m256i n = _mm256_add_epi32(oldWeight, _mm256_set1_epi32(1));
+    const __m256i unobserved = _mm256_cmpeq_epi32(oldWeight, _mm256_setzero_si256());
+    const __m256i reciprocal = _mm256_i32gather_epi32(reciprocalTable().data(), n, 4);
+
+    // there is no 16 bit masked store, invalid lanes are written back unchanged. The row belongs to the calling thread
+    const __m256i newTSDF = _mm256_blendv_epi8(oldTSDF, blendFixedPointAVX2(oldTSDF, tsdf, reciprocal, unobserved),
+                                               validMask);
+    const __m256i newWeight = _mm256_blendv_epi8(
+            oldWeight, _mm256_min_epi32(n, _mm256_set1_epi32(FixedPointVoxel::MaxWeight)), validMask);
+    // packs works within the 128 bit halves, the permutation moves both results into the low half
+    _mm_storeu_si128(tsdfPlane, _mm256_castsi256_si128(
+            _mm256_permute4x64_epi64(_mm256_packs_epi32(newTSDF, newTSDF), 0x08)));
+    _mm_storeu_si128(weightPlane, _mm256_castsi256_si128(
+            _mm256_permute4x64_epi64(_mm256_packus_epi32(newWeight, newWeight), 0x08)));
+
+    if (!row.color || !frame.colorMap)
+        return;
+    __m256i* colorPlane = reinterpret_cast<__m256i*>(row.color);
+    const __m256i color = _mm256_loadu_si256(colorPlane);
+    _mm256_storeu_si256(colorPlane, blendColorAVX2(frame, sdf, pixel, validMask, color, reciprocal, unobserved));
+}
+
+// consecutive runs of a bricked row lie in different bricks, which defeats the hardware prefetcher
+inline void prefetchRun(const Voxel* voxels) {
+    for (size_t line = 0; line < 8 * sizeof(Voxel); line += 64)
+        _mm_prefetch(reinterpret_cast<const char*>(voxels) + line, _MM_HINT_T0);
+}
+
+inline void prefetchRun(const FixedPointVoxel* voxels) {
+    _mm_prefetch(reinterpret_cast<const char*>(voxels), _MM_HINT_T0);
+}
+
+inline void prefetchRun(const VoxelPlanes& voxels) {
+    _mm_prefetch(reinterpret_cast<const char*>(voxels.tsdf), _MM_HINT_T0);
+    _mm_prefetch(reinterpret_cast<const char*>(voxels.weight), _MM_HINT_T0);
+    if (voxels.color)
+        _mm_prefetch(reinterpret_cast<const char*>(voxels.color), _MM_HINT_T0);
+}
+
+// prefetches the voxels x of bricked rows, contiguous rows are left to the hardware
+template<typename RowT>
+inline void prefetchVoxels(RowT, int, int) {}
+
+template<typename RowT>
+inline void prefetchVoxels(const BrickedRow<RowT>& row, int x, int xEnd) {
+    if (x < xEnd)
+        prefetchRun(row + x);
+}
+
+template<typename RowT>
+__attribute__((target("avx2,fma")))
+Range integrateRowAVX2(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                       int xBegin, int xEnd, RowT row) {
+    const __m256 lane = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    const __m256 p0X = _mm256_set1_ps(p0.x()), p0Y = _mm256_set1_ps(p0.y()), p0Z = _mm256_set1_ps(p0.z());
+    const __m256 dX = _mm256_set1_ps(delta.x()), dY = _mm256_set1_ps(delta.y()), dZ = _mm256_set1_ps(delta.z());
+    const __m256 fX = _mm256_set1_ps(frame.fX), fY = _mm256_set1_ps(frame.fY);
+    const __m256 cX = _mm256_set1_ps(frame.cX), cY = _mm256_set1_ps(frame.cY);
+    const __m256 maxU = _mm256_set1_ps(float(frame.width - 1)), maxV = _mm256_set1_ps(float(frame.height - 1));
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+    const __m256 negTruncation = _mm256_set1_ps(-frame.truncationDistance);
+    const __m256i width = _mm256_set1_epi32(frame.width);
+
+    Range updated = {0, 0};
+    int x = alignRow(frame, p0, delta, xBegin, xEnd, row, updated);
+    for (; x + 8 <= xEnd; x += 8) {
+        prefetchVoxels(row, x + 4 * 8, xEnd);
+        const __m256 xs = _mm256_add_ps(_mm256_set1_ps(float(x)), lane);
+        const __m256 pX = _mm256_fmadd_ps(xs, dX, p0X);
+        const __m256 pY = _mm256_fmadd_ps(xs, dY, p0Y);
+        const __m256 pZ = _mm256_fmadd_ps(xs, dZ, p0Z);
+
+        __m256 valid = _mm256_cmp_ps(pZ, zero, _CMP_GT_OQ);
+        if (!_mm256_movemask_ps(valid)) continue;
+
+        // projection onto the depth plane
+        const __m256 invZ = _mm256_div_ps(one, pZ);
+        const __m256 u = _mm256_round_ps(_mm256_fmadd_ps(_mm256_mul_ps(fX, pX), invZ, cX),
+                                         _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        const __m256 v = _mm256_round_ps(_mm256_fmadd_ps(_mm256_mul_ps(fY, pY), invZ, cY),
+                                         _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, maxU, _CMP_LE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, maxV, _CMP_LE_OQ));
+        if (!_mm256_movemask_ps(valid)) continue;
+
+        // depth test
+        const __m256i pixel = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtps_epi32(v), width),
+                                               _mm256_cvtps_epi32(u));
+        const __m256 depth = _mm256_mask_i32gather_ps(zero, frame.depthMap, pixel, valid, 4);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(depth, zero, _CMP_GT_OQ));
+
+        // signed distance along the ray through the pixel, 1 / lambda comes from the table of the camera model
+        const __m256 inverseLambda = _mm256_mask_i32gather_ps(one, frame.inverseLambdas, pixel, valid, 4);
+        const __m256 distance = _mm256_sqrt_ps(
+                _mm256_fmadd_ps(pX, pX, _mm256_fmadd_ps(pY, pY, _mm256_mul_ps(pZ, pZ))));
+        const __m256 sdf = _mm256_fnmadd_ps(distance, inverseLambda, depth);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(sdf, negTruncation, _CMP_GE_OQ));
+
+        const int mask = _mm256_movemask_ps(valid);
+        if (!mask) continue;
+        blendLanesAVX2(frame, sdf, pixel, valid, row + x);
+        extend(updated, x + __builtin_ctz(mask), x + 32 - __builtin_clz(mask));
+    }
+    const Range tail = integrateRowScalar(frame, p0, delta, x, xEnd, row);
+    if (tail.begin < tail.end)
+        extend(updated, tail.begin, tail.end);
+    return updated;
+}
+
+template<typename RowT>
+Range integrateRowSSE2(const FrameData& frame, const Eigen::Vector3f& p0, const Eigen::Vector3f& delta,
+                       int xBegin, int xEnd, RowT row) {
+    const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128 p0X = _mm_set1_ps(p0.x()), p0Y = _mm_set1_ps(p0.y()), p0Z = _mm_set1_ps(p0.z());
+    const __m128 dX = _mm_set1_ps(delta.x()), dY = _mm_set1_ps(delta.y()), dZ = _mm_set1_ps(delta.z());
+    const __m128 fX = _mm_set1_ps(frame.fX), fY = _mm_set1_ps(frame.fY);
+    const __m128 cX = _mm_set1_ps(frame.cX), cY = _mm_set1_ps(frame.cY);
+    const __m128 maxU = _mm_set1_ps(float(frame.width - 1)), maxV = _mm_set1_ps(float(frame.height - 1));
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    const __m128 negTruncation = _mm_set1_ps(-frame.truncationDistance);
+
+    alignas(16) float us[4], vs[4], depths[4], inverseLambdas[4], sdfs[4];
+    int pixels[4];
+
+    Range updated = {0, 0};
+    int x = alignRow(frame, p0, delta, xBegin, xEnd, row, updated);
+    for (; x + 4 <= xEnd; x += 4) {
+        const __m128 xs = _mm_add_ps(_mm_set1_ps(float(x)), lane);
+        const __m128 pX = _mm_add_ps(_mm_mul_ps(xs, dX), p0X);
+        const __m128 pY = _mm_add_ps(_mm_mul_ps(xs, dY), p0Y);
+        const __m128 pZ = _mm_add_ps(_mm_mul_ps(xs, dZ), p0Z);
+
+        __m128 valid = _mm_cmpgt_ps(pZ, zero);
+        if (!_mm_movemask_ps(valid)) continue;
+
+        // projection onto the depth plane, cvtps rounds to nearest with the default rounding mode
+        const __m128 invZ = _mm_div_ps(one, pZ);
+        const __m128 u = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fX, pX), invZ), cX)));
+        const __m128 v = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fY, pY), invZ), cY)));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(u, maxU));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(v, maxV));
+        int mask = _mm_movemask_ps(valid);
+        if (!mask) continue;
+
+        // SSE2 has no gather, the depth values of the valid lanes are loaded one by one
+        _mm_store_ps(us, u);
+        _mm_store_ps(vs, v);
+        for (int i = 0; i < 4; ++i) {
+            pixels[i] = (mask & (1 << i)) ? int(us[i]) + int(vs[i]) * frame.width : 0;
+            depths[i] = (mask & (1 << i)) ? frame.depthMap[pixels[i]] : 0.f;
+            inverseLambdas[i] = frame.inverseLambdas[pixels[i]];
+        }
+        const __m128 depth = _mm_load_ps(depths);
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(depth, zero));
+
+        // signed distance along the ray through the pixel, 1 / lambda comes from the table of the camera model
+        const __m128 distance = _mm_sqrt_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(pX, pX), _mm_mul_ps(pY, pY)), _mm_mul_ps(pZ, pZ)));
+        const __m128 sdf = _mm_sub_ps(depth, _mm_mul_ps(distance, _mm_load_ps(inverseLambdas)));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(sdf, negTruncation));
+
+        mask = _mm_movemask_ps(valid);
+        if (!mask) continue;
+        extend(updated, x + __builtin_ctz(mask), x + 32 - __builtin_clz(mask));
+        _mm_store_ps(sdfs, sdf);
+        while (mask) {
+            const int i = __builtin_ctz(mask);
+            mask &= mask - 1;
+            blendVoxel(frame, sdfs[i], pixels[i], row + (x + i));
+        }
+    }
+    const Range tail = integrateRowScalar(frame, p0, delta, x, xEnd, row);
+    if (tail.begin < tail.end)
+        extend(updated, tail.begin, tail.end);
+    return updated;
+}
+
+#endif
+
+struct RowKernel {
+    Range (*integrateRow)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int, Voxel*);
+    Range (*integrateRowFixedPoint)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int,
+                                    FixedPointVoxel*);
+    Range (*integrateRowPlanes)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int,
+                                VoxelPlanes);
+    Range (*integrateBrickedRow)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int,
+                                 BrickedRow<Voxel*>);
+    Range (*integrateBrickedRowFixedPoint)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int,
+                                           BrickedRow<FixedPointVoxel*>);
+    Range (*integrateBrickedRowPlanes)(const FrameData&, const Eigen::Vector3f&, const Eigen::Vector3f&, int, int,
+                                       BrickedRow<VoxelPlanes>);
+    const char* name;
+};
+
+#define KFUSION_ROW_KERNEL(kernel, name) \
+    {kernel<Voxel*>, kernel<FixedPointVoxel*>, kernel<VoxelPlanes>, kernel<BrickedRow<Voxel*>>, \
+     kernel<BrickedRow<FixedPointVoxel*>>, kernel<BrickedRow<VoxelPlanes>>, name}
+
+RowKernel selectRowKernel() {
+#ifdef KFUSION_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return KFUSION_ROW_KERNEL(integrateRowAVX2, "AVX2");
+    return KFUSION_ROW_KERNEL(integrateRowSSE2, "SSE2");
+#else
+    return KFUSION_ROW_KERNEL(integrateRowScalar, "scalar");
+#endif
+}
+
+#undef KFUSION_ROW_KERNEL
+
+const RowKernel rowKernel = selectRowKernel();
+
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd, Voxel* row) {
+    return rowKernel.integrateRow(frame, p0, delta, xBegin, xEnd, row);
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd,
+                                                  FixedPointVoxel* row) {
+    return rowKernel.integrateRowFixedPoint(frame, p0, delta, xBegin, xEnd, row);
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd,
+                                                  const VoxelPlanes& row) {
+    return rowKernel.integrateRowPlanes(frame, p0, delta, xBegin, xEnd, row);
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd,
+                                                  const BrickedRow<Voxel*>& row) {
+    return rowKernel.integrateBrickedRow(frame, p0, delta, xBegin, xEnd, row);
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd,
+                                                  const BrickedRow<FixedPointVoxel*>& row) {
+    return rowKernel.integrateBrickedRowFixedPoint(frame, p0, delta, xBegin, xEnd, row);
+}
+
+SimdIntegrator::Range SimdIntegrator::integrateRow(const FrameData& frame, const Eigen::Vector3f& p0,
+                                                  const Eigen::Vector3f& delta, int xBegin, int xEnd,
+                                                  const BrickedRow<VoxelPlanes>& row) {
+    return rowKernel.integrateBrickedRowPlanes(frame, p0, delta, xBegin, xEnd, row);
+}
+
+void SimdIntegrator::updateVoxel(FixedPointVoxel& voxel, float sdf, const Vector4uc& image_color,
+                                 float truncationDistance) {
+    const bool updateColor = sdf <= truncationDistance / 2 && sdf >= -truncationDistance / 2 && image_color[3] != 0;
+    blendVoxel(quantizeTSDF(sdf, truncationDistance), updateColor, image_color, voxel);
+}
+
+void SimdIntegrator::updateVoxel(const VoxelPlanes& voxel, float sdf, const Vector4uc& image_color,
+                                 float truncationDistance) {
+    const bool updateColor = sdf <= truncationDistance / 2 && sdf >= -truncationDistance / 2 && image_color[3] != 0;
+    blendVoxel(quantizeTSDF(sdf, truncationDistance), updateColor, image_color, voxel);
+}
+
+const char* SimdIntegrator::instructionSet() {
+    return rowKernel.name;
+}
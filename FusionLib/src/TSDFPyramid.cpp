@@ -0,0 +1,114 @@
+#include "TSDFPyramid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "BrickSummary.hpp"
+#include "VolumeGrid.hpp"
+
+TSDFPyramid::TSDFPyramid(std::shared_ptr<Volume> volume, int levels)
+        : m_volume(std::move(volume)) {
+    createLevels(std::max(0, std::min(levels, MaxLevels)));
+    rebuild();
+}
+
+void TSDFPyramid::createLevels(int levels) {
+    m_levels.clear();
+    Eigen::Vector3i size = m_volume->getVolumeSize();
+    for (int level = 1; level <= levels; ++level) {
+        size = (size + Eigen::Vector3i::Ones()) / 2;
+        m_levels.push_back(std::make_shared<Volume>(m_volume->getOrigin(), size,
+                                                    m_volume->getVoxelScale() * double(1 << level),
+                                                    VolumeStorage::FixedPoint, m_volume->hasColor()));
+        if (m_volume->getBrickSummary())
+            m_levels.back()->enableBrickSummary();
+        m_levels.back()->setColorVolume(m_volume->getColorVolume());
+    }
+}
+
+void TSDFPyramid::update(const DirtyBricks& bricks) {
+    const auto marked = bricks.getBricks();
+    for (int level = 1; level <= getLevelCount(); ++level) {
+        const Eigen::Vector3i& size = m_levels[level - 1]->getVolumeSize();
+        const auto toLevel = [level](int voxel) { return voxel >> level; };
+        DirtyBricks levelBricks(size);
+        for (const Eigen::Vector3i& brick : marked) {
+            // a brick covers (BrickSize >> level)^3 voxels of the level, the voxels of different bricks are disjoint
+            const Eigen::Vector3i first = brick * DirtyBricks::BrickSize;
+            const Eigen::Vector3i end = first + Eigen::Vector3i::Constant(DirtyBricks::BrickSize);
+            downsample(level, first.unaryExpr(toLevel), end.unaryExpr(toLevel).cwiseMin(size));
+            levelBricks.mark(first.x() >> level, first.y() >> level, first.z() >> level);
+        }
+        if (BrickSummary* summary = m_levels[level - 1]->getBrickSummary()) {
+            const BrickSummary::BrickList bricks = levelBricks.getBricks();
+            summary->update(*m_levels[level - 1], bricks, 0, bricks.size());
+        }
+    }
+}
+
+void TSDFPyramid::rebuild() {
+    // a shift of a rolling volume moves its origin by whole bricks of the volume, which are no whole bricks of the
+    // coarser levels, so the levels are created again at the new origin
+    if (!m_levels.empty() && m_levels.front()->getOrigin() != m_volume->getOrigin())
+        createLevels(getLevelCount());
+    for (int level = 1; level <= getLevelCount(); ++level) {
+        downsample(level, Eigen::Vector3i::Zero(), m_levels[level - 1]->getVolumeSize());
+        m_levels[level - 1]->updateBrickSummary();
+    }
+}
+
+int TSDFPyramid::getLevelCount() const {
+    return int(m_levels.size());
+}
+
+std::shared_ptr<Volume> TSDFPyramid::getLevel(int level) const {
+    return level <= 0 ? m_volume : m_levels[std::min(level, getLevelCount()) - 1];
+}
+
+int TSDFPyramid::selectLevel(double maxVoxelScale) const {
+    for (int level = getLevelCount(); level > 0; --level)
+        if (m_levels[level - 1]->getVoxelScale() <= maxVoxelScale)
+            return level;
+    return 0;
+}
+
+void TSDFPyramid::downsample(int level, const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) {
+    Volume& target = *m_levels[level - 1];
+    Volume& source = *getLevel(level - 1);
+    const Eigen::Vector3i& sourceSize = source.getVolumeSize();
+    auto& voxels = target.getFixedPointVoxelData();
+
+    dispatchVolumeGrid(source, [&](const auto& grid) {
+        for (int z = minVoxel.z(); z < maxVoxel.z(); ++z) {
+            for (int y = minVoxel.y(); y < maxVoxel.y(); ++y) {
+                for (int x = minVoxel.x(); x < maxVoxel.x(); ++x) {
+                    double tsdf = 0., weight = 0.;
+                    Eigen::Vector4d color = Eigen::Vector4d::Zero();
+                    int observed = 0;
+                    for (int child = 0; child < 8; ++child) {
+                        const int cx = 2 * x + (child & 1), cy = 2 * y + ((child >> 1) & 1), cz = 2 * z + (child >> 2);
+                        if (cx >= sourceSize.x() || cy >= sourceSize.y() || cz >= sourceSize.z())
+                            continue;
+                        const Voxel voxel = grid.getVoxel(cx, cy, cz);
+                        if (voxel.weight <= 0.)
+                            continue;
+                        tsdf += voxel.weight * voxel.tsdf;
+                        weight += voxel.weight;
+                        color += voxel.weight * voxel.color.cast<double>();
+                        observed++;
+                    }
+
+                    FixedPointVoxel& voxel = voxels[target.getVoxelIndex(x, y, z)];
+                    if (observed == 0) {
+                        voxel = FixedPointVoxel();
+                        continue;
+                    }
+                    voxel.tsdf = int16_t(std::lround(std::max(-1., std::min(1., tsdf / weight)) *
+                                                     FixedPointVoxel::TSDFScale));
+                    voxel.weight = uint16_t(std::max(1l, std::min(std::lround(weight / observed),
+                                                                  long(FixedPointVoxel::MaxWeight))));
+                    voxel.setColor((color / weight).array().round().cast<unsigned char>());
+                }
+            }
+        }
+    });
+}
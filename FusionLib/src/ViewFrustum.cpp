@@ -0,0 +1,140 @@
+#include "ViewFrustum.hpp"
+
+#include <cmath>
+
+namespace {
+
+// restricts [lower, upper] to the x which satisfy a + b*x >= 0
+bool clipLinear(double a, double b, double& lower, double& upper) {
+    if (b > 0)
+        lower = std::max(lower, -a / b);
+    else if (b < 0)
+        upper = std::min(upper, -a / b);
+    else if (a < 0)
+        return false;
+    return lower <= upper;
+}
+
+}
+
+ViewFrustum::ViewFrustum(Frame& frame, Volume& volume, double truncationDistance)
+        : ViewFrustum(frame, volume.getOrigin(), volume.getVoxelScale(), volume.getVolumeSize(), truncationDistance) {}
+
+ViewFrustum::ViewFrustum(Frame& frame, const Eigen::Vector3d& origin, double voxelScale,
+                         const Eigen::Vector3i& volumeSize, double truncationDistance) {
+    const Eigen::Matrix4d pose = frame.getGlobalPose().inverse();
+    m_rotation = pose.block(0, 0, 3, 3);
+    m_translation = pose.block(0, 3, 3, 1);
+
+    m_volumeOrigin = origin;
+    m_voxelScale = voxelScale;
+    m_volumeSizeX = volumeSize.x();
+
+    const auto& intrinsics = frame.getIntrinsics();
+    m_fX = intrinsics(0, 0);
+    m_fY = intrinsics(1, 1);
+    m_cX = intrinsics(0, 2);
+    m_cY = intrinsics(1, 2);
+    m_width = frame.getWidth();
+    m_height = frame.getHeight();
+
+    double maxDepth = 0.;
+    for (double depth : frame.getDepthMap())
+        if (std::isfinite(depth))
+            maxDepth = std::max(maxDepth, depth);
+
+    // the sdf is measured along the ray through the pixel center, which may be shorter than the camera z of the
+    // voxel by up to half a pixel --> widen the far plane accordingly
+    m_farDepth = (maxDepth + truncationDistance) * (1. + 1. / std::min(m_fX, m_fY));
+
+    m_minVoxel.setZero();
+    m_maxVoxel.setZero();
+    if (maxDepth <= 0.)
+        return;
+
+    // camera center and the four far corners of the frustum in voxel coordinates
+    const Eigen::Matrix3d cameraToWorld = m_rotation.transpose();
+    std::vector<Eigen::Vector3d> corners;
+    corners.emplace_back(-cameraToWorld * m_translation);
+    for (double u : {-0.5, m_width - 0.5}) {
+        for (double v : {-0.5, m_height - 0.5}) {
+            const Eigen::Vector3d cameraPoint((u - m_cX) / m_fX * m_farDepth, (v - m_cY) / m_fY * m_farDepth, m_farDepth);
+            corners.emplace_back(cameraToWorld * (cameraPoint - m_translation));
+        }
+    }
+
+    Eigen::Vector3d lower = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector3d upper = Eigen::Vector3d::Constant(std::numeric_limits<double>::lowest());
+    for (const auto& corner : corners) {
+        const Eigen::Vector3d voxel = (corner - m_volumeOrigin) / m_voxelScale - Eigen::Vector3d::Constant(0.5);
+        lower = lower.cwiseMin(voxel);
+        upper = upper.cwiseMax(voxel);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        m_minVoxel[i] = int(std::max(0., std::floor(lower[i]) - 1));
+        m_maxVoxel[i] = int(std::min<double>(volumeSize[i], std::ceil(upper[i]) + 2));
+    }
+}
+
+bool ViewFrustum::intersectsVolume() const {
+    return (m_minVoxel.array() < m_maxVoxel.array()).all();
+}
+
+const Eigen::Vector3i& ViewFrustum::getMinVoxel() const {
+    return m_minVoxel;
+}
+
+const Eigen::Vector3i& ViewFrustum::getMaxVoxel() const {
+    return m_maxVoxel;
+}
+
+bool ViewFrustum::intersectsBox(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) const {
+    if (!intersectsVolume())
+        return false;
+    // voxel i covers [i, i+1) * voxelScale, one voxel of slack as in rowExtent
+    const Eigen::Vector3d center = m_volumeOrigin + 0.5 * (minVoxel + maxVoxel).cast<double>() * m_voxelScale;
+    const double radius = (0.5 * (maxVoxel - minVoxel).cast<double>().norm() + 1.) * m_voxelScale;
+    const Eigen::Vector3d p = m_rotation * center + m_translation;
+
+    if (p.z() < -radius || p.z() > m_farDepth + radius)
+        return false;
+    // the side planes through the camera center, the same inequalities as in rowExtent
+    const Eigen::Vector3d normals[4] = {{m_fX, 0., m_cX + 0.5}, {-m_fX, 0., m_width - 0.5 - m_cX},
+                                        {0., m_fY, m_cY + 0.5}, {0., -m_fY, m_height - 0.5 - m_cY}};
+    for (const auto& normal : normals)
+        if (normal.dot(p) < -radius * normal.norm())
+            return false;
+    return true;
+}
+
+bool ViewFrustum::rowExtent(int y, int z, int& xBegin, int& xEnd) const {
+    // camera space position of the voxel (x, y, z) is p0 + x * delta
+    const Eigen::Vector3d globalCoord = m_volumeOrigin + Eigen::Vector3d(0.5, y + 0.5, z + 0.5) * m_voxelScale;
+    const Eigen::Vector3d p0 = m_rotation * globalCoord + m_translation;
+    const Eigen::Vector3d delta = m_rotation.col(0) * m_voxelScale;
+
+    double lower = 0.;
+    double upper = m_volumeSizeX - 1;
+
+    // in front of the camera and before the far plane
+    if (!clipLinear(p0.z(), delta.z(), lower, upper)) return false;
+    if (!clipLinear(m_farDepth - p0.z(), -delta.z(), lower, upper)) return false;
+
+    // round(u) in [0, width-1]  <=>  -0.5 <= fX*x/z + cX < width - 0.5, multiplied by z > 0
+    if (!clipLinear(m_fX * p0.x() + (m_cX + 0.5) * p0.z(), m_fX * delta.x() + (m_cX + 0.5) * delta.z(), lower, upper))
+        return false;
+    if (!clipLinear((m_width - 0.5 - m_cX) * p0.z() - m_fX * p0.x(),
+                    (m_width - 0.5 - m_cX) * delta.z() - m_fX * delta.x(), lower, upper))
+        return false;
+    if (!clipLinear(m_fY * p0.y() + (m_cY + 0.5) * p0.z(), m_fY * delta.y() + (m_cY + 0.5) * delta.z(), lower, upper))
+        return false;
+    if (!clipLinear((m_height - 0.5 - m_cY) * p0.z() - m_fY * p0.y(),
+                    (m_height - 0.5 - m_cY) * delta.z() - m_fY * delta.y(), lower, upper))
+        return false;
+
+    // one voxel of slack on both sides absorbs rounding of the projection
+    xBegin = std::max(0, int(std::floor(lower)) - 1);
+    xEnd = std::min(m_volumeSizeX, int(std::floor(upper)) + 2);
+    return xBegin < xEnd;
+}
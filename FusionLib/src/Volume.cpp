@@ -1,5 +1,37 @@
 #include "Volume.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include "BrickStore.hpp"
+#include "BrickSummary.hpp"
+#include "ColorVolume.hpp"
+#include "ViewFrustum.hpp"
+
+namespace {
+
+// spreads the lower 10 bits of v so that two zero bits follow every bit
+uint32_t spreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+}
+
+constexpr int Volume::BrickShift;
+constexpr int Volume::BrickSize;
+constexpr int Volume::SwapCellShift;
+
 Ray::Ray(const Eigen::Vector3d &origin, const Eigen::Vector3d &dir) : orig(origin), dir(dir) {
     invdir[0] = 1/dir[0];
     invdir[1] = 1/dir[1];
@@ -10,20 +42,88 @@ Ray::Ray(const Eigen::Vector3d &origin, const Eigen::Vector3d &dir) : orig(origi
 }
 
 
-Volume::Volume(const Eigen::Vector3d origin, const Eigen::Vector3i volumeSize, const double voxelScale)
-        : _volumeSize(volumeSize),
+Volume::Volume(const Eigen::Vector3d origin, const Eigen::Vector3i volumeSize, const double voxelScale,
+               VolumeStorage storage, bool storeColor, VolumeLayout layout, int maxLevel, double levelDistance)
+        : _storage(storage),
+          _layout(layout),
+          _hasColor(storeColor || storage != VolumeStorage::Planar),
+          _volumeSize(volumeSize),
           _voxelScale(voxelScale),
           _volumeRange(volumeSize.cast<double>()*voxelScale),
           _origin(origin),
-          _maxPoint(voxelScale * volumeSize.cast<double>())
+          _maxPoint(voxelScale * volumeSize.cast<double>()),
+          _maxLevel(layout == VolumeLayout::Hashed ? std::min(8, std::max(0, maxLevel)) : 0),
+          _levelDistance(levelDistance)
           {
-    _voxelData.resize(volumeSize.x() * volumeSize.y() * volumeSize.z(),Voxel());
+    size_t numVoxels = size_t(volumeSize.x()) * volumeSize.y() * volumeSize.z();
+    const size_t brickCount[3] = {size_t(volumeSize.x() + BrickSize - 1) >> BrickShift,
+                                  size_t(volumeSize.y() + BrickSize - 1) >> BrickShift,
+                                  size_t(volumeSize.z() + BrickSize - 1) >> BrickShift};
+    if (layout == VolumeLayout::Bricked) {
+        // the bricks are stored in cubic superblocks of 2^superShift bricks per side, the bricks of a superblock in
+        // Morton order and the superblocks in linear order. Both parts of the index are separable. superShift is as
+        // large as possible while the padding to whole superblocks stays below 20 %, so a volume with a power of two
+        // number of bricks along all axes is a single Morton curve
+        const size_t numBricks = brickCount[0] * brickCount[1] * brickCount[2];
+        int superShift = 0;
+        for (int shift = 1; shift <= 10; ++shift) {
+            const size_t padded = roundUp(brickCount[0], size_t(1) << shift) * roundUp(brickCount[1], size_t(1) << shift) *
+                                  roundUp(brickCount[2], size_t(1) << shift);
+            if (padded * 5 <= numBricks * 6)
+                superShift = shift;
+        }
+        const size_t superSize = size_t(1) << superShift;
+        size_t superCount[3], superStride[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            superCount[axis] = roundUp(brickCount[axis], superSize) >> superShift;
+            superStride[axis] = axis == 0 ? 1 : superStride[axis - 1] * superCount[axis - 1];
+        }
+
+        std::vector<size_t>* tables[3] = {&_indexX, &_indexY, &_indexZ};
+        for (int axis = 0; axis < 3; ++axis) {
+            tables[axis]->resize(volumeSize[axis]);
+            for (int c = 0; c < volumeSize[axis]; ++c) {
+                const uint32_t brick = uint32_t(c) >> BrickShift;
+                const size_t brickIndex = ((brick >> superShift) * superStride[axis] << (3 * superShift)) |
+                                          (size_t(spreadBits(brick & (superSize - 1))) << axis);
+                (*tables[axis])[c] = (brickIndex << (3 * BrickShift)) | (size_t(c & (BrickSize - 1)) << (axis * BrickShift));
+            }
+        }
+        numVoxels = (superCount[0] * superCount[1] * superCount[2]) << (3 * superShift + 3 * BrickShift);
+    }
+
+    if (layout == VolumeLayout::Hashed) {
+        // only the empty brick in slot 0 exists, the bricks are allocated by allocateBrick
+        numVoxels = size_t(1) << (3 * BrickShift);
+        _indexX.resize(volumeSize.x());
+        for (int x = 0; x < volumeSize.x(); ++x)
+            _indexX[x] = size_t(x & (BrickSize - 1));
+        _brickKeys.assign(1024, 0);
+        _brickSlots.assign(1024, 0);
+        _brickHashShift = 64 - 10;
+    } else {
+        _brickOrder.reserve(brickCount[0] * brickCount[1] * brickCount[2]);
+        for (int z = 0; z < int(brickCount[2]); ++z)
+            for (int y = 0; y < int(brickCount[1]); ++y)
+                for (int x = 0; x < int(brickCount[0]); ++x)
+                    _brickOrder.emplace_back(x << BrickShift, y << BrickShift, z << BrickShift);
+    }
+    if (layout == VolumeLayout::Bricked) {
+        // neighbouring bricks in all three directions end up close to each other in memory
+        std::sort(_brickOrder.begin(), _brickOrder.end(), [this](const Eigen::Vector3i& a, const Eigen::Vector3i& b) {
+            return getVoxelIndex(a.x(), a.y(), a.z()) < getVoxelIndex(b.x(), b.y(), b.z());
+        });
+    }
+
+    resizeVoxelData(numVoxels);
 
     Eigen::Vector3d half_voxelSize(voxelScale/2, voxelScale/2, voxelScale/2);
     bounds[0] = _origin + half_voxelSize;
     bounds[1] = _maxPoint - half_voxelSize;
 }
 
+Volume::~Volume() = default;
+
 bool Volume::intersects(const Ray &r, float& entry_distance) const{
 
     float tmin, tmax, tymin, tymax, tzmin, tzmax;
@@ -70,10 +170,825 @@ const Eigen::Vector3d& Volume::getOrigin() const{
 }
 
 
-std::vector<Voxel>& Volume::getVoxelData()  {
+VolumeStorage Volume::getStorage() const {
+    return _storage;
+}
+
+VolumeLayout Volume::getLayout() const {
+    return _layout;
+}
+
+const std::vector<size_t>& Volume::getIndexX() const {
+    return _indexX;
+}
+
+const std::vector<size_t>& Volume::getIndexY() const {
+    return _indexY;
+}
+
+const std::vector<size_t>& Volume::getIndexZ() const {
+    return _indexZ;
+}
+
+const std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>>& Volume::getBrickOrder() const {
+    return _brickOrder;
+}
+
+const std::vector<uint8_t>& Volume::getBrickLevels() const {
+    return _brickLevels;
+}
+
+int Volume::getMaxLevel() const {
+    return _maxLevel;
+}
+
+double Volume::getLevelDistance() const {
+    return _levelDistance;
+}
+
+int Volume::getLevelForDepth(double depth) const {
+    int level = 0;
+    while (level < _maxLevel && depth >= _levelDistance * (1 << level))
+        level++;
+    return level;
+}
+
+bool Volume::allocateBrick(int x, int y, int z, int level) {
+    if (_layout != VolumeLayout::Hashed)
+        return false;
+    const Eigen::Vector3i brick(x >> (BrickShift + level), y >> (BrickShift + level), z >> (BrickShift + level));
+    const uint64_t key = brickKey(level, brick.x(), brick.y(), brick.z());
+    const uint32_t existing = findBrick(level, brick.x(), brick.y(), brick.z());
+    if (existing != 0) {
+        if (_brickStore) {
+            _brickLastUse[existing - 1] = _pagingPeriod;
+            _brickModified[existing - 1] = 1;
+            _pagingStats.hits++;
+        }
+        return false;
+    }
+
+    const uint32_t slot = allocateSlot(key, brick * (BrickSize << level), level);
+    if (_brickStore && _brickStore->contains(key)) {
+        std::vector<char> data(getBrickBytes());
+        if (_brickStore->read(key, data.data())) {
+            writeBrick(slot, data.data());
+            _pagingStats.loads++;
+            return true;
+        }
+    }
+
+    // the brick lies inside a single brick of every coarser level, the finest of them holds the best estimate
+    const Eigen::Vector3i& first = _brickOrder.back();
+    for (int coarseLevel = level + 1; coarseLevel <= _maxLevel; ++coarseLevel) {
+        const size_t coarseIdx = getBrickIndex(first.x(), first.y(), first.z(), coarseLevel);
+        if (coarseIdx == 0)
+            continue;
+        const size_t brickIdx = size_t(slot) << (3 * BrickShift);
+        const int step = 1 << level;
+        for (int k = 0; k < BrickSize; ++k)
+            for (int j = 0; j < BrickSize; ++j)
+                for (int i = 0; i < BrickSize; ++i) {
+                    // the voxel at the center of the sample
+                    const int vx = first.x() + i * step + step / 2;
+                    const int vy = first.y() + j * step + step / 2;
+                    const int vz = first.z() + k * step + step / 2;
+                    const size_t nearest = coarseIdx | ((size_t(vz >> coarseLevel) & (BrickSize - 1)) << (2 * BrickShift)) |
+                                           ((size_t(vy >> coarseLevel) & (BrickSize - 1)) << BrickShift) |
+                                           (size_t(vx >> coarseLevel) & (BrickSize - 1));
+                    const double tsdf = interpolateTSDF(vx, vy, vz, coarseLevel) / step;
+                    setVoxel(brickIdx + i + (j << BrickShift) + (k << (2 * BrickShift)),
+                             std::max(-1., std::min(1., tsdf)), getWeight(nearest), getColor(nearest));
+                }
+        break;
+    }
+    return true;
+}
+
+uint32_t Volume::allocateSlot(uint64_t key, const Eigen::Vector3i& first, int level) {
+    const uint32_t slot = uint32_t(_brickOrder.size() + 1);
+    // the table is kept at most half full, which keeps the probe sequences short
+    if (2 * size_t(slot) > _brickKeys.size()) {
+        std::vector<uint64_t> keys(2 * _brickKeys.size(), 0);
+        std::vector<uint32_t> slots(2 * _brickSlots.size(), 0);
+        keys.swap(_brickKeys);
+        slots.swap(_brickSlots);
+        _brickHashShift--;
+        for (size_t i = 0; i < keys.size(); ++i)
+            if (keys[i] != 0)
+                insertBrick(keys[i], slots[i]);
+    }
+    insertBrick(key, slot);
+    _brickOrder.push_back(first);
+    _brickLevels.push_back(uint8_t(level));
+    resizeVoxelData(size_t(slot + 1) << (3 * BrickShift));
+    if (_brickStore) {
+        _brickLastUse.push_back(_pagingPeriod);
+        _brickModified.push_back(1);
+    }
+    return slot;
+}
+
+bool Volume::enablePaging(const std::string& path, size_t memoryBudget) {
+    if (_layout != VolumeLayout::Hashed)
+        return false;
+    // a quarter of the budget may wait for the writer thread
+    std::unique_ptr<BrickStore> store(new BrickStore(path, getBrickBytes(), memoryBudget / 4));
+    if (!store->isOpen())
+        return false;
+    _brickStore = std::move(store);
+    _swapCells.clear();
+    _pagingBudget = memoryBudget;
+    _brickLastUse.assign(_brickOrder.size(), _pagingPeriod);
+    _brickModified.assign(_brickOrder.size(), 1);
+    return true;
+}
+
+bool Volume::isPaged() const {
+    return _brickStore != nullptr;
+}
+
+void Volume::setSpecializedAccess(bool enabled) {
+    _specializedAccess = enabled;
+}
+
+bool Volume::hasSpecializedAccess() const {
+    return _specializedAccess;
+}
+
+bool Volume::enableBrickSummary() {
+    if (_maxLevel > 0)
+        return false;
+    if (!_brickSummary) {
+        _brickSummary.reset(new BrickSummary(_volumeSize));
+        _brickSummary->rebuild(*this);
+    }
+    return true;
+}
+
+BrickSummary* Volume::getBrickSummary() {
+    return _brickSummary.get();
+}
+
+const BrickSummary* Volume::getBrickSummary() const {
+    return _brickSummary.get();
+}
+
+void Volume::updateBrickSummary() {
+    if (_brickSummary)
+        _brickSummary->rebuild(*this);
+}
+
+bool Volume::enableColorVolume(int downsampling) {
+    // up to BrickSize the shift of a rolling volume by whole bricks is a whole number of color voxels
+    if (downsampling < 2 || downsampling > BrickSize || (downsampling & (downsampling - 1)) != 0)
+        return false;
+    _colorVolume = std::make_shared<ColorVolume>(_origin, _volumeSize, _voxelScale, downsampling);
+    // the records of the swap file of a paged volume include the plane
+    if (_storage == VolumeStorage::Planar && _hasColor && !_brickStore) {
+        _hasColor = false;
+        VoxelArray<uint32_t>().swap(_colorPlane);
+    }
+    return true;
+}
+
+void Volume::setColorVolume(std::shared_ptr<ColorVolume> colors) {
+    _colorVolume = std::move(colors);
+}
+
+const std::shared_ptr<ColorVolume>& Volume::getColorVolume() const {
+    return _colorVolume;
+}
+
+void Volume::pageIn(const ViewFrustum& frustum) {
+    if (!_brickStore)
+        return;
+    if (!frustum.intersectsVolume())
+        return;
+    pageInBricks(frustum.getMinVoxel(), frustum.getMaxVoxel(), [&frustum](const Eigen::Vector3i& first, int level) {
+        return frustum.intersectsBox(first, first + Eigen::Vector3i::Constant(BrickSize << level));
+    });
+}
+
+void Volume::pageIn(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) {
+    if (!_brickStore)
+        return;
+    pageInBricks(minVoxel, maxVoxel, [&minVoxel, &maxVoxel](const Eigen::Vector3i& first, int level) {
+        return (first.array() < maxVoxel.array()).all() &&
+               ((first + Eigen::Vector3i::Constant(BrickSize << level)).array() > minVoxel.array()).all();
+    });
+}
+
+template<typename Predicate>
+void Volume::pageInBricks(const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel, Predicate overlaps) {
+    for (size_t i = 0; i < _brickOrder.size(); ++i) {
+        if (overlaps(_brickOrder[i], int(_brickLevels[i]))) {
+            _brickLastUse[i] = _pagingPeriod;
+            _pagingStats.hits++;
+        }
+    }
+    if (_swapCells.empty())
+        return;
+
+    // a brick of the coarsest level starting up to its size before minVoxel still overlaps
+    const int cellSize = 1 << SwapCellShift;
+    const Eigen::Vector3i minCell = ((minVoxel.array() - (BrickSize << _maxLevel) + 1).max(0) / cellSize).matrix();
+    const Eigen::Vector3i maxCell = ((maxVoxel.cwiseMin(_volumeSize).array() - 1).max(0) / cellSize).matrix();
+    std::vector<char> data(getBrickBytes());
+    for (int cz = minCell.z(); cz <= maxCell.z(); ++cz) {
+        for (int cy = minCell.y(); cy <= maxCell.y(); ++cy) {
+            for (int cx = minCell.x(); cx <= maxCell.x(); ++cx) {
+                const auto cell = _swapCells.find(brickKey(0, cx, cy, cz));
+                if (cell == _swapCells.end())
+                    continue;
+                for (const uint64_t key : cell->second) {
+                    const uint64_t bits = key - 1;
+                    const int level = int(bits >> 60);
+                    const Eigen::Vector3i brick(int(bits & 0xfffff), int((bits >> 20) & 0xfffff),
+                                                int((bits >> 40) & 0xfffff));
+                    const Eigen::Vector3i first = brick * (BrickSize << level);
+                    if (findBrick(level, brick.x(), brick.y(), brick.z()) != 0 || !overlaps(first, level))
+                        continue;
+                    if (!_brickStore->read(key, data.data()))
+                        continue;
+                    const uint32_t slot = allocateSlot(key, first, level);
+                    writeBrick(slot, data.data());
+                    _brickModified[slot - 1] = 0;
+                    _pagingStats.loads++;
+                }
+            }
+        }
+    }
+}
+
+void Volume::evictBricks() {
+    if (!_brickStore)
+        return;
+    const size_t brickBytes = getBrickBytes();
+    const size_t maxBricks = _pagingBudget / brickBytes;
+    if (_brickOrder.size() > maxBricks) {
+        std::vector<uint32_t> candidates;
+        for (uint32_t slot = 1; slot <= _brickOrder.size(); ++slot)
+            if (_brickLastUse[slot - 1] < _pagingPeriod)
+                candidates.push_back(slot);
+        const size_t count = std::min(candidates.size(), _brickOrder.size() - maxBricks);
+        std::nth_element(candidates.begin(), candidates.begin() + count, candidates.end(),
+                         [this](uint32_t a, uint32_t b) { return _brickLastUse[a - 1] < _brickLastUse[b - 1]; });
+        candidates.resize(count);
+
+        // in descending order the last slot, which moves into an evicted one, is never evicted later
+        std::sort(candidates.begin(), candidates.end(), std::greater<uint32_t>());
+        const size_t oldSize = (_brickOrder.size() + 1) << (3 * BrickShift);
+        std::vector<char> data(brickBytes);
+        for (uint32_t slot : candidates)
+            evictBrick(slot, data.data());
+
+        // the freed bricks go back to the system and read as unobserved when they are allocated again
+        const size_t newSize = (_brickOrder.size() + 1) << (3 * BrickShift);
+        mappedDiscard(_voxelData.data() + std::min(newSize, _voxelData.size()),
+                      (std::min(oldSize, _voxelData.size()) - std::min(newSize, _voxelData.size())) * sizeof(Voxel));
+        mappedDiscard(_fixedPointVoxelData.data() + std::min(newSize, _fixedPointVoxelData.size()),
+                      (std::min(oldSize, _fixedPointVoxelData.size()) - std::min(newSize, _fixedPointVoxelData.size())) *
+                      sizeof(FixedPointVoxel));
+        mappedDiscard(_tsdfPlane.data() + std::min(newSize, _tsdfPlane.size()),
+                      (std::min(oldSize, _tsdfPlane.size()) - std::min(newSize, _tsdfPlane.size())) * sizeof(int16_t));
+        mappedDiscard(_weightPlane.data() + std::min(newSize, _weightPlane.size()),
+                      (std::min(oldSize, _weightPlane.size()) - std::min(newSize, _weightPlane.size())) * sizeof(uint16_t));
+        mappedDiscard(_colorPlane.data() + std::min(newSize, _colorPlane.size()),
+                      (std::min(oldSize, _colorPlane.size()) - std::min(newSize, _colorPlane.size())) * sizeof(uint32_t));
+        resizeVoxelData(newSize);
+    }
+    _pagingPeriod++;
+    _pagingStats.stallSeconds = _brickStore->getStallSeconds();
+}
+
+void Volume::evictBrick(uint32_t slot, char* data) {
+    const uint32_t last = uint32_t(_brickOrder.size());
+    const uint64_t key = slotKey(slot);
+    if (_brickModified[slot - 1]) {
+        if (!_brickStore->contains(key)) {
+            const Eigen::Vector3i cell = _brickOrder[slot - 1] / (1 << SwapCellShift);
+            _swapCells[brickKey(0, cell.x(), cell.y(), cell.z())].push_back(key);
+        }
+        readBrick(slot, data);
+        _brickStore->write(key, data);
+        _pagingStats.writes++;
+    }
+    _pagingStats.evictions++;
+    eraseBrick(key);
+
+    if (slot != last) {
+        readBrick(last, data);
+        writeBrick(slot, data);
+        const uint64_t lastKey = slotKey(last);
+        size_t i = hashBrick(lastKey);
+        while (_brickKeys[i] != lastKey)
+            i = (i + 1) & (_brickKeys.size() - 1);
+        _brickSlots[i] = slot;
+        _brickOrder[slot - 1] = _brickOrder[last - 1];
+        _brickLevels[slot - 1] = _brickLevels[last - 1];
+        _brickLastUse[slot - 1] = _brickLastUse[last - 1];
+        _brickModified[slot - 1] = _brickModified[last - 1];
+    }
+    _brickOrder.pop_back();
+    _brickLevels.pop_back();
+    _brickLastUse.pop_back();
+    _brickModified.pop_back();
+}
+
+std::vector<std::pair<Eigen::Vector3i, int>, Eigen::aligned_allocator<std::pair<Eigen::Vector3i, int>>>
+Volume::getPagedBricks() const {
+    std::vector<std::pair<Eigen::Vector3i, int>, Eigen::aligned_allocator<std::pair<Eigen::Vector3i, int>>> bricks;
+    for (size_t i = 0; i < _brickOrder.size(); ++i)
+        bricks.emplace_back(_brickOrder[i], int(_brickLevels[i]));
+    if (!_brickStore)
+        return bricks;
+    for (const auto& record : _brickStore->getRecords()) {
+        const uint64_t bits = record.first - 1;
+        const int level = int(bits >> 60);
+        const Eigen::Vector3i brick(int(bits & 0xfffff), int((bits >> 20) & 0xfffff), int((bits >> 40) & 0xfffff));
+        if (findBrick(level, brick.x(), brick.y(), brick.z()) == 0)
+            bricks.emplace_back(brick * (BrickSize << level), level);
+    }
+    return bricks;
+}
+
+const Volume::PagingStats& Volume::getPagingStats() {
+    if (_brickStore)
+        _pagingStats.stallSeconds = _brickStore->getStallSeconds();
+    return _pagingStats;
+}
+
+bool Volume::enableRolling() {
+    // a shift moves the voxels of every z across the slabs, which are placed on fixed nodes
+    if (_layout == VolumeLayout::Hashed || _volumeSize.x() % BrickSize || _volumeSize.y() % BrickSize ||
+        _volumeSize.z() % BrickSize || !_slabPlacement.empty())
+        return false;
+    if (_rolling)
+        return true;
+    if (_layout == VolumeLayout::Linear) {
+        _indexX.resize(_volumeSize.x());
+        _indexY.resize(_volumeSize.y());
+        _indexZ.resize(_volumeSize.z());
+        for (int x = 0; x < _volumeSize.x(); ++x)
+            _indexX[x] = size_t(x);
+        for (int y = 0; y < _volumeSize.y(); ++y)
+            _indexY[y] = y * size_t(_volumeSize.x());
+        for (int z = 0; z < _volumeSize.z(); ++z)
+            _indexZ[z] = z * size_t(_volumeSize.x()) * _volumeSize.y();
+    }
+    _unshiftedIndex[0] = _indexX;
+    _unshiftedIndex[1] = _indexY;
+    _unshiftedIndex[2] = _indexZ;
+    _rolling = true;
+    return true;
+}
+
+bool Volume::isRolling() const {
+    return _rolling;
+}
+
+void Volume::setSlabCallback(SlabCallback callback) {
+    _slabCallback = std::move(callback);
+}
+
+void Volume::shift(const Eigen::Vector3i& bricks) {
+    if (!_rolling || bricks.isZero())
+        return;
+    const Eigen::Vector3i voxels = bricks * BrickSize;
+
+    // the slabs leaving along x, then along y without the x slab, then along z without both, so that every voxel is
+    // reported and cleared once
+    Eigen::Vector3i remainingMin = Eigen::Vector3i::Zero();
+    Eigen::Vector3i remainingMax = _volumeSize;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (voxels[axis] == 0)
+            continue;
+        Eigen::Vector3i slabMin = remainingMin, slabMax = remainingMax;
+        if (voxels[axis] > 0)
+            slabMax[axis] = std::min(_volumeSize[axis], voxels[axis]);
+        else
+            slabMin[axis] = std::max(0, _volumeSize[axis] + voxels[axis]);
+        if ((slabMin.array() >= slabMax.array()).any())
+            continue;
+
+        if (_slabCallback)
+            _slabCallback(*this, slabMin, slabMax);
+        // runs of BrickSize voxels starting at a multiple of BrickSize are contiguous in both layouts
+        for (int z = slabMin.z(); z < slabMax.z(); ++z)
+            for (int y = slabMin.y(); y < slabMax.y(); ++y)
+                for (int x = slabMin.x(); x < slabMax.x(); x += BrickSize)
+                    clearVoxels(_indexX[x] + _indexY[y] + _indexZ[z], BrickSize);
+
+        if (voxels[axis] > 0)
+            remainingMin[axis] = slabMax[axis];
+        else
+            remainingMax[axis] = slabMin[axis];
+    }
+
+    // the voxel x of the new window is the voxel x + shift of the old one
+    _gridOffset += voxels;
+    std::vector<size_t>* tables[3] = {&_indexX, &_indexY, &_indexZ};
+    for (int axis = 0; axis < 3; ++axis) {
+        const int size = _volumeSize[axis];
+        const int offset = ((_gridOffset[axis] % size) + size) % size;
+        for (int c = 0; c < size; ++c)
+            (*tables[axis])[c] = _unshiftedIndex[axis][(c + offset) % size];
+    }
+    const Eigen::Vector3d translation = voxels.cast<double>() * _voxelScale;
+    _origin += translation;
+    _maxPoint += translation;
+    bounds[0] += translation;
+    bounds[1] += translation;
+
+    if (_layout == VolumeLayout::Bricked) {
+        std::sort(_brickOrder.begin(), _brickOrder.end(), [this](const Eigen::Vector3i& a, const Eigen::Vector3i& b) {
+            return getVoxelIndex(a.x(), a.y(), a.z()) < getVoxelIndex(b.x(), b.y(), b.z());
+        });
+    }
+    if (_brickSummary)
+        _brickSummary->shift(bricks);
+    if (_colorVolume)
+        _colorVolume->shift(voxels);
+}
+
+bool Volume::followPoint(const Eigen::Vector3d& point, const Eigen::Vector3d& anchor, double threshold) {
+    const Eigen::Vector3i bricks = getFollowShift(point, anchor, threshold);
+    shift(bricks);
+    return !bricks.isZero();
+}
+
+Eigen::Vector3i Volume::getFollowShift(const Eigen::Vector3d& point, const Eigen::Vector3d& anchor,
+                                       double threshold) const {
+    Eigen::Vector3i bricks = Eigen::Vector3i::Zero();
+    if (!_rolling)
+        return bricks;
+    const Eigen::Vector3d distance = point - anchor - _origin;
+    const double brickLength = BrickSize * _voxelScale;
+    for (int axis = 0; axis < 3; ++axis)
+        if (std::abs(distance[axis]) > threshold)
+            bricks[axis] = int(std::lround(distance[axis] / brickLength));
+    return bricks;
+}
+
+const Eigen::Vector3i& Volume::getGridOffset() const {
+    return _gridOffset;
+}
+
+size_t Volume::getAllocatedBrickCount() const {
+    return _brickOrder.size();
+}
+
+size_t Volume::getMemoryUsage() const {
+    return _voxelData.capacity() * sizeof(Voxel) + _fixedPointVoxelData.capacity() * sizeof(FixedPointVoxel) +
+           _tsdfPlane.capacity() * sizeof(int16_t) + _weightPlane.capacity() * sizeof(uint16_t) +
+           _colorPlane.capacity() * sizeof(uint32_t) +
+           (_indexX.capacity() + _indexY.capacity() + _indexZ.capacity()) * sizeof(size_t) +
+           _brickOrder.capacity() * sizeof(Eigen::Vector3i) + _brickLevels.capacity() +
+           _brickKeys.capacity() * sizeof(uint64_t) + _brickSlots.capacity() * sizeof(uint32_t);
+}
+
+size_t Volume::getResidentMemoryUsage() const {
+    const size_t voxelBytes = _voxelData.capacity() * sizeof(Voxel) +
+                              _fixedPointVoxelData.capacity() * sizeof(FixedPointVoxel) +
+                              _tsdfPlane.capacity() * sizeof(int16_t) + _weightPlane.capacity() * sizeof(uint16_t) +
+                              _colorPlane.capacity() * sizeof(uint32_t);
+    return getMemoryUsage() - voxelBytes +
+           residentBytes(_voxelData.data(), _voxelData.capacity() * sizeof(Voxel)) +
+           residentBytes(_fixedPointVoxelData.data(), _fixedPointVoxelData.capacity() * sizeof(FixedPointVoxel)) +
+           residentBytes(_tsdfPlane.data(), _tsdfPlane.capacity() * sizeof(int16_t)) +
+           residentBytes(_weightPlane.data(), _weightPlane.capacity() * sizeof(uint16_t)) +
+           residentBytes(_colorPlane.data(), _colorPlane.capacity() * sizeof(uint32_t));
+}
+
+bool Volume::placeSlabs(const std::vector<NumaNode>& nodes) {
+    if (_layout != VolumeLayout::Linear || _rolling || nodes.size() < 2)
+        return false;
+    size_t totalCpus = 0;
+    for (const NumaNode& node : nodes)
+        totalCpus += node.cpus.size();
+
+    _slabPlacement.clear();
+    const size_t sliceVoxels = size_t(_volumeSize.x()) * _volumeSize.y();
+    const std::vector<std::pair<char*, size_t>> arrays = getVoxelArrays();
+    std::vector<std::thread> touchers;
+    size_t cpus = 0;
+    for (const NumaNode& node : nodes) {
+        const int zBegin = int(cpus * _volumeSize.z() / totalCpus);
+        cpus += node.cpus.size();
+        const int zEnd = int(cpus * _volumeSize.z() / totalCpus);
+        if (zBegin == zEnd)
+            continue;
+        _slabPlacement.push_back({zBegin, zEnd, node});
+
+        bool preferred = true;
+        for (const auto& array : arrays)
+            preferred &= preferNode(array.first + zBegin * sliceVoxels * array.second,
+                                    (zEnd - zBegin) * sliceVoxels * array.second, node.id);
+        if (preferred)
+            continue;
+        // without a memory policy the page lands on the node of the thread which writes it first
+        touchers.emplace_back([&arrays, &node, zBegin, zEnd, sliceVoxels]() {
+            pinCurrentThread(node.cpus);
+            const size_t pageSize = 4096;
+            for (const auto& array : arrays) {
+                volatile char* begin = array.first + zBegin * sliceVoxels * array.second;
+                volatile char* end = array.first + zEnd * sliceVoxels * array.second;
+                for (volatile char* page = begin; page < end; page += pageSize)
+                    *page = 0;
+            }
+        });
+    }
+    for (std::thread& toucher : touchers)
+        toucher.join();
+    return true;
+}
+
+const std::vector<Volume::SlabPlacement>& Volume::getSlabPlacement() const {
+    return _slabPlacement;
+}
+
+bool Volume::enableHugePages() {
+    _hugePages = true;
+    return adviseHugePages();
+}
+
+std::vector<std::pair<int, size_t>> Volume::getResidentBytesPerNode() const {
+    // every 16th page is enough to tell the placement of whole slabs
+    const size_t stride = 16;
+    std::vector<std::pair<int, size_t>> bytesPerNode;
+    addBytesPerNode(_voxelData.data(), _voxelData.size() * sizeof(Voxel), stride, bytesPerNode);
+    addBytesPerNode(_fixedPointVoxelData.data(), _fixedPointVoxelData.size() * sizeof(FixedPointVoxel), stride,
+                    bytesPerNode);
+    addBytesPerNode(_tsdfPlane.data(), _tsdfPlane.size() * sizeof(int16_t), stride, bytesPerNode);
+    addBytesPerNode(_weightPlane.data(), _weightPlane.size() * sizeof(uint16_t), stride, bytesPerNode);
+    addBytesPerNode(_colorPlane.data(), _colorPlane.size() * sizeof(uint32_t), stride, bytesPerNode);
+    std::sort(bytesPerNode.begin(), bytesPerNode.end());
+    return bytesPerNode;
+}
+
+void Volume::insertBrick(uint64_t key, uint32_t slot) {
+    size_t i = hashBrick(key);
+    while (_brickKeys[i] != 0)
+        i = (i + 1) & (_brickKeys.size() - 1);
+    _brickKeys[i] = key;
+    _brickSlots[i] = slot;
+}
+
+void Volume::eraseBrick(uint64_t key) {
+    const size_t mask = _brickKeys.size() - 1;
+    size_t hole = hashBrick(key);
+    while (_brickKeys[hole] != key)
+        hole = (hole + 1) & mask;
+    for (size_t i = (hole + 1) & mask; _brickKeys[i] != 0; i = (i + 1) & mask) {
+        // an entry can fill the hole if the hole lies between its hash position and its current position
+        if (((i - hashBrick(_brickKeys[i])) & mask) >= ((i - hole) & mask)) {
+            _brickKeys[hole] = _brickKeys[i];
+            _brickSlots[hole] = _brickSlots[i];
+            hole = i;
+        }
+    }
+    _brickKeys[hole] = 0;
+    _brickSlots[hole] = 0;
+}
+
+uint64_t Volume::slotKey(uint32_t slot) const {
+    const int level = _brickLevels[slot - 1];
+    const Eigen::Vector3i& first = _brickOrder[slot - 1];
+    return brickKey(level, first.x() >> (BrickShift + level), first.y() >> (BrickShift + level),
+                    first.z() >> (BrickShift + level));
+}
+
+size_t Volume::getBrickBytes() const {
+    const size_t voxels = size_t(1) << (3 * BrickShift);
+    switch (_storage) {
+        case VolumeStorage::FixedPoint: return voxels * sizeof(FixedPointVoxel);
+        case VolumeStorage::Planar: return voxels * (sizeof(int16_t) + sizeof(uint16_t) + (_hasColor ? sizeof(uint32_t) : 0));
+        default: return voxels * sizeof(Voxel);
+    }
+}
+
+void Volume::readBrick(uint32_t slot, char* data) const {
+    const size_t voxels = size_t(1) << (3 * BrickShift);
+    const size_t first = size_t(slot) << (3 * BrickShift);
+    switch (_storage) {
+        case VolumeStorage::FixedPoint:
+            std::memcpy(data, &_fixedPointVoxelData[first], voxels * sizeof(FixedPointVoxel));
+            break;
+        case VolumeStorage::Planar:
+            std::memcpy(data, &_tsdfPlane[first], voxels * sizeof(int16_t));
+            std::memcpy(data + voxels * sizeof(int16_t), &_weightPlane[first], voxels * sizeof(uint16_t));
+            if (_hasColor)
+                std::memcpy(data + voxels * (sizeof(int16_t) + sizeof(uint16_t)), &_colorPlane[first],
+                            voxels * sizeof(uint32_t));
+            break;
+        default:
+            std::memcpy(data, &_voxelData[first], voxels * sizeof(Voxel));
+    }
+}
+
+void Volume::writeBrick(uint32_t slot, const char* data) {
+    const size_t voxels = size_t(1) << (3 * BrickShift);
+    const size_t first = size_t(slot) << (3 * BrickShift);
+    switch (_storage) {
+        case VolumeStorage::FixedPoint:
+            std::memcpy(&_fixedPointVoxelData[first], data, voxels * sizeof(FixedPointVoxel));
+            break;
+        case VolumeStorage::Planar:
+            std::memcpy(&_tsdfPlane[first], data, voxels * sizeof(int16_t));
+            std::memcpy(&_weightPlane[first], data + voxels * sizeof(int16_t), voxels * sizeof(uint16_t));
+            if (_hasColor)
+                std::memcpy(&_colorPlane[first], data + voxels * (sizeof(int16_t) + sizeof(uint16_t)),
+                            voxels * sizeof(uint32_t));
+            break;
+        default:
+            std::memcpy(static_cast<void*>(&_voxelData[first]), data, voxels * sizeof(Voxel));
+    }
+}
+
+bool Volume::adviseHugePages() {
+    return mappedAdviseHugePages(_voxelData.data(), _voxelData.capacity() * sizeof(Voxel)) |
+           mappedAdviseHugePages(_fixedPointVoxelData.data(), _fixedPointVoxelData.capacity() * sizeof(FixedPointVoxel)) |
+           mappedAdviseHugePages(_tsdfPlane.data(), _tsdfPlane.capacity() * sizeof(int16_t)) |
+           mappedAdviseHugePages(_weightPlane.data(), _weightPlane.capacity() * sizeof(uint16_t)) |
+           mappedAdviseHugePages(_colorPlane.data(), _colorPlane.capacity() * sizeof(uint32_t));
+}
+
+std::vector<std::pair<char*, size_t>> Volume::getVoxelArrays() {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint:
+            return {{reinterpret_cast<char*>(_fixedPointVoxelData.data()), sizeof(FixedPointVoxel)}};
+        case VolumeStorage::Planar: {
+            std::vector<std::pair<char*, size_t>> planes = {
+                    {reinterpret_cast<char*>(_tsdfPlane.data()), sizeof(int16_t)},
+                    {reinterpret_cast<char*>(_weightPlane.data()), sizeof(uint16_t)}};
+            if (_hasColor)
+                planes.emplace_back(reinterpret_cast<char*>(_colorPlane.data()), sizeof(uint32_t));
+            return planes;
+        }
+        default:
+            return {{reinterpret_cast<char*>(_voxelData.data()), sizeof(Voxel)}};
+    }
+}
+
+void Volume::resizeVoxelData(size_t numVoxels) {
+    // a grown array is a new mapping, which needs the huge page advice again
+    const size_t capacity = _voxelData.capacity() + _fixedPointVoxelData.capacity() + _tsdfPlane.capacity();
+    // value-initialized elements are not written, the zero pages of the allocator already hold unobserved voxels
+    if (_storage == VolumeStorage::FixedPoint) {
+        _fixedPointVoxelData.resize(numVoxels);
+    } else if (_storage == VolumeStorage::Planar) {
+        _tsdfPlane.resize(numVoxels);
+        _weightPlane.resize(numVoxels);
+        if (_hasColor)
+            _colorPlane.resize(numVoxels);
+    } else {
+        _voxelData.resize(numVoxels);
+    }
+    if (_hugePages && _voxelData.capacity() + _fixedPointVoxelData.capacity() + _tsdfPlane.capacity() != capacity)
+        adviseHugePages();
+}
+
+void Volume::setVoxel(size_t voxelIdx, double tsdf, double weight, const Vector4uc& color) {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint: {
+            FixedPointVoxel& voxel = _fixedPointVoxelData[voxelIdx];
+            voxel.tsdf = int16_t(std::lround(tsdf * FixedPointVoxel::TSDFScale));
+            voxel.weight = uint16_t(std::min<double>(weight, FixedPointVoxel::MaxWeight));
+            voxel.setColor(color);
+            break;
+        }
+        case VolumeStorage::Planar:
+            _tsdfPlane[voxelIdx] = int16_t(std::lround(tsdf * FixedPointVoxel::TSDFScale));
+            _weightPlane[voxelIdx] = uint16_t(std::min<double>(weight, FixedPointVoxel::MaxWeight));
+            if (_hasColor)
+                _colorPlane[voxelIdx] = uint32_t(color[0]) | (uint32_t(color[1]) << 8) | (uint32_t(color[2]) << 16);
+            break;
+        default:
+            _voxelData[voxelIdx].tsdf = tsdf;
+            _voxelData[voxelIdx].weight = weight;
+            _voxelData[voxelIdx].color = color;
+    }
+}
+
+void Volume::clearVoxels(size_t voxelIdx, size_t count) {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint:
+            std::fill_n(&_fixedPointVoxelData[voxelIdx], count, FixedPointVoxel());
+            break;
+        case VolumeStorage::Planar:
+            std::fill_n(&_tsdfPlane[voxelIdx], count, int16_t(0));
+            std::fill_n(&_weightPlane[voxelIdx], count, uint16_t(0));
+            if (_hasColor)
+                std::fill_n(&_colorPlane[voxelIdx], count, uint32_t(0));
+            break;
+        default:
+            std::fill_n(&_voxelData[voxelIdx], count, Voxel());
+    }
+}
+
+double Volume::readTSDF(int x, int y, int z) const {
+    const int level = _maxLevel > 0 ? getVoxelLevel(x, y, z) : 0;
+    if (level <= 0)
+        return getTSDF(getVoxelIndex(x, y, z));
+    return std::max(-1., std::min(1., interpolateTSDF(x, y, z, level)));
+}
+
+double Volume::interpolateTSDF(int x, int y, int z, int level) const {
+    // sample i of the level covers the voxels [i, i+1) * 2^level, its value belongs to the center of that range
+    const double step = 1 << level;
+    const Eigen::Vector3d position = (Eigen::Vector3d(x, y, z) + Eigen::Vector3d::Constant(0.5)) / step -
+                                     Eigen::Vector3d::Constant(0.5);
+    const Eigen::Vector3d lower = position.array().floor();
+    const Eigen::Vector3d t = position - lower;
+
+    double tsdf = 0., weightSum = 0.;
+    for (int corner = 0; corner < 8; ++corner) {
+        const Eigen::Vector3i sample = lower.cast<int>() + Eigen::Vector3i(corner & 1, (corner >> 1) & 1, corner >> 2);
+        if ((sample.array() < 0).any())
+            continue;
+        const size_t slot = findBrick(level, sample.x() >> BrickShift, sample.y() >> BrickShift, sample.z() >> BrickShift);
+        if (slot == 0)
+            continue;
+        const size_t sampleIdx = (slot << (3 * BrickShift)) | (size_t(sample.z() & (BrickSize - 1)) << (2 * BrickShift)) |
+                                 (size_t(sample.y() & (BrickSize - 1)) << BrickShift) | size_t(sample.x() & (BrickSize - 1));
+        if (getWeight(sampleIdx) == 0.)
+            continue;
+        const double w = (corner & 1 ? t.x() : 1. - t.x()) * ((corner >> 1) & 1 ? t.y() : 1. - t.y()) *
+                         (corner >> 2 ? t.z() : 1. - t.z());
+        tsdf += w * getTSDF(sampleIdx);
+        weightSum += w;
+    }
+    if (weightSum <= 0.)
+        return getTSDF(getVoxelIndex(x, y, z)) * step;
+    return tsdf / weightSum * step;
+}
+
+VoxelArray<Voxel>& Volume::getVoxelData()  {
     return _voxelData;
 }
 
+VoxelArray<FixedPointVoxel>& Volume::getFixedPointVoxelData() {
+    return _fixedPointVoxelData;
+}
+
+VoxelArray<int16_t>& Volume::getTSDFPlane() {
+    return _tsdfPlane;
+}
+
+VoxelArray<uint16_t>& Volume::getWeightPlane() {
+    return _weightPlane;
+}
+
+VoxelArray<uint32_t>& Volume::getColorPlane() {
+    return _colorPlane;
+}
+
+bool Volume::hasColor() const {
+    return _hasColor;
+}
+
+Voxel Volume::getVoxel( int x, int y, int z){
+    const size_t voxelIdx = getVoxelIndex(x, y, z);
+    if (_storage == VolumeStorage::Double && _maxLevel == 0)
+        return _voxelData[voxelIdx];
+
+    Voxel voxel;
+    voxel.tsdf = _maxLevel > 0 ? readTSDF(x, y, z) : getTSDF(voxelIdx);
+    voxel.weight = getWeight(voxelIdx);
+    voxel.color = getColor(voxelIdx);
+    return voxel;
+}
+
+double Volume::getTSDF(size_t voxelIdx) const {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint: return _fixedPointVoxelData[voxelIdx].getTSDF();
+        case VolumeStorage::Planar: return double(_tsdfPlane[voxelIdx]) / FixedPointVoxel::TSDFScale;
+        default: return _voxelData[voxelIdx].tsdf;
+    }
+}
+
+double Volume::getWeight(size_t voxelIdx) const {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint: return _fixedPointVoxelData[voxelIdx].getWeight();
+        case VolumeStorage::Planar: return _weightPlane[voxelIdx];
+        default: return _voxelData[voxelIdx].weight;
+    }
+}
+
+Vector4uc Volume::getColor(size_t voxelIdx) const {
+    switch (_storage) {
+        case VolumeStorage::FixedPoint: return _fixedPointVoxelData[voxelIdx].getColor();
+        case VolumeStorage::Planar: {
+            if (!_hasColor)
+                return Vector4uc(255, 255, 255, 255);
+            const uint32_t color = _colorPlane[voxelIdx];
+            return Vector4uc(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, _weightPlane[voxelIdx] ? 255 : 0);
+        }
+        default: return _voxelData[voxelIdx].getColor();
+    }
+}
+
 const Eigen::Vector3i &Volume::getVolumeSize() const {
     return _volumeSize;
 }
@@ -98,32 +1013,33 @@ Eigen::Vector3d Volume::getGlobalCoordinate( int voxelIdx_x, int voxelIdx_y, int
     return position + _origin;
 }
 
-double Volume::getTSDF(Eigen::Vector3d global){
+size_t Volume::getVoxelIndex(const Eigen::Vector3d& global) const {
     Eigen::Vector3d shifted = (global - _origin) / _voxelScale;
-    Eigen::Vector3i currentPosition;
-    currentPosition.x() = int(shifted.x());
-    currentPosition.y() = int(shifted.y());
-    currentPosition.z() = int(shifted.z());
+    return getVoxelIndex(int(shifted.x()), int(shifted.y()), int(shifted.z()));
+}
 
-    Voxel voxelData = getVoxelData()[currentPosition.x() + currentPosition.y()*_volumeSize.x()
-                                                               + currentPosition.z()*_volumeSize.x()*_volumeSize.y()];
-    return voxelData.tsdf;
+double Volume::getTSDF(Eigen::Vector3d global){
+    if (_maxLevel > 0) {
+        const Eigen::Vector3d shifted = (global - _origin) / _voxelScale;
+        return readTSDF(int(shifted.x()), int(shifted.y()), int(shifted.z()));
+    }
+    return getTSDF(getVoxelIndex(global));
 }
 
 double Volume::getTSDF( int x, int y, int z){
-    return getVoxelData()[x + y*_volumeSize.x() + z*_volumeSize.x()*_volumeSize.y()].tsdf;
+    return _maxLevel > 0 ? readTSDF(x, y, z) : getTSDF(getVoxelIndex(x, y, z));
+}
+
+double Volume::getWeight( int x, int y, int z){
+    return getWeight(getVoxelIndex(x, y, z));
 }
 
 Vector4uc Volume::getColor(Eigen::Vector3d global){
-    Eigen::Vector3d shifted = (global - _origin) / _voxelScale;
-    Eigen::Vector3i currentPosition;
-    currentPosition.x() = int(shifted.x());
-    currentPosition.y() = int(shifted.y());
-    currentPosition.z() = int(shifted.z());
+    return getColor(getVoxelIndex(global));
+}
 
-    Voxel voxelData = getVoxelData()[currentPosition.x() + currentPosition.y()*_volumeSize.x()
-                                     + currentPosition.z()*_volumeSize.x()*_volumeSize.y()];
-    return voxelData.color;
+Vector4uc Volume::getColor( int x, int y, int z){
+    return getColor(getVoxelIndex(x, y, z));
 }
 
 Eigen::Vector3d Volume::getTSDFGrad(Eigen::Vector3d global){
@@ -135,17 +1051,14 @@ Eigen::Vector3d Volume::getTSDFGrad(Eigen::Vector3d global){
 
     // TODO: double check
 
-    double tsdf_x0 = getVoxelData()[(currentPosition.x()-1) + currentPosition.y()*_volumeSize.x()
-                                                               + currentPosition.z()*_volumeSize.x()*_volumeSize.y()].tsdf;
-    double tsdf_x1 = getVoxelData()[(currentPosition.x()+1) + currentPosition.y()*_volumeSize.x()
-                                                               + currentPosition.z()*_volumeSize.x()*_volumeSize.y()].tsdf;
-    double tsdf_y0 = getVoxelData()[currentPosition.x() + (currentPosition.y()-1)*_volumeSize.x()
-                                                               + currentPosition.z()*_volumeSize.x()*_volumeSize.y()].tsdf;
-    double tsdf_y1 = getVoxelData()[currentPosition.x() + (currentPosition.y()+1)*_volumeSize.x()
-                                                               + currentPosition.z()*_volumeSize.x()*_volumeSize.y()].tsdf;
-    double tsdf_z0 = getVoxelData()[currentPosition.x() + currentPosition.y()*_volumeSize.x()
-                                                               + (currentPosition.z()-1)*_volumeSize.x()*_volumeSize.y()].tsdf;
-    double tsdf_z1 = getVoxelData()[currentPosition.x() + currentPosition.y()*_volumeSize.x()
-                                                               + (currentPosition.z()+1)*_volumeSize.x()*_volumeSize.y()].tsdf;
+    // neighbours outside of the volume are clamped to the border
+    const Eigen::Vector3i lower = (currentPosition - Eigen::Vector3i::Ones()).cwiseMax(0);
+    const Eigen::Vector3i upper = (currentPosition + Eigen::Vector3i::Ones()).cwiseMin(_volumeSize - Eigen::Vector3i::Ones());
+    double tsdf_x0 = readTSDF(lower.x(), currentPosition.y(), currentPosition.z());
+    double tsdf_x1 = readTSDF(upper.x(), currentPosition.y(), currentPosition.z());
+    double tsdf_y0 = readTSDF(currentPosition.x(), lower.y(), currentPosition.z());
+    double tsdf_y1 = readTSDF(currentPosition.x(), upper.y(), currentPosition.z());
+    double tsdf_z0 = readTSDF(currentPosition.x(), currentPosition.y(), lower.z());
+    double tsdf_z1 = readTSDF(currentPosition.x(), currentPosition.y(), upper.z());
     return Eigen::Vector3d(tsdf_x1 - tsdf_x0, tsdf_y1 - tsdf_y0, tsdf_z1 - tsdf_z0) / (_voxelScale*2);
 }
@@ -0,0 +1,234 @@
+#include "VolumeCheckpoint.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include "VolumeSnapshot.hpp"
+
+namespace {
+
+const char Magic[4] = {'K', 'F', 'V', 'L'};
+const uint32_t Version = 2;
+// reads as another value on a machine with a different byte order
+const uint32_t ByteOrderMark = 0x01020304;
+const size_t HeaderBytes = sizeof(Magic) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+const size_t StreamBufferSize = 1 << 20;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value) {
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+//! @return a random generation for a new base snapshot, never 0, which plain snapshots carry
+uint64_t newGeneration() {
+    std::random_device device;
+    const uint64_t generation = ((uint64_t(device()) << 32) | device()) ^
+                                uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+    return generation != 0 ? generation : 1;
+}
+
+/*!
+ * Creates or truncates the log of the base snapshot at path and writes its header, which holds the generation of the
+ * base, so the log of an earlier base is recognized after a compaction.
+ * @return the open log, nullptr on failure
+ */
+std::FILE* startLog(const std::string& path, uint64_t generation) {
+    std::FILE* log = std::fopen(VolumeCheckpoint::getLogPath(path).c_str(), "wb");
+    if (!log)
+        return nullptr;
+    if (std::fwrite(Magic, sizeof(Magic), 1, log) != 1 || std::fwrite(&Version, sizeof(Version), 1, log) != 1 ||
+        std::fwrite(&ByteOrderMark, sizeof(ByteOrderMark), 1, log) != 1 ||
+        std::fwrite(&generation, sizeof(generation), 1, log) != 1 || std::fflush(log) != 0) {
+        std::fclose(log);
+        return nullptr;
+    }
+    return log;
+}
+
+}
+
+std::string VolumeCheckpoint::getLogPath(const std::string& path) {
+    return path + ".log";
+}
+
+VolumeCheckpoint::VolumeCheckpoint(const std::shared_ptr<Volume>& volume, const std::string& path)
+        : m_volume(volume), m_bricks(volume->getVolumeSize()), m_gridOffset(volume->getGridOffset()) {
+    const uint64_t generation = newGeneration();
+    if (VolumeSnapshot::save(*volume, path, generation))
+        m_log = startLog(path, generation);
+    m_writer = std::thread([this]() { writerLoop(); });
+}
+
+VolumeCheckpoint::~VolumeCheckpoint() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_writer.join();
+    if (m_log)
+        std::fclose(m_log);
+}
+
+bool VolumeCheckpoint::isOpen() const {
+    return m_log != nullptr;
+}
+
+void VolumeCheckpoint::markBricks(const DirtyBricks& bricks) {
+    trackShift();
+    m_bricks.merge(bricks);
+}
+
+void VolumeCheckpoint::trackShift() {
+    const Eigen::Vector3i& offset = m_volume->getGridOffset();
+    if (offset == m_gridOffset)
+        return;
+    const Eigen::Vector3i bricks = (offset - m_gridOffset) / Volume::BrickSize;
+    m_shifts.push_back(bricks);
+    m_bricks.shift(bricks);
+    m_gridOffset = offset;
+}
+
+bool VolumeCheckpoint::write() {
+    if (!m_log)
+        return false;
+    trackShift();
+    if (m_bricks.empty() && m_shifts.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return !m_failed;
+    }
+
+    // a delta: its length, the shifts in bricks, then the bricks and color blocks
+    const auto start = std::chrono::steady_clock::now();
+    std::ostringstream out;
+    writeValue(out, uint64_t(0));
+    writeValue(out, uint32_t(m_shifts.size()));
+    for (const Eigen::Vector3i& shift : m_shifts)
+        out.write(reinterpret_cast<const char*>(shift.data()), 3 * sizeof(int));
+    VolumeSnapshot::writeBricks(*m_volume, m_bricks, out);
+    std::string delta = out.str();
+    const uint64_t length = delta.size() - sizeof(uint64_t);
+    std::memcpy(&delta[0], &length, sizeof(length));
+    m_stats.deltas++;
+    m_stats.bricks += m_bricks.count();
+    m_stats.bytes += delta.size();
+    m_bricks.clear();
+    m_shifts.clear();
+    m_stats.copySeconds += secondsSince(start);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_queue.empty()) {
+        const auto stallStart = std::chrono::steady_clock::now();
+        m_condition.wait(lock, [this]() { return m_queue.empty(); });
+        m_stats.stallSeconds += secondsSince(stallStart);
+    }
+    if (m_failed)
+        return false;
+    m_queue.push_back(std::move(delta));
+    lock.unlock();
+    m_condition.notify_all();
+    return true;
+}
+
+void VolumeCheckpoint::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto start = std::chrono::steady_clock::now();
+    m_condition.wait(lock, [this]() { return m_queue.empty() && !m_writing; });
+    m_stats.stallSeconds += secondsSince(start);
+}
+
+const VolumeCheckpoint::Stats& VolumeCheckpoint::getStats() const {
+    return m_stats;
+}
+
+void VolumeCheckpoint::writerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        // the queued deltas are still appended when stopping
+        if (m_queue.empty())
+            return;
+        const std::string delta = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_writing = true;
+        lock.unlock();
+
+        // a crash during the append leaves a delta cut off at the end, which load drops
+        const bool written = m_log && std::fwrite(delta.data(), 1, delta.size(), m_log) == delta.size() &&
+                             std::fflush(m_log) == 0;
+
+        lock.lock();
+        m_failed |= !written;
+        m_writing = false;
+        m_condition.notify_all();
+    }
+}
+
+std::shared_ptr<Volume> VolumeCheckpoint::load(const std::string& path) {
+    uint64_t generation;
+    std::shared_ptr<Volume> volume = VolumeSnapshot::load(path, &generation);
+    if (!volume)
+        return nullptr;
+
+    std::vector<char> buffer(StreamBufferSize);
+    std::ifstream in;
+    in.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    in.open(getLogPath(path), std::ios::binary | std::ios::ate);
+    // a log cut off within its header has no deltas yet
+    if (!in.is_open() || uint64_t(in.tellg()) < HeaderBytes)
+        return volume;
+    const uint64_t logBytes = uint64_t(in.tellg());
+    in.seekg(0);
+
+    char magic[sizeof(Magic)];
+    uint32_t version, byteOrder;
+    uint64_t baseGeneration;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0 ||
+        !readValue(in, version) || version != Version || !readValue(in, byteOrder) || byteOrder != ByteOrderMark ||
+        !readValue(in, baseGeneration))
+        return nullptr;
+    if (baseGeneration != generation)
+        return volume;
+
+    for (uint64_t length; readValue(in, length);) {
+        if (logBytes - uint64_t(in.tellg()) < length)
+            break;
+        uint32_t shifts;
+        if (!readValue(in, shifts))
+            return nullptr;
+        for (uint32_t i = 0; i < shifts; ++i) {
+            Eigen::Vector3i bricks;
+            if (!in.read(reinterpret_cast<char*>(bricks.data()), 3 * sizeof(int)) ||
+                (!volume->isRolling() && !volume->enableRolling()))
+                return nullptr;
+            volume->shift(bricks);
+        }
+        if (!VolumeSnapshot::readBricks(*volume, in))
+            return nullptr;
+    }
+    return volume;
+}
+
+bool VolumeCheckpoint::compact(const std::string& path) {
+    const std::shared_ptr<Volume> volume = load(path);
+    if (!volume)
+        return false;
+    // until the new log is started, the old one belongs to the previous base and is dropped by load
+    const std::string compacted = path + ".compacted";
+    const uint64_t generation = newGeneration();
+    if (!VolumeSnapshot::save(*volume, compacted, generation) || std::rename(compacted.c_str(), path.c_str()) != 0)
+        return false;
+    std::FILE* log = startLog(path, generation);
+    return log && std::fclose(log) == 0;
+}
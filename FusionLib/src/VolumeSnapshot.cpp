@@ -0,0 +1,398 @@
+#include "VolumeSnapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <tuple>
+#include "ColorVolume.hpp"
+
+namespace {
+
+const char Magic[4] = {'K', 'F', 'V', 'S'};
+const uint32_t Version = 2;
+// reads as another value on a machine with a different byte order
+const uint32_t ByteOrderMark = 0x01020304;
+// snapshots are written through a larger buffer than the default of the streams
+const size_t StreamBufferSize = 1 << 20;
+
+template<typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value) {
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+//! bytes of the record of a voxel: tsdf, weight and RGBA for double voxels, the members of FixedPointVoxel otherwise
+size_t recordBytes(const Volume& volume) {
+    switch (volume.getStorage()) {
+        case VolumeStorage::Double: return 2 * sizeof(double) + 4;
+        case VolumeStorage::FixedPoint: return sizeof(FixedPointVoxel);
+        case VolumeStorage::Planar:
+            return sizeof(int16_t) + sizeof(uint16_t) + (volume.hasColor() ? sizeof(uint32_t) : 0);
+    }
+    return 0;
+}
+
+/*!
+ * Copies the voxels [index, index + count) of the storage into records.
+ * @return true if one of them is observed
+ */
+bool packVoxels(Volume& volume, size_t index, size_t count, char* records) {
+    bool observed = false;
+    switch (volume.getStorage()) {
+        case VolumeStorage::Double: {
+            const Voxel* voxels = volume.getVoxelData().data() + index;
+            for (size_t i = 0; i < count; ++i, records += 2 * sizeof(double) + 4) {
+                std::memcpy(records, &voxels[i].tsdf, sizeof(double));
+                std::memcpy(records + sizeof(double), &voxels[i].weight, sizeof(double));
+                std::memcpy(records + 2 * sizeof(double), voxels[i].color.data(), 4);
+                observed |= voxels[i].weight > 0.;
+            }
+            break;
+        }
+        case VolumeStorage::FixedPoint: {
+            const FixedPointVoxel* voxels = volume.getFixedPointVoxelData().data() + index;
+            std::memcpy(records, voxels, count * sizeof(FixedPointVoxel));
+            for (size_t i = 0; i < count && !observed; ++i)
+                observed = voxels[i].weight > 0;
+            break;
+        }
+        case VolumeStorage::Planar: {
+            const uint16_t* weights = volume.getWeightPlane().data() + index;
+            std::memcpy(records, volume.getTSDFPlane().data() + index, count * sizeof(int16_t));
+            std::memcpy(records + count * sizeof(int16_t), weights, count * sizeof(uint16_t));
+            if (volume.hasColor())
+                std::memcpy(records + count * (sizeof(int16_t) + sizeof(uint16_t)),
+                            volume.getColorPlane().data() + index, count * sizeof(uint32_t));
+            for (size_t i = 0; i < count && !observed; ++i)
+                observed = weights[i] > 0;
+            break;
+        }
+    }
+    return observed;
+}
+
+//! copies records of packVoxels into the voxels [index, index + count) of the storage
+void unpackVoxels(Volume& volume, size_t index, size_t count, const char* records) {
+    switch (volume.getStorage()) {
+        case VolumeStorage::Double: {
+            Voxel* voxels = volume.getVoxelData().data() + index;
+            for (size_t i = 0; i < count; ++i, records += 2 * sizeof(double) + 4) {
+                std::memcpy(&voxels[i].tsdf, records, sizeof(double));
+                std::memcpy(&voxels[i].weight, records + sizeof(double), sizeof(double));
+                std::memcpy(voxels[i].color.data(), records + 2 * sizeof(double), 4);
+            }
+            break;
+        }
+        case VolumeStorage::FixedPoint:
+            std::memcpy(volume.getFixedPointVoxelData().data() + index, records, count * sizeof(FixedPointVoxel));
+            break;
+        case VolumeStorage::Planar:
+            std::memcpy(volume.getTSDFPlane().data() + index, records, count * sizeof(int16_t));
+            std::memcpy(volume.getWeightPlane().data() + index, records + count * sizeof(int16_t),
+                        count * sizeof(uint16_t));
+            if (volume.hasColor())
+                std::memcpy(volume.getColorPlane().data() + index,
+                            records + count * (sizeof(int16_t) + sizeof(uint16_t)), count * sizeof(uint32_t));
+            break;
+    }
+}
+
+/*!
+ * Calls row(index, count) for the runs of voxels the brick with the given first voxel and level consists of, they are
+ * contiguous in the storage. A brick of a hashed volume holds BrickSize^3 samples, the bricks of the dense layouts
+ * end at the volume border.
+ */
+template<typename Row>
+void forEachRow(const Volume& volume, const Eigen::Vector3i& first, int level, Row row) {
+    if (volume.getLayout() == VolumeLayout::Hashed) {
+        const size_t index = volume.getBrickIndex(first.x(), first.y(), first.z(), level);
+        for (int k = 0; k < Volume::BrickSize; ++k)
+            for (int j = 0; j < Volume::BrickSize; ++j)
+                row(index + size_t(k * Volume::BrickSize + j) * Volume::BrickSize, size_t(Volume::BrickSize));
+        return;
+    }
+    const Eigen::Vector3i last = (first + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(volume.getVolumeSize());
+    for (int z = first.z(); z < last.z(); ++z)
+        for (int y = first.y(); y < last.y(); ++y)
+            row(volume.getVoxelIndex(first.x(), y, z), size_t(last.x() - first.x()));
+}
+
+//! @return true if first is the first voxel of a brick of the level inside the volume
+bool isBrick(const Volume& volume, const Eigen::Vector3i& first, int level) {
+    const int size = Volume::BrickSize << level;
+    return level >= 0 && level <= volume.getMaxLevel() && (first.array() >= 0).all() &&
+           (first.array() < volume.getVolumeSize().array()).all() && first.x() % size == 0 &&
+           first.y() % size == 0 && first.z() % size == 0;
+}
+
+typedef std::vector<std::pair<Eigen::Vector3i, int>, Eigen::aligned_allocator<std::pair<Eigen::Vector3i, int>>>
+        BrickList;
+typedef std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> BlockList;
+
+//! orders by z, y, x, then level, the order in which a paged volume is read back in layers
+bool brickBefore(const std::pair<Eigen::Vector3i, int>& a, const std::pair<Eigen::Vector3i, int>& b) {
+    return std::make_tuple(a.first.z(), a.first.y(), a.first.x(), a.second) <
+           std::make_tuple(b.first.z(), b.first.y(), b.first.x(), b.second);
+}
+
+/*!
+ * Writes a record for each of the bricks, given by first voxel and level, and the end tag. Bricks of a hashed volume
+ * which are not allocated are skipped, as are unobserved bricks of a volume without levels, which read the same as
+ * missing ones.
+ */
+void writeBrickList(Volume& volume, BrickList& bricks, std::ostream& out) {
+    // a paged volume is read back in layers of bricks along z, like the mesh extraction
+    if (volume.isPaged())
+        std::sort(bricks.begin(), bricks.end(), brickBefore);
+
+    const size_t bytes = recordBytes(volume);
+    std::vector<char> records(size_t(Volume::BrickSize * Volume::BrickSize * Volume::BrickSize) * bytes);
+    int pagedLayer = -1;
+    for (size_t i = 0; i < bricks.size(); ++i) {
+        const auto& brick = bricks[i];
+        const Eigen::Vector3i& first = brick.first;
+        if (volume.isPaged() && first.z() / Volume::BrickSize != pagedLayer) {
+            if (pagedLayer >= 0)
+                volume.evictBricks();
+            pagedLayer = first.z() / Volume::BrickSize;
+            // one pageIn for the box of the bricks of the layer, every call scans the resident bricks
+            Eigen::Vector3i minVoxel = first, maxVoxel = first;
+            for (size_t j = i; j < bricks.size() && bricks[j].first.z() / Volume::BrickSize == pagedLayer; ++j) {
+                const Eigen::Vector3i extent = Eigen::Vector3i::Constant(Volume::BrickSize << bricks[j].second);
+                minVoxel = minVoxel.cwiseMin(bricks[j].first);
+                maxVoxel = maxVoxel.cwiseMax(bricks[j].first + extent);
+            }
+            volume.pageIn(minVoxel, maxVoxel);
+        }
+        if (volume.getLayout() == VolumeLayout::Hashed &&
+            volume.getBrickIndex(first.x(), first.y(), first.z(), brick.second) == 0)
+            continue;
+        size_t filled = 0;
+        bool observed = false;
+        forEachRow(volume, first, brick.second, [&](size_t index, size_t count) {
+            observed |= packVoxels(volume, index, count, records.data() + filled);
+            filled += count * bytes;
+        });
+        if (!observed && volume.getMaxLevel() == 0)
+            continue;
+        writeValue(out, uint8_t(1));
+        out.write(reinterpret_cast<const char*>(first.data()), 3 * sizeof(int));
+        writeValue(out, uint8_t(brick.second));
+        out.write(records.data(), filled);
+    }
+    writeValue(out, uint8_t(0));
+    if (volume.isPaged())
+        volume.evictBricks();
+}
+
+//! reads the records of writeBrickList into the volume, allocating the bricks of a hashed volume
+bool readBrickList(Volume& volume, std::istream& in) {
+    const size_t bytes = recordBytes(volume);
+    std::vector<char> records(size_t(Volume::BrickSize * Volume::BrickSize * Volume::BrickSize) * bytes);
+    for (uint8_t tag;;) {
+        if (!readValue(in, tag))
+            return false;
+        if (tag == 0)
+            return true;
+        Eigen::Vector3i first;
+        uint8_t level;
+        if (!in.read(reinterpret_cast<char*>(first.data()), 3 * sizeof(int)) || !readValue(in, level) ||
+            !isBrick(volume, first, level))
+            return false;
+        volume.allocateBrick(first.x(), first.y(), first.z(), level);
+
+        size_t filled = 0;
+        forEachRow(volume, first, level, [&](size_t, size_t count) { filled += count * bytes; });
+        if (!in.read(records.data(), filled))
+            return false;
+        filled = 0;
+        forEachRow(volume, first, level, [&](size_t index, size_t count) {
+            unpackVoxels(volume, index, count, records.data() + filled);
+            filled += count * bytes;
+        });
+    }
+}
+
+//! writes the blocks of BrickSize^3 color voxels with the given first voxels which hold an observed one, then the end tag
+void writeColorBlocks(const ColorVolume& colors, const BlockList& blocks, std::ostream& out) {
+    const Eigen::Vector3i& size = colors.getSize();
+    std::vector<ColorVoxel> block;
+    for (const Eigen::Vector3i& first : blocks) {
+        const Eigen::Vector3i last = (first + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(size);
+        block.clear();
+        bool observed = false;
+        for (int z = first.z(); z < last.z(); ++z) {
+            for (int y = first.y(); y < last.y(); ++y) {
+                for (int x = first.x(); x < last.x(); ++x) {
+                    block.push_back(colors.getVoxel(x, y, z));
+                    observed |= block.back().weight > 0;
+                }
+            }
+        }
+        if (!observed)
+            continue;
+        writeValue(out, uint8_t(1));
+        out.write(reinterpret_cast<const char*>(first.data()), 3 * sizeof(int));
+        out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(ColorVoxel));
+    }
+    writeValue(out, uint8_t(0));
+}
+
+bool readColorBlocks(ColorVolume& colors, std::istream& in) {
+    const Eigen::Vector3i& size = colors.getSize();
+    std::vector<ColorVoxel> block;
+    for (uint8_t tag; readValue(in, tag);) {
+        if (tag == 0)
+            return true;
+        Eigen::Vector3i first;
+        if (!in.read(reinterpret_cast<char*>(first.data()), 3 * sizeof(int)) || (first.array() < 0).any() ||
+            (first.array() >= size.array()).any() || first.x() % Volume::BrickSize || first.y() % Volume::BrickSize ||
+            first.z() % Volume::BrickSize)
+            return false;
+        const Eigen::Vector3i last = (first + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(size);
+        block.resize(size_t((last - first).prod()));
+        if (!in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(ColorVoxel)))
+            return false;
+        size_t i = 0;
+        for (int z = first.z(); z < last.z(); ++z)
+            for (int y = first.y(); y < last.y(); ++y)
+                for (int x = first.x(); x < last.x(); ++x)
+                    colors.getVoxel(x, y, z) = block[i++];
+    }
+    return false;
+}
+
+}
+
+bool VolumeSnapshot::write(Volume& volume, std::ostream& out, uint64_t generation) {
+    const std::shared_ptr<ColorVolume>& colors = volume.getColorVolume();
+    out.write(Magic, sizeof(Magic));
+    writeValue(out, Version);
+    writeValue(out, ByteOrderMark);
+    writeValue(out, generation);
+    writeValue(out, uint8_t(volume.getStorage()));
+    writeValue(out, uint8_t(volume.getLayout()));
+    writeValue(out, uint8_t(volume.hasColor()));
+    writeValue(out, uint8_t(volume.getMaxLevel()));
+    out.write(reinterpret_cast<const char*>(volume.getOrigin().data()), 3 * sizeof(double));
+    writeValue(out, volume._voxelScale);
+    writeValue(out, volume.getLevelDistance());
+    out.write(reinterpret_cast<const char*>(volume.getVolumeSize().data()), 3 * sizeof(int));
+    writeValue(out, int32_t(colors ? colors->getDownsampling() : 0));
+
+    BrickList bricks;
+    if (volume.getLayout() == VolumeLayout::Hashed)
+        bricks = volume.getPagedBricks();
+    else {
+        for (const Eigen::Vector3i& brick : volume.getBrickOrder())
+            bricks.emplace_back(brick, 0);
+    }
+    writeBrickList(volume, bricks, out);
+
+    if (colors) {
+        BlockList blocks;
+        const Eigen::Vector3i& size = colors->getSize();
+        for (int z = 0; z < size.z(); z += Volume::BrickSize)
+            for (int y = 0; y < size.y(); y += Volume::BrickSize)
+                for (int x = 0; x < size.x(); x += Volume::BrickSize)
+                    blocks.emplace_back(x, y, z);
+        writeColorBlocks(*colors, blocks, out);
+    }
+    return bool(out);
+}
+
+bool VolumeSnapshot::writeBricks(Volume& volume, const DirtyBricks& bricks, std::ostream& out) {
+    const std::shared_ptr<ColorVolume>& colors = volume.getColorVolume();
+    const int downsampling = colors ? colors->getDownsampling() : 1;
+    BrickList list;
+    BlockList blocks;
+    for (const Eigen::Vector3i& brick : bricks.getBricks()) {
+        const Eigen::Vector3i first = brick * Volume::BrickSize;
+        // a voxel of the marked brick is stored in the brick of one of the levels
+        const int levels = volume.getLayout() == VolumeLayout::Hashed ? volume.getMaxLevel() : 0;
+        for (int level = 0; level <= levels; ++level) {
+            const int size = Volume::BrickSize << level;
+            list.emplace_back(first / size * size, level);
+        }
+        // a block of BrickSize^3 color voxels covers downsampling^3 bricks
+        if (colors)
+            blocks.push_back(brick / downsampling * Volume::BrickSize);
+    }
+    // the coarse bricks and the color blocks are shared by neighbouring marked bricks
+    std::sort(list.begin(), list.end(), brickBefore);
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    writeBrickList(volume, list, out);
+
+    if (colors) {
+        std::sort(blocks.begin(), blocks.end(), [](const Eigen::Vector3i& a, const Eigen::Vector3i& b) {
+            return std::make_tuple(a.z(), a.y(), a.x()) < std::make_tuple(b.z(), b.y(), b.x());
+        });
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        writeColorBlocks(*colors, blocks, out);
+    }
+    return bool(out);
+}
+
+bool VolumeSnapshot::readBricks(Volume& volume, std::istream& in) {
+    if (!readBrickList(volume, in))
+        return false;
+    return !volume.getColorVolume() || readColorBlocks(*volume.getColorVolume(), in);
+}
+
+bool VolumeSnapshot::save(Volume& volume, const std::string& path, uint64_t generation) {
+    std::vector<char> buffer(StreamBufferSize);
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+    const bool written = write(volume, out, generation);
+    out.close();
+    return written && bool(out);
+}
+
+std::shared_ptr<Volume> VolumeSnapshot::read(std::istream& in, uint64_t* generation) {
+    char magic[sizeof(Magic)];
+    uint32_t version, byteOrder;
+    uint64_t headerGeneration;
+    uint8_t storage, layout, hasColor, maxLevel;
+    Eigen::Vector3d origin;
+    double voxelScale, levelDistance;
+    Eigen::Vector3i volumeSize;
+    int32_t colorDownsampling;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0 ||
+        !readValue(in, version) || version != Version || !readValue(in, byteOrder) || byteOrder != ByteOrderMark ||
+        !readValue(in, headerGeneration) || !readValue(in, storage) || storage > uint8_t(VolumeStorage::Planar) || !readValue(in, layout) ||
+        layout > uint8_t(VolumeLayout::Hashed) || !readValue(in, hasColor) || !readValue(in, maxLevel) ||
+        !in.read(reinterpret_cast<char*>(origin.data()), 3 * sizeof(double)) || !readValue(in, voxelScale) ||
+        !readValue(in, levelDistance) || !in.read(reinterpret_cast<char*>(volumeSize.data()), 3 * sizeof(int)) ||
+        !readValue(in, colorDownsampling) || (volumeSize.array() <= 0).any() || !(voxelScale > 0.))
+        return nullptr;
+
+    auto volume = std::make_shared<Volume>(origin, volumeSize, voxelScale, VolumeStorage(storage), hasColor != 0,
+                                           VolumeLayout(layout), maxLevel, levelDistance);
+    if (volume->getMaxLevel() != maxLevel || (colorDownsampling != 0 && !volume->enableColorVolume(colorDownsampling)))
+        return nullptr;
+
+    if (!readBricks(*volume, in))
+        return nullptr;
+    if (generation)
+        *generation = headerGeneration;
+    return volume;
+}
+
+std::shared_ptr<Volume> VolumeSnapshot::load(const std::string& path, uint64_t* generation) {
+    std::vector<char> buffer(StreamBufferSize);
+    std::ifstream in;
+    in.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    in.open(path, std::ios::binary);
+    if (!in.is_open())
+        return nullptr;
+    return read(in, generation);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <Frame.h>
+
+/*!
+ * Renders a depth and color image of a sphere in front of a wall, so the benchmarks can run without a recorded
+ * dataset. The camera looks along +z and can be shifted along x to simulate motion.
+ */
+class SyntheticScene {
+public:
+    SyntheticScene(unsigned int width = 640, unsigned int height = 480)
+            : m_width(width), m_height(height) {
+        m_intrinsics << 525., 0., (width - 1) / 2.,
+                        0., 525., (height - 1) / 2.,
+                        0., 0., 1.;
+    }
+
+    std::shared_ptr<Frame> renderFrame(double cameraShiftX = 0.) {
+        std::vector<double> depth(m_width * m_height, 0.);
+        std::vector<BYTE> colors(m_width * m_height * 4, 255);
+
+        const Eigen::Vector3d center(0., 0., 1.5);
+        const Eigen::Vector3d origin(cameraShiftX, 0., 0.);
+        const double radius = 0.4;
+        const double wall = 2.;
+
+        for (unsigned int v = 0; v < m_height; ++v) {
+            for (unsigned int u = 0; u < m_width; ++u) {
+                const Eigen::Vector3d dir((u - m_intrinsics(0, 2)) / m_intrinsics(0, 0),
+                                          (v - m_intrinsics(1, 2)) / m_intrinsics(1, 1), 1.);
+                const double b = 2 * dir.dot(origin - center);
+                const double c = (origin - center).squaredNorm() - radius * radius;
+                const double disc = b * b - 4 * dir.squaredNorm() * c;
+                const size_t idx = u + v * m_width;
+                depth[idx] = disc > 0 ? (-b - std::sqrt(disc)) / (2 * dir.squaredNorm()) : wall;
+                colors[idx * 4] = BYTE(u % 256);
+                colors[idx * 4 + 1] = BYTE(v % 256);
+                colors[idx * 4 + 2] = disc > 0 ? 200 : 50;
+            }
+        }
+
+        auto frame = std::make_shared<Frame>(depth.data(), colors.data(), m_intrinsics, m_intrinsics,
+                                             Eigen::Matrix4d::Identity(), m_width, m_height);
+        Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+        pose(0, 3) = cameraShiftX;
+        frame->setGlobalPose(pose);
+        return frame;
+    }
+
+private:
+    unsigned int m_width;
+    unsigned int m_height;
+    Eigen::Matrix3d m_intrinsics;
+};
+
+template<typename F>
+double measureSeconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
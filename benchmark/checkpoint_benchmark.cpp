@@ -0,0 +1,170 @@
+#include <iostream>
+#include <fstream>
+#include <Fusion.hpp>
+#include <VolumeCheckpoint.hpp>
+#include <VolumeSnapshot.hpp>
+#include <ColorVolume.hpp>
+#include "SyntheticScene.h"
+
+namespace {
+
+size_t fileBytes(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file.is_open() ? size_t(file.tellg()) : 0;
+}
+
+//! @return number of voxels and color voxels in which the volumes differ
+size_t countDifferences(Volume& volume, Volume& loaded) {
+    // swapped out bricks read as unobserved, the working set may exceed the budget until the next evictBricks
+    if (volume.isPaged())
+        volume.pageIn(Eigen::Vector3i::Zero(), volume.getVolumeSize());
+    const Eigen::Vector3i& size = volume.getVolumeSize();
+    size_t differing = 0;
+    for (int z = 0; z < size.z(); ++z) {
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x) {
+                const Voxel a = volume.getVoxel(x, y, z), b = loaded.getVoxel(x, y, z);
+                if (a.tsdf != b.tsdf || a.weight != b.weight || a.color != b.color)
+                    differing++;
+            }
+        }
+    }
+    if (const ColorVolume* colors = volume.getColorVolume().get()) {
+        const Eigen::Vector3i& colorSize = colors->getSize();
+        for (int z = 0; z < colorSize.z(); ++z) {
+            for (int y = 0; y < colorSize.y(); ++y) {
+                for (int x = 0; x < colorSize.x(); ++x) {
+                    const ColorVoxel& a = colors->getVoxel(x, y, z);
+                    const ColorVoxel& b = loaded.getColorVolume()->getVoxel(x, y, z);
+                    if (a.weight != b.weight || a.rgb[0] != b.rgb[0] || a.rgb[1] != b.rgb[1] || a.rgb[2] != b.rgb[2])
+                        differing++;
+                }
+            }
+        }
+    }
+    return differing;
+}
+
+}
+
+/*
+ * Moves the camera of the synthetic scene 2 m along x and writes a VolumeCheckpoint every few frames, for several
+ * storages and layouts, among them a rolling volume following the camera and a paged one. Reports the time a
+ * checkpoint takes the integrating thread and the bricks and bytes per delta against saving a full VolumeSnapshot,
+ * then loads base and log, compacts them and loads the new base, and compares both with the volume.
+ * The checkpoints are written to the results directory.
+ * usage: checkpoint_benchmark [volume resolution] [frames] [frames per checkpoint]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 40;
+    const int interval = argc > 3 ? std::max(1, std::atoi(argv[3])) : 4;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(-1. + 2. * i / std::max(1, frames - 1)));
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << ", checkpoint every " << interval
+              << " frames" << std::endl;
+
+    struct Layout {
+        VolumeStorage storage;
+        VolumeLayout layout;
+        int maxLevel;
+        int colorDownsampling;
+        bool rolling;
+        //MiB of bricks kept in memory by a paged volume, 0 keeps all
+        size_t pagingBudget;
+    };
+    const Layout layouts[] = {{VolumeStorage::FixedPoint, VolumeLayout::Linear, 0, 0, false, 0},
+                              {VolumeStorage::Planar, VolumeLayout::Bricked, 0, 2, true, 0},
+                              {VolumeStorage::FixedPoint, VolumeLayout::Hashed, 2, 0, false, 0},
+                              {VolumeStorage::FixedPoint, VolumeLayout::Hashed, 0, 0, false, 8}};
+
+    const std::string path = PROJECT_DIR + std::string("/results/checkpoint_benchmark.kfvs");
+    for (const Layout& layout : layouts) {
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, layout.storage,
+                                               layout.colorDownsampling == 0, layout.layout, layout.maxLevel, 1.);
+        if (layout.colorDownsampling > 0)
+            volume->enableColorVolume(layout.colorDownsampling);
+        if (layout.rolling)
+            volume->enableRolling();
+        if (layout.pagingBudget > 0)
+            volume->enablePaging(PROJECT_DIR + std::string("/results/checkpoint_benchmark.swap"),
+                                 layout.pagingBudget << 20);
+
+        std::cout << toString(layout.storage) << " " << toString(layout.layout);
+        if (layout.maxLevel > 0)
+            std::cout << " with " << layout.maxLevel << " levels";
+        if (layout.colorDownsampling > 0)
+            std::cout << ", color volume 1/" << layout.colorDownsampling;
+        if (layout.rolling)
+            std::cout << ", rolling";
+        if (layout.pagingBudget > 0)
+            std::cout << ", paged with " << layout.pagingBudget << " MiB";
+        std::cout << std::endl;
+
+        std::unique_ptr<VolumeCheckpoint> checkpoint(new VolumeCheckpoint(volume, path));
+        if (!checkpoint->isOpen()) {
+            std::cout << "  failed to start the checkpoint" << std::endl;
+            continue;
+        }
+        const Eigen::Vector3d anchor = sequence.front()->getGlobalPose().block<3, 1>(0, 3) - volumeOrigin;
+        double checkpointSeconds = 0.;
+        int shifts = 0;
+        for (int i = 0; i < frames; ++i) {
+            DirtyBricks dirtyBricks(volumeSize);
+            fusion.reconstructSurface(sequence[i], volume, truncationDistance, &dirtyBricks);
+            checkpoint->markBricks(dirtyBricks);
+            if (volume->followPoint(sequence[i]->getGlobalPose().block<3, 1>(0, 3), anchor, 0.1)) {
+                checkpoint->trackShift();
+                shifts++;
+            }
+            if ((i + 1) % interval == 0 || i + 1 == frames)
+                checkpointSeconds += measureSeconds([&]() { checkpoint->write(); });
+        }
+        checkpoint->flush();
+        const VolumeCheckpoint::Stats stats = checkpoint->getStats();
+        checkpoint.reset();
+
+        const std::string snapshotPath = PROJECT_DIR + std::string("/results/checkpoint_benchmark_full.kfvs");
+        const double snapshotSeconds = measureSeconds([&]() { VolumeSnapshot::save(*volume, snapshotPath); });
+        std::cout << "  " << stats.deltas << " checkpoints, " << shifts << " shifts, "
+                  << 1000. * checkpointSeconds / std::max<size_t>(1, stats.deltas) << " ms each (stalled "
+                  << 1000. * stats.stallSeconds << " ms in total), " << stats.bricks / std::max<size_t>(1, stats.deltas)
+                  << " bricks and " << stats.bytes / std::max<size_t>(1, stats.deltas) / (1024. * 1024.)
+                  << " MiB per delta, full snapshot " << 1000. * snapshotSeconds << " ms and "
+                  << fileBytes(snapshotPath) / (1024. * 1024.) << " MiB" << std::endl;
+
+        std::shared_ptr<Volume> loaded;
+        const double loadSeconds = measureSeconds([&]() { loaded = VolumeCheckpoint::load(path); });
+        const size_t logBytes = fileBytes(VolumeCheckpoint::getLogPath(path));
+        if (!loaded) {
+            std::cout << "  failed to load the checkpoint" << std::endl;
+            continue;
+        }
+        std::cout << "  base and log " << (fileBytes(path) + logBytes) / (1024. * 1024.) << " MiB, loaded in "
+                  << 1000. * loadSeconds << " ms, differing voxels: " << countDifferences(*volume, *loaded)
+                  << std::endl;
+
+        bool compacted = false;
+        const double compactSeconds = measureSeconds([&]() { compacted = VolumeCheckpoint::compact(path); });
+        loaded = VolumeCheckpoint::load(path);
+        if (!compacted || !loaded) {
+            std::cout << "  failed to compact the checkpoint" << std::endl;
+            continue;
+        }
+        std::cout << "  compacted in " << 1000. * compactSeconds << " ms to "
+                  << (fileBytes(path) + fileBytes(VolumeCheckpoint::getLogPath(path))) / (1024. * 1024.)
+                  << " MiB, differing voxels: " << countDifferences(*volume, *loaded) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include <Marching_cubes.hpp>
+#include <ColorVolume.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Compares the colors fused into the voxels with a separate color volume at half and quarter resolution. Reports the
+ * memory of the voxels and of the color volume, the integration time, the time of a raycast and of marching cubes and
+ * the mean absolute difference per channel between the raycast colors and the color image of the raycast pose.
+ * usage: color_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << std::endl;
+
+    struct Layout {
+        VolumeStorage storage;
+        //1: colors in the voxels
+        int colorDownsampling;
+    };
+    const Layout layouts[] = {{VolumeStorage::FixedPoint, 1}, {VolumeStorage::FixedPoint, 2},
+                              {VolumeStorage::Planar, 1}, {VolumeStorage::Planar, 2}, {VolumeStorage::Planar, 4}};
+
+    for (const Layout& layout : layouts) {
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, layout.storage,
+                                               layout.colorDownsampling == 1);
+        if (layout.colorDownsampling > 1)
+            volume->enableColorVolume(layout.colorDownsampling);
+
+        double integrationSeconds = 0.;
+        for (const auto& frame : sequence)
+            integrationSeconds += measureSeconds([&]() {
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+            });
+
+        std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+        const std::vector<Vector4uc> image = frame->getColorMap();
+        Raycast raycast;
+        const double raycastSeconds = measureSeconds([&]() {
+            raycast.surfacePrediction(frame, volume, float(truncationDistance));
+        });
+        double difference = 0.;
+        size_t hits = 0;
+        for (size_t i = 0; i < image.size(); ++i) {
+            if (!frame->getGlobalPoints()[i].allFinite())
+                continue;
+            for (int c = 0; c < 3; ++c)
+                difference += std::abs(int(frame->getColorMap()[i][c]) - int(image[i][c]));
+            hits++;
+        }
+
+        const std::string name = "color_benchmark_" + std::to_string(layout.colorDownsampling);
+        const double meshSeconds = measureSeconds([&]() { MarchingCubes::extractMesh(*volume, name); });
+
+        const size_t colorBytes = volume->getColorVolume() ? volume->getColorVolume()->getResidentMemoryUsage() : 0;
+        std::cout << toString(layout.storage)
+                  << (layout.colorDownsampling == 1 ? std::string(", colors in the voxels")
+                                                    : ", color volume 1/" + std::to_string(layout.colorDownsampling))
+                  << ": voxels " << volume->getResidentMemoryUsage() / (1024. * 1024.) << " MiB, color volume "
+                  << colorBytes / (1024. * 1024.) << " MiB, integration " << 1000. * integrationSeconds / frames
+                  << " ms/frame, raycast " << 1000. * raycastSeconds << " ms, marching cubes "
+                  << 1000. * meshSeconds << " ms, color difference " << difference / std::max<size_t>(1, 3 * hits)
+                  << " (" << hits << " hits)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Compares the fixed point and planar volumes with the double precision volume, all integrated with the vectorized
+ * kernel, and reports the deviation against the error bounds documented in SimdIntegrator as well as the time of a
+ * raycast, which only reads the tsdf.
+ * usage: fixedpoint_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 20;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames
+              << ", instruction set: " << SimdIntegrator::instructionSet() << std::endl;
+
+    struct Layout {
+        VolumeStorage storage;
+        bool color;
+    };
+    const Layout layouts[] = {{VolumeStorage::Double, true}, {VolumeStorage::FixedPoint, true},
+                              {VolumeStorage::Planar, true}, {VolumeStorage::Planar, false}};
+
+    std::vector<std::shared_ptr<Volume>> volumes;
+    for (const Layout& layout : layouts) {
+        Fusion fusion(1);
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, layout.storage, layout.color);
+        const double seconds = measureSeconds([&]() {
+            for (const auto& frame : sequence)
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+        });
+        const size_t bytes = volume->getVoxelData().size() * sizeof(Voxel) +
+                             volume->getFixedPointVoxelData().size() * sizeof(FixedPointVoxel) +
+                             volume->getTSDFPlane().size() * sizeof(int16_t) +
+                             volume->getWeightPlane().size() * sizeof(uint16_t) +
+                             volume->getColorPlane().size() * sizeof(uint32_t);
+
+        std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+        Raycast raycast;
+        const double raycastSeconds = measureSeconds([&]() {
+            raycast.surfacePrediction(frame, volume, float(truncationDistance));
+        });
+        std::cout << toString(layout.storage) << (layout.color ? "" : " without color") << ": "
+                  << 1000. * seconds / frames << " ms/frame, " << bytes / (1024 * 1024) << " MiB, raycast "
+                  << 1000. * raycastSeconds << " ms" << std::endl;
+        volumes.push_back(volume);
+    }
+
+    for (size_t i = 1; i < volumes.size(); ++i) {
+        size_t observed = 0, weightMismatches = 0;
+        double maxTSDFError = 0., sumTSDFError = 0.;
+        int maxColorError = 0;
+        for (int z = 0; z < resolution; ++z) {
+            for (int y = 0; y < resolution; ++y) {
+                for (int x = 0; x < resolution; ++x) {
+                    const Voxel reference = volumes[0]->getVoxel(x, y, z);
+                    const Voxel compact = volumes[i]->getVoxel(x, y, z);
+                    if (reference.weight == 0. && compact.weight == 0.) continue;
+                    if (reference.weight != compact.weight) {
+                        weightMismatches++;
+                        continue;
+                    }
+                    observed++;
+                    const double error = std::abs(reference.tsdf - compact.tsdf);
+                    maxTSDFError = std::max(maxTSDFError, error);
+                    sumTSDFError += error;
+                    if (!volumes[i]->hasColor()) continue;
+                    for (int c = 0; c < 3; ++c)
+                        maxColorError = std::max(maxColorError, std::abs(int(reference.color[c]) - int(compact.color[c])));
+                }
+            }
+        }
+        const double lsb = 1. / FixedPointVoxel::TSDFScale;
+        std::cout << toString(layouts[i].storage) << (layouts[i].color ? "" : " without color")
+                  << " against Double" << std::endl;
+        std::cout << "  voxels with differing weight: " << weightMismatches << " of " << observed << std::endl;
+        std::cout << "  max tsdf difference: " << maxTSDFError / lsb << " lsb (" << 1e6 * maxTSDFError * truncationDistance
+                  << " um), mean: " << sumTSDFError / std::max<size_t>(1, observed) / lsb << " lsb" << std::endl;
+        std::cout << "  bound after " << frames << " updates: " << 1.25 * (frames + 1) / 2 << " lsb" << std::endl;
+        std::cout << "  max rgb difference: " << maxColorError << std::endl;
+    }
+    return 0;
+}
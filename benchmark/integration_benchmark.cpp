@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Compares the double precision integration loop with the vectorized row kernel on a synthetic scene.
+ * usage: integration_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 5;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.01 * i));
+
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames
+              << ", instruction set: " << SimdIntegrator::instructionSet() << std::endl;
+
+    std::vector<std::shared_ptr<Volume>> volumes;
+    for (auto kernel : {IntegrationKernel::Scalar, IntegrationKernel::Simd}) {
+        Fusion fusion(1);
+        fusion.setIntegrationKernel(kernel);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale);
+        const double seconds = measureSeconds([&]() {
+            for (const auto& frame : sequence)
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+        });
+        std::cout << toString(kernel) << ": " << 1000. * seconds / frames << " ms/frame" << std::endl;
+        volumes.push_back(volume);
+    }
+
+    // the kernels round pixel coordinates differently and work in float, so only report the deviation
+    const auto& reference = volumes[0]->getVoxelData();
+    const auto& simd = volumes[1]->getVoxelData();
+    size_t weightMismatches = 0;
+    double maxTSDFError = 0.;
+    for (size_t i = 0; i < reference.size(); ++i) {
+        if (reference[i].weight != simd[i].weight) {
+            weightMismatches++;
+            continue;
+        }
+        maxTSDFError = std::max(maxTSDFError, std::abs(reference[i].tsdf - simd[i].tsdf));
+    }
+    std::cout << "voxels with differing weight: " << weightMismatches << " of " << reference.size() << std::endl;
+    std::cout << "max tsdf difference: " << maxTSDFError << std::endl;
+    return 0;
+}
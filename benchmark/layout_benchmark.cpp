@@ -0,0 +1,193 @@
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include "SyntheticScene.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Counts the last level cache misses of the calling thread with perf_event_open. If the kernel does not allow it
+ * (perf_event_paranoid, containers) only the time is reported.
+ */
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~CacheMissCounter() {
+#if defined(__linux__)
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    bool available() const {
+        return m_fd >= 0;
+    }
+
+    //! runs f and returns the number of cache misses it caused, 0 if the counter is not available
+    template<typename F>
+    long long count(F&& f) {
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+            f();
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            long long misses = 0;
+            if (read(m_fd, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+            return misses;
+        }
+#endif
+        f();
+        return 0;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+/*
+ * Compares the linear, the bricked and the hashed volume layout on the access patterns of the pipeline: the
+ * integration, a raycast, the 8-corner fetch of the marching cubes and the 6-neighbour gradient of
+ * Volume::getTSDFGrad, and reports the memory of each layout. The voxel data is committed lazily, the construction
+ * time and the resident memory before and after the integration show how much of it is actually touched.
+ * usage: layout_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+
+    CacheMissCounter counter;
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames
+              << ", instruction set: " << SimdIntegrator::instructionSet()
+              << (counter.available() ? "" : ", cache miss counter not available") << std::endl;
+
+    auto report = [&](const char* name, double seconds, long long misses) {
+        std::cout << "  " << name << ": " << 1000. * seconds << " ms";
+        if (counter.available())
+            std::cout << ", " << misses / 1000 << "k cache misses";
+        std::cout << std::endl;
+    };
+
+    std::vector<std::shared_ptr<Volume>> volumes;
+    for (auto layout : {VolumeLayout::Linear, VolumeLayout::Bricked, VolumeLayout::Hashed}) {
+        std::cout << toString(layout) << std::endl;
+        Fusion fusion(1);
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        std::shared_ptr<Volume> volume;
+        double seconds = measureSeconds([&]() {
+            volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint, true,
+                                              layout);
+        });
+        std::cout << "  construction: " << 1000. * seconds << " ms, resident: "
+                  << volume->getResidentMemoryUsage() / (1024. * 1024.) << " MiB" << std::endl;
+
+        long long misses = counter.count([&]() {
+            seconds = measureSeconds([&]() {
+                for (const auto& frame : sequence)
+                    fusion.reconstructSurface(frame, volume, truncationDistance);
+            });
+        });
+        report("integration", seconds, misses);
+        std::cout << "  memory: " << volume->getMemoryUsage() / (1024. * 1024.) << " MiB, resident: "
+                  << volume->getResidentMemoryUsage() / (1024. * 1024.) << " MiB, bricks: "
+                  << volume->getAllocatedBrickCount() << std::endl;
+
+        std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+        Raycast raycast;
+        misses = counter.count([&]() {
+            seconds = measureSeconds([&]() { raycast.surfacePrediction(frame, volume, float(truncationDistance)); });
+        });
+        report("raycast", seconds, misses);
+
+        // the tsdf test the marching cubes runs on every cube, in the same brick order
+        static const int cornerOffsets[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1},
+                                                {0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}};
+        const Eigen::Vector3i lastCube = volumeSize - Eigen::Vector3i::Ones();
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> surfacePoints;
+        misses = counter.count([&]() {
+            seconds = measureSeconds([&]() {
+                for (const Eigen::Vector3i& brick : volume->getBrickOrder()) {
+                    const Eigen::Vector3i brickEnd = (brick + Eigen::Vector3i::Constant(Volume::BrickSize)).cwiseMin(lastCube);
+                    for (int z = brick.z(); z < brickEnd.z(); z++)
+                        for (int y = brick.y(); y < brickEnd.y(); y++)
+                            for (int x = brick.x(); x < brickEnd.x(); x++) {
+                                int insideCorners = 0;
+                                for (int i = 0; i < 8; i++)
+                                    if (volume->getTSDF(x + cornerOffsets[i][0], y + cornerOffsets[i][1],
+                                                        z + cornerOffsets[i][2]) <= 0.0)
+                                        insideCorners++;
+                                if (insideCorners != 0 && insideCorners != 8 && volume->getWeight(x, y, z) > 0.)
+                                    surfacePoints.push_back(volume->getGlobalCoordinate(x, y, z));
+                            }
+                }
+            });
+        });
+        report("marching cubes corners", seconds, misses);
+
+        double gradientSum = 0.;
+        misses = counter.count([&]() {
+            seconds = measureSeconds([&]() {
+                for (const auto& point : surfacePoints)
+                    gradientSum += volume->getTSDFGrad(point).norm();
+            });
+        });
+        report("gradients", seconds, misses);
+        std::cout << "  surface cubes: " << surfacePoints.size() << ", mean gradient: "
+                  << gradientSum / std::max<size_t>(1, surfacePoints.size()) << std::endl;
+        volumes.push_back(volume);
+    }
+
+    // the row kernel restarts at every brick border, which only changes the float rounding of the voxel positions.
+    // The hashed volume does not store the free space in front of the truncation band, so it is only compared on
+    // its allocated bricks
+    for (size_t i = 1; i < volumes.size(); ++i) {
+        size_t weightMismatches = 0;
+        double maxTSDFError = 0.;
+        for (int z = 0; z < resolution; ++z)
+            for (int y = 0; y < resolution; ++y)
+                for (int x = 0; x < resolution; ++x) {
+                    if (!volumes[i]->isAllocated(x, y, z))
+                        continue;
+                    const Voxel linear = volumes[0]->getVoxel(x, y, z);
+                    const Voxel other = volumes[i]->getVoxel(x, y, z);
+                    if (linear.weight != other.weight)
+                        weightMismatches++;
+                    else
+                        maxTSDFError = std::max(maxTSDFError, std::abs(linear.tsdf - other.tsdf));
+                }
+        std::cout << toString(volumes[i]->getLayout()) << " vs " << toString(VolumeLayout::Linear)
+                  << ": voxels with differing weight: " << weightMismatches << ", max tsdf difference: "
+                  << maxTSDFError * FixedPointVoxel::TSDFScale << " lsb" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Integrates the same frames into a linear volume with the default memory placement, with huge pages, and with its
+ * z-slabs placed on the NUMA nodes (Volume::placeSlabs), and reports the time per frame, the resident memory and the
+ * bytes per node. On a single node machine the cpus of the node can be split into several nodes backed by the same
+ * memory, which exercises the placed scheduling without a second memory controller.
+ * usage: numa_benchmark [volume resolution] [frames] [nodes to split a single node into]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 512;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const int splitNodes = argc > 3 ? std::atoi(argv[3]) : 2;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+
+    std::vector<NumaNode> nodes = getNumaNodes();
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << ", NUMA nodes: " << nodes.size() << std::endl;
+    if (nodes.size() == 1 && splitNodes > 1) {
+        const std::vector<int> cpus = nodes.front().cpus;
+        nodes.clear();
+        for (int n = 0; n < splitNodes; ++n) {
+            NumaNode node{0, {}};
+            for (size_t c = n * cpus.size() / splitNodes; c < (n + 1) * cpus.size() / splitNodes; ++c)
+                node.cpus.push_back(cpus[c]);
+            // with fewer cpus than nodes, the nodes share them
+            if (node.cpus.empty())
+                node.cpus.push_back(cpus[n % cpus.size()]);
+            nodes.push_back(node);
+        }
+        std::cout << "Single node split into " << nodes.size() << " nodes of its cpus" << std::endl;
+    }
+
+    const char* names[] = {"default", "huge pages", "placed slabs", "placed slabs and huge pages"};
+    std::shared_ptr<Volume> reference;
+    for (int mode = 0; mode < 4; ++mode) {
+        const bool hugePages = mode & 1;
+        const bool placed = mode & 2;
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint);
+        const bool advised = hugePages && volume->enableHugePages();
+        if (placed && !volume->placeSlabs(nodes)) {
+            std::cout << names[mode] << ": not placed, needs several nodes" << std::endl;
+            continue;
+        }
+
+        double seconds = 0.;
+        for (const auto& frame : sequence)
+            seconds += measureSeconds([&]() { fusion.reconstructSurface(frame, volume, truncationDistance); });
+
+        std::cout << names[mode] << (hugePages && !advised ? " (not supported)" : "") << std::endl;
+        std::cout << "  integration: " << 1000. * seconds / frames << " ms/frame, resident: "
+                  << volume->getResidentMemoryUsage() / (1024. * 1024.) << " MiB" << std::endl;
+        std::cout << "  placement:";
+        for (const auto& node : volume->getResidentBytesPerNode())
+            std::cout << " node " << node.first << ": " << node.second / (1024. * 1024.) << " MiB";
+        std::cout << std::endl;
+
+        if (!reference) {
+            reference = volume;
+            continue;
+        }
+        const auto& expected = reference->getFixedPointVoxelData();
+        const auto& actual = volume->getFixedPointVoxelData();
+        size_t differing = 0;
+        for (size_t i = 0; i < expected.size(); ++i)
+            if (expected[i].tsdf != actual[i].tsdf || expected[i].weight != actual[i].weight)
+                differing++;
+        std::cout << "  voxels differing from the default placement: " << differing << std::endl;
+    }
+    return 0;
+}
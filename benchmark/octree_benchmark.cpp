@@ -0,0 +1,77 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Integrates the synthetic scene into hashed volumes with an increasing number of levels and reports the memory, the
+ * bricks per level, the integration and raycast time and the distance of the raycast points to the true surface of
+ * the scene. The dense linear volume is listed as reference. The sphere lies between 1.1 m and 1.5 m, the wall at
+ * 2 m, so with the default level distance of 1 m the sphere ends up at level 1 and the wall at level 2.
+ * usage: octree_benchmark [volume resolution] [frames] [level distance]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double levelDistance = argc > 3 ? std::atof(argv[3]) : 1.;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+
+    std::cout << "Volume: " << resolution << "^3, voxel size: " << 1000. * voxelScale << " mm, frames: " << frames
+              << ", level distance: " << levelDistance << " m" << std::endl;
+
+    for (int maxLevel = -1; maxLevel <= 3; ++maxLevel) {
+        Fusion fusion(1);
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint, true,
+                                               maxLevel < 0 ? VolumeLayout::Linear : VolumeLayout::Hashed,
+                                               std::max(0, maxLevel), levelDistance);
+        const double seconds = measureSeconds([&]() {
+            for (const auto& frame : sequence)
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+        });
+
+        std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+        Raycast raycast;
+        const double raycastSeconds = measureSeconds([&]() {
+            raycast.surfacePrediction(frame, volume, float(truncationDistance));
+        });
+
+        // distance of the predicted points to the sphere and the wall of the scene
+        size_t valid = 0;
+        double errorSum = 0.;
+        for (const auto& point : frame->getGlobalPoints()) {
+            if (!std::isfinite(point.x())) continue;
+            const double sphere = std::abs((point - Eigen::Vector3d(0., 0., 1.5)).norm() - 0.4);
+            errorSum += std::min(sphere, std::abs(point.z() - 2.));
+            valid++;
+        }
+
+        if (maxLevel < 0) {
+            std::cout << "Linear";
+        } else {
+            std::cout << "Hashed, max level " << maxLevel << ", bricks per level:";
+            std::vector<size_t> perLevel(maxLevel + 1, 0);
+            for (uint8_t level : volume->getBrickLevels())
+                perLevel[level]++;
+            for (size_t count : perLevel)
+                std::cout << " " << count;
+        }
+        std::cout << std::endl << "  integration: " << 1000. * seconds / frames << " ms/frame, memory: "
+                  << volume->getMemoryUsage() / (1024. * 1024.) << " MiB, raycast: " << 1000. * raycastSeconds
+                  << " ms" << std::endl;
+        std::cout << "  raycast points: " << valid << ", mean distance to the surface: "
+                  << 1000. * errorSum / std::max<size_t>(1, valid) << " mm" << std::endl;
+    }
+    return 0;
+}
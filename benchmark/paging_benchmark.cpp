@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Moves the camera of the synthetic scene across the volume and back, integrating every frame and raycasting every
+ * fifth, once with all bricks in memory and once for every memory budget of a paged volume. On the way back the
+ * bricks evicted on the way out are read back from the swap file. Reports the time per frame, the hit rate and the
+ * stall time of the paging and checks that the paged volume ends up with the same voxels as the one in memory.
+ * usage: paging_benchmark [volume resolution] [frames] [budgets in MiB...]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 40;
+    std::vector<size_t> budgets;
+    for (int i = 3; i < argc; ++i)
+        budgets.push_back(size_t(std::atoi(argv[i])));
+    if (budgets.empty())
+        budgets = {32, 8, 2};
+    const double truncationDistance = 0.06;
+    // the raycast is much slower than the integration, it only runs for every few frames
+    const int RaycastInterval = 5;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    // from x = -1 m to 1 m and back
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i) {
+        const double t = double(i) / std::max(1, frames - 1);
+        sequence.push_back(scene.renderFrame(t < 0.5 ? -1. + 4. * t : 3. - 4. * t));
+    }
+
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << std::endl;
+
+    std::shared_ptr<Volume> reference;
+    for (int run = -1; run < int(budgets.size()); ++run) {
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint, true,
+                                               VolumeLayout::Hashed);
+        if (run >= 0 && !volume->enablePaging("paging_benchmark.swap", budgets[run] << 20)) {
+            std::cout << "Failed to create the swap file" << std::endl;
+            return -1;
+        }
+
+        double integrationSeconds = 0., raycastSeconds = 0.;
+        size_t maxResident = 0;
+        for (int i = 0; i < frames; ++i) {
+            const std::shared_ptr<Frame>& frame = sequence[i];
+            integrationSeconds += measureSeconds([&]() {
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+            });
+            maxResident = std::max(maxResident, volume->getAllocatedBrickCount());
+            if (i % RaycastInterval != 0)
+                continue;
+            std::shared_ptr<Frame> prediction = std::make_shared<Frame>(*frame);
+            Raycast raycast;
+            raycastSeconds += measureSeconds([&]() {
+                raycast.surfacePrediction(prediction, volume, float(truncationDistance));
+            });
+        }
+        const int raycasts = (frames + RaycastInterval - 1) / RaycastInterval;
+
+        if (run < 0) {
+            std::cout << "In memory";
+        } else {
+            std::cout << "Paged, budget " << budgets[run] << " MiB";
+        }
+        std::cout << std::endl << "  integration: " << 1000. * integrationSeconds / frames << " ms/frame, raycast: "
+                  << 1000. * raycastSeconds / raycasts << " ms/raycast, resident bricks: "
+                  << volume->getAllocatedBrickCount() << " (at most " << maxResident << ")" << std::endl;
+        if (run < 0) {
+            reference = volume;
+            continue;
+        }
+
+        const Volume::PagingStats stats = volume->getPagingStats();
+        std::cout << "  hit rate: " << 100. * stats.hitRate() << " %, bricks read: " << stats.loads
+                  << ", evicted: " << stats.evictions << ", written: " << stats.writes
+                  << ", stall: " << 1000. * stats.stallSeconds << " ms" << std::endl;
+
+        // every brick of the reference, read through the paging layer
+        size_t bricks = 0, differing = 0;
+        for (const Eigen::Vector3i& first : reference->getBrickOrder()) {
+            volume->pageIn(first, first + Eigen::Vector3i::Constant(Volume::BrickSize));
+            for (int z = first.z(); z < first.z() + Volume::BrickSize; ++z)
+                for (int y = first.y(); y < first.y() + Volume::BrickSize; ++y)
+                    for (int x = first.x(); x < first.x() + Volume::BrickSize; ++x)
+                        if (volume->getWeight(x, y, z) != reference->getWeight(x, y, z) ||
+                            volume->getTSDF(x, y, z) != reference->getTSDF(x, y, z))
+                            differing++;
+            if (++bricks % 256 == 0)
+                volume->evictBricks();
+        }
+        std::cout << "  voxels differing from the volume in memory: " << differing << std::endl;
+    }
+    return 0;
+}
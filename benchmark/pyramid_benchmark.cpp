@@ -0,0 +1,132 @@
+#include <iostream>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include <Marching_cubes.hpp>
+#include <TSDFPyramid.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Integrates frames into a volume and keeps a TSDFPyramid current with the bricks each frame touched, then compares
+ * the incrementally updated levels with a pyramid rebuilt from scratch. Reports the time of the incremental update
+ * and of a rebuild per frame, and the time of a raycast and of marching cubes on every level. A level is raycast with
+ * the truncation distance scaled by its voxel size, the rays step by the same number of voxels on every level.
+ * Then moves the camera 1 m along x through a rolling volume, rebuilding its pyramid after every shift, and reports
+ * the mean distance of the raycast points of every level to those of the volume itself.
+ * usage: pyramid_benchmark [volume resolution] [frames] [levels]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const int levels = argc > 3 ? std::atoi(argv[3]) : TSDFPyramid::MaxLevels;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << ", levels: " << levels << std::endl;
+
+    Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+    fusion.setIntegrationKernel(IntegrationKernel::Simd);
+    auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint, true);
+    TSDFPyramid pyramid(volume, levels);
+
+    double integrationSeconds = 0., updateSeconds = 0., rebuildSeconds = 0.;
+    size_t dirtyBricks = 0;
+    DirtyBricks bricks(volumeSize);
+    for (int i = 0; i < frames; ++i) {
+        bricks.clear();
+        integrationSeconds += measureSeconds([&]() {
+            fusion.reconstructSurface(scene.renderFrame(0.002 * i), volume, truncationDistance, &bricks);
+        });
+        dirtyBricks += bricks.count();
+        updateSeconds += measureSeconds([&]() { pyramid.update(bricks); });
+    }
+    TSDFPyramid rebuilt(volume, levels);
+    for (int i = 0; i < frames; ++i)
+        rebuildSeconds += measureSeconds([&]() { rebuilt.rebuild(); });
+
+    std::cout << "integration: " << 1000. * integrationSeconds / frames << " ms/frame, " << dirtyBricks / frames
+              << " dirty bricks/frame" << std::endl;
+    std::cout << "incremental update: " << 1000. * updateSeconds / frames << " ms/frame, rebuild: "
+              << 1000. * rebuildSeconds / frames << " ms" << std::endl;
+
+    for (int level = 0; level <= pyramid.getLevelCount(); ++level) {
+        std::shared_ptr<Volume> coarse = pyramid.getLevel(level);
+        size_t differing = 0, observed = 0;
+        if (level > 0) {
+            const auto& expected = rebuilt.getLevel(level)->getFixedPointVoxelData();
+            const auto& actual = coarse->getFixedPointVoxelData();
+            for (size_t i = 0; i < expected.size(); ++i) {
+                if (expected[i].tsdf != actual[i].tsdf || expected[i].weight != actual[i].weight ||
+                    expected[i].getColor() != actual[i].getColor())
+                    differing++;
+                if (actual[i].weight > 0)
+                    observed++;
+            }
+        }
+
+        std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+        Raycast raycast;
+        const double raycastSeconds = measureSeconds([&]() {
+            raycast.surfacePrediction(frame, coarse, float(truncationDistance * (1 << level)));
+        });
+        size_t hits = 0;
+        for (const auto& point : frame->getGlobalPoints())
+            if (point.allFinite())
+                hits++;
+
+        const std::string name = "pyramid_benchmark_level" + std::to_string(level);
+        const double meshSeconds = measureSeconds([&]() { MarchingCubes::extractMesh(*coarse, name); });
+
+        std::cout << "level " << level << ": " << coarse->getVolumeSize().x() << "^3, voxel "
+                  << 1000. * coarse->getVoxelScale() << " mm, raycast: " << 1000. * raycastSeconds << " ms ("
+                  << hits << " hits), marching cubes: " << 1000. * meshSeconds << " ms";
+        if (level > 0)
+            std::cout << ", observed voxels: " << observed << ", differing from rebuild: " << differing;
+        std::cout << std::endl;
+    }
+
+    auto rolling = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint, true);
+    rolling->enableRolling();
+    TSDFPyramid rollingPyramid(rolling, levels);
+    const Eigen::Vector3d anchor = scene.renderFrame(0.)->getGlobalPose().block<3, 1>(0, 3) - volumeOrigin;
+    int shifts = 0;
+    for (int i = 0; i < frames; ++i) {
+        std::shared_ptr<Frame> frame = scene.renderFrame(double(i) / std::max(1, frames - 1));
+        bricks.clear();
+        fusion.reconstructSurface(frame, rolling, truncationDistance, &bricks);
+        rollingPyramid.update(bricks);
+        if (rolling->followPoint(frame->getGlobalPose().block<3, 1>(0, 3), anchor, 0.1)) {
+            rollingPyramid.rebuild();
+            shifts++;
+        }
+    }
+    std::cout << "rolling: " << shifts << " shifts, origin moved by "
+              << (rolling->getOrigin() - volumeOrigin).transpose() << std::endl;
+    std::vector<Eigen::Vector3d> reference;
+    for (int level = 0; level <= rollingPyramid.getLevelCount(); ++level) {
+        std::shared_ptr<Frame> frame = scene.renderFrame(1.);
+        std::shared_ptr<Volume> coarse = rollingPyramid.getLevel(level);
+        Raycast raycast;
+        raycast.surfacePrediction(frame, coarse, float(truncationDistance * (1 << level)));
+        const auto& points = frame->getGlobalPoints();
+        if (level == 0) {
+            reference.assign(points.begin(), points.end());
+            continue;
+        }
+        double distance = 0.;
+        size_t hits = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (!points[i].allFinite() || !reference[i].allFinite())
+                continue;
+            distance += (points[i] - reference[i]).norm();
+            hits++;
+        }
+        std::cout << "rolling level " << level << ": " << hits << " hits, mean distance to level 0: "
+                  << 1000. * distance / std::max<size_t>(1, hits) << " mm" << std::endl;
+    }
+    return 0;
+}
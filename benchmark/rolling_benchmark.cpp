@@ -0,0 +1,103 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Moves the camera of the synthetic scene 2 m along x through a rolling volume half as wide as a static volume which
+ * covers the whole way. The rolling volume follows the camera, every shift hands the slabs leaving it to a callback
+ * and clears them. Reports the time per frame with and without rolling and the time and size of the shifts, and
+ * compares the voxels which stayed in the rolling window during the whole run with the static volume.
+ * usage: rolling_benchmark [volume resolution] [frames] [shift threshold in m]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 40;
+    const double threshold = argc > 3 ? std::atof(argv[3]) : 0.1;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const double voxelScale = volumeRange.x() / resolution;
+    // the static volume covers x from -2.5 m to 2.5 m, the rolling one starts centered on the camera at x = -1 m, on
+    // the grid of the static one
+    const Eigen::Vector3d staticOrigin(-volumeRange.x(), -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i staticSize(2 * resolution, resolution, resolution);
+    const int startOffset = int(std::lround(0.25 / voxelScale / Volume::BrickSize)) * Volume::BrickSize;
+    const Eigen::Vector3d rollingOrigin = staticOrigin + Eigen::Vector3d(startOffset * voxelScale, 0., 0.);
+    const Eigen::Vector3i rollingSize(resolution, resolution, resolution);
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(-1. + 2. * i / std::max(1, frames - 1)));
+
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << ", shift threshold: " << threshold << " m"
+              << std::endl;
+
+    for (auto layout : {VolumeLayout::Linear, VolumeLayout::Bricked}) {
+        std::cout << toString(layout) << std::endl;
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+
+        auto reference = std::make_shared<Volume>(staticOrigin, staticSize, voxelScale, VolumeStorage::FixedPoint,
+                                                  true, layout);
+        double staticSeconds = 0.;
+        for (const auto& frame : sequence)
+            staticSeconds += measureSeconds([&]() { fusion.reconstructSurface(frame, reference, truncationDistance); });
+
+        auto volume = std::make_shared<Volume>(rollingOrigin, rollingSize, voxelScale, VolumeStorage::FixedPoint,
+                                               true, layout);
+        if (!volume->enableRolling()) {
+            std::cout << "  rolling not supported" << std::endl;
+            continue;
+        }
+        size_t slabs = 0, slabVoxels = 0;
+        volume->setSlabCallback([&](Volume&, const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) {
+            slabs++;
+            slabVoxels += size_t((maxVoxel - minVoxel).prod());
+        });
+
+        const Eigen::Vector3d anchor = sequence.front()->getGlobalPose().block<3, 1>(0, 3) - rollingOrigin;
+        double rollingSeconds = 0., shiftSeconds = 0.;
+        int shifts = 0;
+        // the window of voxels which have been inside the rolling volume all the time, in the voxels of the static one
+        int keptBegin = startOffset, keptEnd = startOffset + rollingSize.x();
+        for (const auto& frame : sequence) {
+            rollingSeconds += measureSeconds([&]() { fusion.reconstructSurface(frame, volume, truncationDistance); });
+            bool shifted = false;
+            shiftSeconds += measureSeconds([&]() {
+                shifted = volume->followPoint(frame->getGlobalPose().block<3, 1>(0, 3), anchor, threshold);
+            });
+            if (shifted) {
+                shifts++;
+                keptBegin = std::max(keptBegin, startOffset + volume->getGridOffset().x());
+                keptEnd = std::min(keptEnd, startOffset + volume->getGridOffset().x() + rollingSize.x());
+            }
+        }
+
+        std::cout << "  integration: " << 1000. * staticSeconds / frames << " ms/frame static ("
+                  << staticSize.x() << " voxels wide), " << 1000. * rollingSeconds / frames << " ms/frame rolling ("
+                  << rollingSize.x() << " voxels wide)" << std::endl;
+        std::cout << "  shifts: " << shifts << ", " << 1000. * shiftSeconds / std::max(1, shifts)
+                  << " ms/shift, slabs: " << slabs << " with " << slabVoxels / 1000 << "k voxels, moved by "
+                  << volume->getGridOffset().x() << " voxels" << std::endl;
+
+        size_t compared = 0, weightMismatches = 0;
+        double maxTSDFError = 0.;
+        for (int z = 0; z < rollingSize.z(); ++z)
+            for (int y = 0; y < rollingSize.y(); ++y)
+                for (int x = keptBegin; x < keptEnd; ++x) {
+                    const Voxel expected = reference->getVoxel(x, y, z);
+                    const Voxel rolled = volume->getVoxel(x - startOffset - volume->getGridOffset().x(), y, z);
+                    compared++;
+                    if (expected.weight != rolled.weight)
+                        weightMismatches++;
+                    else
+                        maxTSDFError = std::max(maxTSDFError, std::abs(expected.tsdf - rolled.tsdf));
+                }
+        std::cout << "  voxels kept during the whole run: " << compared / 1000 << "k, with differing weight: "
+                  << weightMismatches << ", max tsdf difference: " << maxTSDFError * FixedPointVoxel::TSDFScale
+                  << " lsb" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <Fusion.hpp>
+#include <VolumeSnapshot.hpp>
+#include <ColorVolume.hpp>
+#include "SyntheticScene.h"
+
+namespace {
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+}
+
+/*
+ * Integrates frames into volumes of several storages and layouts, saves them as VolumeSnapshot and loads them again.
+ * Reports the size of the snapshot against the memory of the volume and the time to save and load it, and checks that
+ * every voxel and color voxel of the loaded volume equals the original and that saving it gives the same file.
+ * The snapshots are written to the results directory.
+ * usage: snapshot_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << std::endl;
+
+    struct Layout {
+        VolumeStorage storage;
+        VolumeLayout layout;
+        int maxLevel;
+        int colorDownsampling;
+        //MiB of bricks kept in memory by a paged volume, 0 keeps all
+        size_t pagingBudget;
+    };
+    const Layout layouts[] = {{VolumeStorage::FixedPoint, VolumeLayout::Linear, 0, 0, 0},
+                              {VolumeStorage::Double, VolumeLayout::Bricked, 0, 0, 0},
+                              {VolumeStorage::Planar, VolumeLayout::Linear, 0, 2, 0},
+                              {VolumeStorage::FixedPoint, VolumeLayout::Hashed, 0, 0, 0},
+                              {VolumeStorage::FixedPoint, VolumeLayout::Hashed, 2, 0, 0},
+                              {VolumeStorage::FixedPoint, VolumeLayout::Hashed, 0, 0, 8}};
+
+    for (const Layout& layout : layouts) {
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, layout.storage,
+                                               layout.colorDownsampling == 0, layout.layout, layout.maxLevel, 1.);
+        if (layout.colorDownsampling > 0)
+            volume->enableColorVolume(layout.colorDownsampling);
+        if (layout.pagingBudget > 0)
+            volume->enablePaging(PROJECT_DIR + std::string("/results/snapshot_benchmark.swap"), layout.pagingBudget << 20);
+        for (const auto& frame : sequence)
+            fusion.reconstructSurface(frame, volume, truncationDistance);
+
+        const std::string path = PROJECT_DIR + std::string("/results/snapshot_benchmark.kfvs");
+        bool saved = false;
+        const double saveSeconds = measureSeconds([&]() { saved = VolumeSnapshot::save(*volume, path); });
+        std::shared_ptr<Volume> loaded;
+        const double loadSeconds = measureSeconds([&]() { loaded = VolumeSnapshot::load(path); });
+        const std::string snapshot = readFile(path);
+
+        std::cout << toString(layout.storage) << " " << toString(layout.layout);
+        if (layout.maxLevel > 0)
+            std::cout << " with " << layout.maxLevel << " levels";
+        if (layout.colorDownsampling > 0)
+            std::cout << ", color volume 1/" << layout.colorDownsampling;
+        if (layout.pagingBudget > 0)
+            std::cout << ", paged with " << layout.pagingBudget << " MiB";
+        std::cout << ": memory " << volume->getResidentMemoryUsage() / (1024. * 1024.) << " MiB, snapshot "
+                  << snapshot.size() / (1024. * 1024.) << " MiB, save " << 1000. * saveSeconds << " ms, load "
+                  << 1000. * loadSeconds << " ms" << std::endl;
+        if (!saved || !loaded) {
+            std::cout << "  failed to " << (saved ? "load" : "save") << " the snapshot" << std::endl;
+            continue;
+        }
+
+        // swapped out bricks read as unobserved, the working set may exceed the budget until the next evictBricks
+        if (volume->isPaged())
+            volume->pageIn(Eigen::Vector3i::Zero(), volumeSize);
+        size_t differing = 0;
+        for (int z = 0; z < resolution; ++z) {
+            for (int y = 0; y < resolution; ++y) {
+                for (int x = 0; x < resolution; ++x) {
+                    const Voxel a = volume->getVoxel(x, y, z), b = loaded->getVoxel(x, y, z);
+                    if (a.tsdf != b.tsdf || a.weight != b.weight || a.color != b.color)
+                        differing++;
+                }
+            }
+        }
+        if (const ColorVolume* colors = volume->getColorVolume().get()) {
+            const Eigen::Vector3i& size = colors->getSize();
+            for (int z = 0; z < size.z(); ++z) {
+                for (int y = 0; y < size.y(); ++y) {
+                    for (int x = 0; x < size.x(); ++x) {
+                        const ColorVoxel& a = colors->getVoxel(x, y, z);
+                        const ColorVoxel& b = loaded->getColorVolume()->getVoxel(x, y, z);
+                        if (a.weight != b.weight || a.rgb[0] != b.rgb[0] || a.rgb[1] != b.rgb[1] || a.rgb[2] != b.rgb[2])
+                            differing++;
+                    }
+                }
+            }
+        }
+        const std::string resavedPath = PROJECT_DIR + std::string("/results/snapshot_benchmark_resaved.kfvs");
+        VolumeSnapshot::save(*loaded, resavedPath);
+        std::cout << "  differing voxels: " << differing << ", saved again "
+                  << (readFile(resavedPath) == snapshot ? "identical" : "differs") << std::endl;
+    }
+    return 0;
+}
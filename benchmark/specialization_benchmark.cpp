@@ -0,0 +1,78 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include <Marching_cubes.hpp>
+#include <VolumeGrid.hpp>
+#include "SyntheticScene.h"
+
+namespace {
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+}
+
+/*
+ * Raycasts and meshes a linear volume once through the VolumeGrid instantiated for its size and once through the
+ * generic Volume accessors, for the double and the fixed point storage, and checks that both produce the same
+ * points and the same mesh. The mesh is written to the results directory, its time includes the file output.
+ * usage: specialization_benchmark [volume resolution, 256 or 512] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 5;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << std::endl;
+
+    for (auto storage : {VolumeStorage::Double, VolumeStorage::FixedPoint}) {
+        auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, storage, true);
+        const int log = getVolumeGridLog(volumeSize, storage, volume->getLayout());
+        std::cout << toString(storage) << (log ? ", specialized for 2^" + std::to_string(log) : ", no specialization")
+                  << std::endl;
+        Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+        fusion.setIntegrationKernel(IntegrationKernel::Simd);
+        for (int i = 0; i < frames; ++i)
+            fusion.reconstructSurface(scene.renderFrame(0.002 * i), volume, truncationDistance);
+
+        std::vector<Eigen::Vector3d> points[2];
+        std::string meshes[2];
+        for (int specialized = 1; specialized >= 0; --specialized) {
+            volume->setSpecializedAccess(specialized != 0);
+            std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+            Raycast raycast;
+            const double raycastSeconds = measureSeconds([&]() {
+                raycast.surfacePrediction(frame, volume, float(truncationDistance));
+            });
+            points[specialized] = frame->getGlobalPoints();
+
+            const std::string name = "specialization_benchmark";
+            const double meshSeconds = measureSeconds([&]() { MarchingCubes::extractMesh(*volume, name); });
+            meshes[specialized] = readFile(PROJECT_DIR + std::string("/results/") + name + ".off");
+
+            std::cout << "  " << (specialized ? "specialized" : "generic") << " raycast: " << 1000. * raycastSeconds
+                      << " ms, marching cubes: " << 1000. * meshSeconds << " ms" << std::endl;
+        }
+
+        size_t differingPoints = 0;
+        for (size_t i = 0; i < points[0].size(); ++i)
+            if (points[0][i] != points[1][i])
+                differingPoints++;
+        std::cout << "  differing raycast points: " << differingPoints << ", meshes "
+                  << (meshes[0] == meshes[1] ? "identical" : "differ") << " (" << meshes[0].size() / 1024 << " KiB)"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cmath>
+#include <Fusion.hpp>
+#include "SyntheticScene.h"
+
+/*
+ * Times the voxel sweep against depth pixel splatting for growing volume resolutions and cross-validates both modes
+ * on a single frame: inside the truncation band every voxel written by the splatting has to hold exactly the value
+ * written by the sweep.
+ * usage: splatting_benchmark [max volume resolution]
+ */
+int main(int argc, char** argv) {
+    const int maxResolution = argc > 1 ? std::atoi(argv[1]) : 512;
+    const double truncationDistance = 0.06;
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+
+    SyntheticScene scene;
+    auto frame = scene.renderFrame(0.02);
+
+    for (int resolution = 64; resolution <= maxResolution; resolution *= 2) {
+        const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+        const double voxelScale = volumeRange.x() / resolution;
+
+        std::vector<std::shared_ptr<Volume>> volumes;
+        std::cout << resolution << "^3:";
+        for (auto mode : {IntegrationMode::VoxelSweep, IntegrationMode::DepthSplatting}) {
+            Fusion fusion(1);
+            // the splatting is compared with the double precision sweep
+            fusion.setIntegrationKernel(IntegrationKernel::Scalar);
+            fusion.setIntegrationMode(mode);
+            auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale);
+            const double seconds = measureSeconds([&]() {
+                fusion.reconstructSurface(frame, volume, truncationDistance);
+            });
+            std::cout << " " << toString(mode) << " " << 1000. * seconds << " ms";
+            volumes.push_back(volume);
+        }
+
+        const auto& sweep = volumes[0]->getVoxelData();
+        const auto& splat = volumes[1]->getVoxelData();
+        size_t mismatches = 0, missed = 0, band = 0;
+        for (size_t i = 0; i < sweep.size(); ++i) {
+            const bool inBand = sweep[i].weight > 0 && std::abs(sweep[i].tsdf) < 1.;
+            band += inBand;
+            if (splat[i].weight > 0) {
+                if (splat[i].tsdf != sweep[i].tsdf || splat[i].color != sweep[i].color)
+                    mismatches++;
+            } else if (inBand) {
+                missed++;
+            }
+        }
+        std::cout << " | band voxels " << band << ", missed " << missed << ", mismatches " << mismatches << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <Fusion.hpp>
+#include <Raycast.hpp>
+#include <MeshWriter.h>
+#include <BrickSummary.hpp>
+#include "SyntheticScene.h"
+
+namespace {
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+}
+
+/*
+ * Integrates the same frames into a volume without and a volume with a BrickSummary, then raycasts, meshes and
+ * exports the tsdf of both. Reports the times, checks that the outputs are identical and that the incrementally
+ * updated summary equals one rebuilt from the voxels. The files are written to the results directory, the times
+ * include the file output.
+ * usage: summary_benchmark [volume resolution] [frames]
+ */
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double truncationDistance = 0.06;
+
+    const Eigen::Vector3d volumeRange(2.5, 2.5, 2.5);
+    const Eigen::Vector3d volumeOrigin(-volumeRange.x() / 2, -volumeRange.y() / 2, 0.5);
+    const Eigen::Vector3i volumeSize(resolution, resolution, resolution);
+    const double voxelScale = volumeRange.x() / resolution;
+
+    SyntheticScene scene;
+    std::vector<std::shared_ptr<Frame>> sequence;
+    for (int i = 0; i < frames; ++i)
+        sequence.push_back(scene.renderFrame(0.002 * i));
+    std::cout << "Volume: " << resolution << "^3, frames: " << frames << std::endl;
+
+    for (auto layout : {VolumeLayout::Linear, VolumeLayout::Bricked, VolumeLayout::Hashed}) {
+        std::cout << toString(layout) << std::endl;
+        std::vector<Eigen::Vector3d> points[2];
+        std::string outputs[2][2];
+        for (int summarized = 0; summarized < 2; ++summarized) {
+            Fusion fusion(std::max(1u, std::thread::hardware_concurrency()));
+            fusion.setIntegrationKernel(IntegrationKernel::Simd);
+            auto volume = std::make_shared<Volume>(volumeOrigin, volumeSize, voxelScale, VolumeStorage::FixedPoint,
+                                                   true, layout);
+            if (summarized)
+                volume->enableBrickSummary();
+
+            double integrationSeconds = 0.;
+            for (const auto& frame : sequence)
+                integrationSeconds += measureSeconds([&]() {
+                    fusion.reconstructSurface(frame, volume, truncationDistance);
+                });
+
+            std::shared_ptr<Frame> frame = scene.renderFrame(0.002 * frames);
+            Raycast raycast;
+            const double raycastSeconds = measureSeconds([&]() {
+                raycast.surfacePrediction(frame, volume, float(truncationDistance));
+            });
+            points[summarized] = frame->getGlobalPoints();
+
+            const std::string mesh = "summary_benchmark_mesh", tsdf = "summary_benchmark_tsdf";
+            const double meshSeconds = measureSeconds([&]() { MarchingCubes::extractMesh(*volume, mesh); });
+            outputs[summarized][0] = readFile(PROJECT_DIR + std::string("/results/") + mesh + ".off");
+            const double tsdfSeconds = measureSeconds([&]() { MeshWriter::toFileTSDF(tsdf, *volume, 2, 0.5); });
+            outputs[summarized][1] = readFile(PROJECT_DIR + std::string("/results/") + tsdf + ".off");
+
+            std::cout << "  " << (summarized ? "with summary" : "without summary") << " integration: "
+                      << 1000. * integrationSeconds / frames << " ms/frame, raycast: " << 1000. * raycastSeconds
+                      << " ms, marching cubes: " << 1000. * meshSeconds << " ms, tsdf export: "
+                      << 1000. * tsdfSeconds << " ms" << std::endl;
+
+            if (!summarized)
+                continue;
+            const BrickSummary& summary = *volume->getBrickSummary();
+            BrickSummary rebuilt(volumeSize);
+            rebuilt.rebuild(*volume);
+            size_t differing = 0;
+            const Eigen::Vector3i& count = summary.getBrickCount();
+            for (int z = 0; z < count.z(); ++z) {
+                for (int y = 0; y < count.y(); ++y) {
+                    for (int x = 0; x < count.x(); ++x) {
+                        const BrickSummary::Brick& a = summary.getBrick(x, y, z);
+                        const BrickSummary::Brick& b = rebuilt.getBrick(x, y, z);
+                        if (a.flags != b.flags ||
+                            (a.flags && (a.minTSDF != b.minTSDF || a.maxTSDF != b.maxTSDF)))
+                            differing++;
+                    }
+                }
+            }
+            std::cout << "  bricks: " << count.prod() << ", observed: " << summary.count(BrickSummary::Observed)
+                      << ", with zero crossing: " << summary.count(BrickSummary::ZeroCrossing)
+                      << ", differing from a rebuild: " << differing << std::endl;
+        }
+
+        size_t differingPoints = 0;
+        for (size_t i = 0; i < points[0].size(); ++i)
+            if (points[0][i] != points[1][i] && (points[0][i].allFinite() || points[1][i].allFinite()))
+                differingPoints++;
+        std::cout << "  differing raycast points: " << differingPoints << ", meshes "
+                  << (outputs[0][0] == outputs[1][0] ? "identical" : "differ") << ", tsdf exports "
+                  << (outputs[0][1] == outputs[1][1] ? "identical" : "differ") << std::endl;
+    }
+    return 0;
+}
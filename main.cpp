@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <vector>
+#include <chrono>
 #include <zconf.h>
 #include <Volume.hpp>
 #include <Fusion.hpp>
@@ -14,6 +15,10 @@
 #include <Recorder.h>
 #include <MeshWriter.h>
 #include <KinectVirtualSensor.h>
+#include <IntegrationScheduler.hpp>
+#include <TSDFPyramid.hpp>
+#include <VolumeSnapshot.hpp>
+#include <VolumeCheckpoint.hpp>
 
 #include "VirtualSensor.h"
 #include "icp.h"
@@ -26,9 +31,15 @@ VirtualSensor sensor;
 // KinectVirtualSensor sensor(PROJECT_DATA_DIR + std::string("/sample0"), 5 );
 //Recorder rec;
 
-bool process_frame( size_t frame_cnt, std::shared_ptr<Frame> prevFrame,std::shared_ptr<Frame> currentFrame, std::shared_ptr<Volume> volume,const Config& config)
+// pose of every frame selected for integration together with its index in the sequence
+typedef std::vector<std::pair<unsigned int, Eigen::Matrix4d>,
+                    Eigen::aligned_allocator<std::pair<unsigned int, Eigen::Matrix4d>>> Trajectory;
+
+/*
+ * Estimates the global pose of the current frame by aligning it to the previous one.
+ */
+void track_frame( size_t frame_cnt, std::shared_ptr<Frame> prevFrame,std::shared_ptr<Frame> currentFrame,const Config& config)
 {
-    // STEP 1: estimate Pose
     icp icp(config.m_dist_threshold,config.m_normal_threshold);
 
     Eigen::Matrix4d estimated_pose = prevFrame->getGlobalPose();
@@ -44,21 +55,140 @@ bool process_frame( size_t frame_cnt, std::shared_ptr<Frame> prevFrame,std::shar
         filename << "frame" << frame_cnt << "pre";
         MeshWriter::toFile(filename.str(), currentFrame);
     }
+}
+
+/*
+ * Tracks the current frame against the previous one and, if the scheduler decides the camera moved enough,
+ * integrates it and raycasts the model for the next frame.
+ * If a pyramid is given, its levels are updated with the integrated bricks and the raycast reads the tracking level.
+ * If a checkpoint is given, the integrated bricks are marked for its next delta.
+ * Returns false if the frame was skipped, the previous frame then stays the tracking reference.
+ */
+bool process_frame( size_t frame_cnt, std::shared_ptr<Frame> prevFrame,std::shared_ptr<Frame> currentFrame, std::shared_ptr<Volume> volume,const Config& config, IntegrationScheduler& scheduler,
+                    TSDFPyramid* pyramid, VolumeCheckpoint* checkpoint)
+{
+    // STEP 1: estimate Pose
+    track_frame(frame_cnt, prevFrame, currentFrame, config);
+    const Eigen::Matrix4d& estimated_pose = currentFrame->getGlobalPose();
+
+    if (!scheduler.shouldIntegrate(estimated_pose)) {
+        std::cout << "Camera static, skipping integration (" << scheduler.getSkippedFrames() << " frames skipped)" << std::endl;
+        return false;
+    }
 
     // STEP 2: Surface reconstruction
     std::cout << "Init: Fusion..." << std::endl;
-    if(!fusion.reconstructSurface(currentFrame,volume, config.m_truncationDistance)){
+    DirtyBricks dirtyBricks(volume->getVolumeSize());
+    if(!fusion.reconstructSurface(currentFrame,volume, config.m_truncationDistance,
+                                  pyramid || checkpoint ? &dirtyBricks : nullptr)){
         throw "Surface reconstruction failed";
     };
+    if (pyramid)
+        pyramid->update(dirtyBricks);
+    if (checkpoint)
+        checkpoint->markBricks(dirtyBricks);
 
     std::cout << "Init: Raycast..." << std::endl;
-    if(!raycast.surfacePrediction(currentFrame,volume, config.m_truncationDistance)){
+    std::shared_ptr<Volume> trackingVolume = pyramid ? pyramid->getLevel(config.m_trackingLevel) : volume;
+    // the rays step by half the truncation distance, on a coarse level by as many of its voxels as on the volume
+    const double levelScale = trackingVolume->getVoxelScale() / volume->getVoxelScale();
+    if(!raycast.surfacePrediction(currentFrame,trackingVolume, config.m_truncationDistance * levelScale)){
         throw "Raycasting failed";
     };
     std::cout << "Done!" << std::endl;
     return true;
 }
 
+/*
+ * Offline pass 1: tracks the frames 1..iMax of the sequence without touching the volume. Every frame is aligned to
+ * the last frame selected by the scheduler, as in the online pipeline, but against its measured surface instead of a
+ * raycast of the model. Only the poses are kept, the frames themselves are released right away.
+ */
+Trajectory track_sequence(VirtualSensor& sensor, std::shared_ptr<Frame> prevFrame, int iMax, const Config& config, IntegrationScheduler& scheduler)
+{
+    Trajectory trajectory;
+    int i = 1;
+    while( i <= iMax && sensor.processNextFrame() ){
+
+        const double* depthMap = &sensor.getDepth()[0];
+        BYTE* colors = &sensor.getColorRGBX()[0];
+        std::shared_ptr<Frame> currentFrame = std::make_shared<Frame>(Frame(depthMap, colors, sensor.getDepthIntrinsics(), sensor.getColorIntrinsics(),
+                                                                            sensor.getD2CExtrinsics(), sensor.getDepthImageWidth(), sensor.getDepthImageHeight()));
+
+        track_frame(i, prevFrame, currentFrame, config);
+
+        if (scheduler.shouldIntegrate(currentFrame->getGlobalPose())) {
+            trajectory.emplace_back(sensor.getCurrentFrameCnt(), currentFrame->getGlobalPose());
+            prevFrame = std::move(currentFrame);
+        }
+        i++;
+    }
+    return trajectory;
+}
+
+/*
+ * Offline pass 2: replays the sequence, attaches the tracked poses and integrates the frames in batches of
+ * config.m_offlineBatchSize. The frames of a batch are integrated one after another, Fusion splits each of them into
+ * z-slabs over all cores without any synchronisation on the volume.
+ * A rolling volume follows the replayed camera like in the online loop, a batch ends at every frame after which the
+ * volume shifts.
+ */
+bool integrate_sequence(const std::string& datasetDir, const Trajectory& trajectory, std::shared_ptr<Volume> volume, const Config& config,
+                        const Eigen::Vector3d& rollingAnchor)
+{
+    VirtualSensor replay;
+    if (!replay.init(datasetDir)) {
+        std::cout << "Failed to initialize the sensor for the replay!" << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Frame>> batch;
+    auto pose = trajectory.begin();
+    while( pose != trajectory.end() && replay.processNextFrame() ){
+        if (replay.getCurrentFrameCnt() != pose->first) continue;
+
+        const double* depthMap = &replay.getDepth()[0];
+        BYTE* colors = &replay.getColorRGBX()[0];
+        std::shared_ptr<Frame> frame = std::make_shared<Frame>(Frame(depthMap, colors, replay.getDepthIntrinsics(), replay.getColorIntrinsics(),
+                                                                     replay.getD2CExtrinsics(), replay.getDepthImageWidth(), replay.getDepthImageHeight()));
+        frame->setGlobalPose(pose->second);
+        const Eigen::Vector3d position = pose->second.block<3, 1>(0, 3);
+        batch.push_back(std::move(frame));
+        ++pose;
+
+        const bool shift = !volume->getFollowShift(position, rollingAnchor, config.m_volumeShiftThreshold).isZero();
+        if (batch.size() >= std::max(1u, config.m_offlineBatchSize) || pose == trajectory.end() || shift) {
+            std::cout << "Init: Fusion of " << batch.size() << " frames..." << std::endl;
+            for (const auto& batchFrame : batch)
+                if(!fusion.reconstructSurface(batchFrame,volume, config.m_truncationDistance)){
+                    throw "Surface reconstruction failed";
+                };
+            batch.clear();
+        }
+        if (shift) {
+            volume->followPoint(position, rollingAnchor, config.m_volumeShiftThreshold);
+            std::cout << "Volume shifted to " << volume->getOrigin().transpose() << std::endl;
+        }
+    }
+    return pose == trajectory.end();
+}
+
+//saves the volume to config.m_volumeSnapshotFile in the results directory, if one is set
+void save_snapshot(Volume& volume, const Config& config) {
+    if (config.m_volumeSnapshotFile.empty())
+        return;
+    const std::string path = PROJECT_DIR + std::string("/results/") + config.m_volumeSnapshotFile;
+    const auto start = std::chrono::steady_clock::now();
+    if (!VolumeSnapshot::save(volume, path)) {
+        std::cout << "Failed to save the volume to " << path << std::endl;
+        return;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::cout << "Saved the volume to " << path << ": " << file.tellg() / (1024 * 1024) << " MiB in " << seconds
+              << " s" << std::endl;
+}
+
 int main(){
 
     // Recorder rec;
@@ -93,10 +223,56 @@ int main(){
     //print Configuration to File
     config.printToFile("config");
 
+    fusion.setNumThreads(config.m_numThreads);
+    fusion.setIntegrationKernel(config.m_integrationKernel);
+    fusion.setIntegrationMode(config.m_integrationMode);
+
+    IntegrationScheduler scheduler(config.m_integrationMinTranslation, config.m_integrationMinRotation,
+                                   config.m_integrationMaxSkippedFrames);
+
     /*
      * Setting up the Volume from Configuration
      */
-    auto volume = std::make_shared<Volume>(config.m_volumeOrigin, config.m_volumeSize,config.m_voxelScale) ;
+    auto volume = std::make_shared<Volume>(config.m_volumeOrigin, config.m_volumeSize,config.m_voxelScale,config.m_volumeStorage,
+                                           config.m_volumeColor && config.m_volumeColorDownsampling <= 1,
+                                           config.m_volumeLayout,config.m_volumeMaxLevel,
+                                           config.m_volumeLevelDistance) ;
+    if (config.m_volumePagingBudget > 0 &&
+        !volume->enablePaging(PROJECT_DIR + std::string("/results/") + config.m_volumePagingFile,
+                              size_t(config.m_volumePagingBudget) << 20)) {
+        std::cout << "Failed to enable paging, it needs the hashed layout and a writable swap file!" << std::endl;
+        return -1;
+    }
+    if (config.m_volumeColor && config.m_volumeColorDownsampling > 1 &&
+        !volume->enableColorVolume(config.m_volumeColorDownsampling)) {
+        std::cout << "Failed to create the color volume, the downsampling has to be 2, 4 or 8!" << std::endl;
+        return -1;
+    }
+    volume->setSpecializedAccess(config.m_volumeSpecialization);
+    if (config.m_volumeBrickSummary && !volume->enableBrickSummary())
+        std::cout << "No brick summary, it is not supported with several levels" << std::endl;
+    if (config.m_volumeHugePages && !volume->enableHugePages())
+        std::cout << "Huge pages are not available, the volume uses normal pages" << std::endl;
+    if (config.m_volumeRolling) {
+        if (!volume->enableRolling()) {
+            std::cout << "Failed to enable rolling, it needs the linear or bricked layout!" << std::endl;
+            return -1;
+        }
+        //the slabs leaving the volume are meshed before they are cleared
+        volume->setSlabCallback([](Volume& v, const Eigen::Vector3i& minVoxel, const Eigen::Vector3i& maxVoxel) {
+            static int slab = 0;
+            MarchingCubes::extractMesh(v, "slab_" + std::to_string(slab++), minVoxel, maxVoxel);
+        });
+    }
+    if (config.m_volumeNumaPlacement) {
+        if (volume->placeSlabs(getNumaNodes())) {
+            for (const auto& slab : volume->getSlabPlacement())
+                std::cout << "Volume slab z " << slab.zBegin << " - " << slab.zEnd << " on NUMA node " << slab.node.id
+                          << std::endl;
+        } else {
+            std::cout << "Volume not placed, it needs a linear layout, no rolling and several NUMA nodes" << std::endl;
+        }
+    }
 
     /*
      * Process a first frame as a reference frame.
@@ -118,13 +294,46 @@ int main(){
     int i = 1;
     const int iMax = 20;
 
+    //position of the camera relative to the volume the rolling volume keeps
+    const Eigen::Vector3d rollingAnchor = prevFrame->getGlobalPose().block<3, 1>(0, 3) - volume->getOrigin();
+
+    if (config.m_pipelineMode == PipelineMode::Offline) {
+        const Trajectory trajectory = track_sequence(sensor, prevFrame, iMax, config, scheduler);
+        std::cout << "Tracked " << trajectory.size() << " frames, integrating..." << std::endl;
+        if (!integrate_sequence(filenameIn, trajectory, volume, config, rollingAnchor)) {
+            std::cout << "Failed to replay the sequence!" << std::endl;
+            return -1;
+        }
+        MeshWriter::toFileMarchingCubes("marchingCubes_offline", *volume);
+        save_snapshot(*volume, config);
+        std::cout << "Integrated " << scheduler.getIntegratedFrames() << " frames, skipped "
+                  << scheduler.getSkippedFrames() << " frames" << std::endl;
+        return 0;
+    }
+
+    std::unique_ptr<TSDFPyramid> pyramid;
+    if (config.m_volumePyramidLevels > 0)
+        pyramid.reset(new TSDFPyramid(volume, config.m_volumePyramidLevels));
+
+    const std::string checkpointPath = PROJECT_DIR + std::string("/results/") + config.m_volumeCheckpointFile;
+    std::unique_ptr<VolumeCheckpoint> checkpoint;
+    if (!config.m_volumeCheckpointFile.empty()) {
+        checkpoint.reset(new VolumeCheckpoint(volume, checkpointPath));
+        if (!checkpoint->isOpen()) {
+            std::cout << "Failed to write the checkpoint to " << checkpointPath << "!" << std::endl;
+            return -1;
+        }
+    }
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+
     while( i <= iMax && sensor.processNextFrame() ){
 
         const double* depthMap = &sensor.getDepth()[0];
         BYTE* colors = &sensor.getColorRGBX()[0];
         std::shared_ptr<Frame> currentFrame = std::make_shared<Frame>(Frame(depthMap, colors, depthIntrinsics,colIntrinsics, d2cExtrinsics, depthWidth, depthHeight));
 
-        process_frame(i,prevFrame,currentFrame,volume,config);
+        const bool integrated = process_frame(i,prevFrame,currentFrame,volume,config,scheduler,pyramid.get(),
+                                              checkpoint.get());
 
         if ((i-1) % 5 == 0) {
             std::stringstream filename;
@@ -136,8 +345,59 @@ int main(){
             MeshWriter::toFileTSDF(std::string("tsdf_") + std::to_string(i),*volume);
         }
 
-        prevFrame = std::move(currentFrame);
+        if (integrated)
+            prevFrame = std::move(currentFrame);
+        if (volume->isRolling() &&
+            volume->followPoint(prevFrame->getGlobalPose().block<3, 1>(0, 3), rollingAnchor, config.m_volumeShiftThreshold)) {
+            std::cout << "Volume shifted to " << volume->getOrigin().transpose() << std::endl;
+            if (pyramid)
+                pyramid->rebuild();
+            if (checkpoint)
+                checkpoint->trackShift();
+        }
+        // the delta is only copied here, the writer thread appends it to the log
+        if (checkpoint && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >=
+                          config.m_volumeCheckpointInterval) {
+            if (!checkpoint->write())
+                std::cout << "Failed to append the checkpoint to " << VolumeCheckpoint::getLogPath(checkpointPath)
+                          << std::endl;
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
         i++;
 
     }
+    if (pyramid)
+        MeshWriter::toFileMarchingCubes("marchingCubes_level" + std::to_string(pyramid->getLevelCount()),
+                                        *pyramid->getLevel(pyramid->getLevelCount()));
+    save_snapshot(*volume, config);
+    if (checkpoint) {
+        checkpoint->write();
+        checkpoint->flush();
+        const VolumeCheckpoint::Stats stats = checkpoint->getStats();
+        std::cout << "Checkpoints: " << stats.deltas << " deltas of " << stats.bricks << " bricks, "
+                  << stats.bytes / (1024 * 1024) << " MiB, copying took " << stats.copySeconds << " s, stalled "
+                  << stats.stallSeconds << " s" << std::endl;
+        checkpoint.reset();
+        if (!VolumeCheckpoint::compact(checkpointPath))
+            std::cout << "Failed to compact the checkpoint " << checkpointPath << std::endl;
+    }
+    std::cout << "Integrated " << scheduler.getIntegratedFrames() << " frames, skipped "
+              << scheduler.getSkippedFrames() << " frames" << std::endl;
+    std::cout << "Volume memory: " << volume->getResidentMemoryUsage() / (1024 * 1024) << " MiB resident of "
+              << volume->getMemoryUsage() / (1024 * 1024) << " MiB" << std::endl;
+    if (volume->getColorVolume())
+        std::cout << "Color volume memory: " << volume->getColorVolume()->getResidentMemoryUsage() / (1024 * 1024)
+                  << " MiB resident of " << volume->getColorVolume()->getMemoryUsage() / (1024 * 1024) << " MiB"
+                  << std::endl;
+    if (!volume->getSlabPlacement().empty()) {
+        std::cout << "Volume placement:";
+        for (const auto& node : volume->getResidentBytesPerNode())
+            std::cout << " node " << node.first << ": " << node.second / (1024 * 1024) << " MiB";
+        std::cout << std::endl;
+    }
+    if (volume->isPaged()) {
+        const auto& stats = volume->getPagingStats();
+        std::cout << "Paging: hit rate " << stats.hitRate() << ", " << stats.loads << " bricks read, " << stats.writes
+                  << " written, stalled " << stats.stallSeconds << " s" << std::endl;
+    }
 }